@@ -0,0 +1,378 @@
+// bench/disk_bench.cpp
+//
+// 磁盘后端基准：在目标文件系统上用 libtorrent 的 add_piece / read_piece 做顺序和随机的
+// piece 写、读，比较 disk_io 的几个后端（bt_disk_io.hpp），用来按部署选后端。
+//
+// 每个阶段新建一个 session，结束时 session 析构保证文件都已关闭；读之前 fsync 并
+// posix_fadvise(DONTNEED)，尽量让读落到存储上而不是页缓存（NFS 上效果取决于客户端）。
+// 写的计时包含 add_piece 的 SHA-1 校验和最后的 fsync，单独列出 SHA-1 速度供对照。
+//
+//   disk_bench --dir /mnt/nvme/tmp [--backend all|default|mmap|posix|small_files]
+//              [--size 1G] [--files 1] [--piece-size-kb 0] [--depth 32]
+//              [--storage-mode sparse|allocate] [--file-pool N] [--keep]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libtorrent/add_torrent_params.hpp>
+#include <libtorrent/alert_types.hpp>
+#include <libtorrent/bencode.hpp>
+#include <libtorrent/create_torrent.hpp>
+#include <libtorrent/file_storage.hpp>
+#include <libtorrent/hasher.hpp>
+#include <libtorrent/session.hpp>
+#include <libtorrent/session_params.hpp>
+#include <libtorrent/settings_pack.hpp>
+#include <libtorrent/torrent_flags.hpp>
+#include <libtorrent/torrent_handle.hpp>
+#include <libtorrent/torrent_info.hpp>
+
+#include "bt_disk_io.hpp"
+
+namespace lt = libtorrent;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const int kDistinctPieces = 16;                 // piece 内容在这么多份随机数据里轮换
+const auto kPhaseTimeout = std::chrono::minutes(30);
+
+struct Options {
+    std::string dir = "/tmp";
+    std::string backend = "all";
+    int64_t size = int64_t(1) << 30;
+    int files = 1;
+    int piece_size_kb = 0;
+    int depth = 32;
+    lt::storage_mode_t storage_mode = lt::storage_mode_sparse;
+    int file_pool = 0;
+    bool keep = false;
+};
+
+Options g_opt;
+std::string g_workdir;
+std::vector<std::vector<char>> g_pieceData;      // 下标 piece % kDistinctPieces
+std::string g_torrentPath;
+int g_numPieces = 0;
+int g_pieceLength = 0;
+
+[[noreturn]] void die(const std::string& msg)
+{
+    std::fprintf(stderr, "disk_bench: %s\n", msg.c_str());
+    std::exit(1);
+}
+
+bool parse_size(const char* s, int64_t& out)
+{
+    char* end;
+    unsigned long long v = std::strtoull(s, &end, 10);
+    if (end == s) return false;
+    switch (*end) {
+        case 'k': case 'K': v <<= 10; ++end; break;
+        case 'm': case 'M': v <<= 20; ++end; break;
+        case 'g': case 'G': v <<= 30; ++end; break;
+        default: break;
+    }
+    if (*end != '\0' || v == 0) return false;
+    out = int64_t(v);
+    return true;
+}
+
+double mib(int64_t bytes)
+{
+    return double(bytes) / (1024.0 * 1024.0);
+}
+
+double seconds(Clock::duration d)
+{
+    return std::chrono::duration<double>(d).count();
+}
+
+/* ---------- 测试 torrent ---------- */
+
+void fill_random(std::vector<char>& buf, uint64_t seed)
+{
+    uint64_t x = seed * 0x9e3779b97f4a7c15ull + 1;
+    for (size_t i = 0; i + 8 <= buf.size(); i += 8) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        std::memcpy(&buf[i], &x, 8);
+    }
+}
+
+// 只生成 .torrent，不落盘数据：piece 内容由下标决定，写阶段再用 add_piece 写入
+void make_torrent()
+{
+    lt::file_storage fs;
+    int64_t per = g_opt.size / g_opt.files;
+    for (int i = 0; i < g_opt.files; ++i) {
+        int64_t sz = (i == g_opt.files - 1) ? g_opt.size - per * (g_opt.files - 1) : per;
+        char name[64];
+        if (g_opt.files == 1) std::snprintf(name, sizeof(name), "payload/data.bin");
+        else std::snprintf(name, sizeof(name), "payload/d%03d/f%06d.bin", i / 1000, i);
+        fs.add_file(name, sz);
+    }
+
+    lt::create_torrent ct(fs, g_opt.piece_size_kb * 1024, lt::create_torrent::v1_only);
+    g_numPieces = ct.num_pieces();
+    g_pieceLength = ct.piece_length();
+
+    g_pieceData.resize(kDistinctPieces);
+    for (int i = 0; i < kDistinctPieces; ++i) {
+        g_pieceData[i].resize(size_t(g_pieceLength));
+        fill_random(g_pieceData[i], uint64_t(i));
+    }
+    for (int p = 0; p < g_numPieces; ++p) {
+        lt::piece_index_t pi(p);
+        lt::hasher h(g_pieceData[p % kDistinctPieces].data(), ct.piece_size(pi));
+        ct.set_hash(pi, h.final());
+    }
+
+    std::vector<char> buf;
+    lt::bencode(std::back_inserter(buf), ct.generate());
+    g_torrentPath = g_workdir + "/payload.torrent";
+    std::ofstream out(g_torrentPath, std::ios::binary);
+    out.write(buf.data(), std::streamsize(buf.size()));
+    if (!out) die("write torrent failed");
+}
+
+/* ---------- 页缓存 ---------- */
+
+int sync_drop_entry(const char* path, const struct stat* sb, int flag, struct FTW*)
+{
+    if (flag != FTW_F || !S_ISREG(sb->st_mode)) return 0;
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    ::fsync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+    return 0;
+}
+
+void sync_and_drop(const std::string& dir)
+{
+    nftw(dir.c_str(), sync_drop_entry, 16, FTW_PHYS);
+}
+
+int rm_entry(const char* path, const struct stat*, int, struct FTW*)
+{
+    return ::remove(path);
+}
+
+/* ---------- 阶段 ---------- */
+
+enum class Op { Write, Read };
+
+std::unique_ptr<lt::session> make_session(const std::string& backend)
+{
+    lt::settings_pack pack;
+    pack.set_int(lt::settings_pack::alert_mask,
+                 lt::alert::error_notification | lt::alert::status_notification |
+                 lt::alert::storage_notification | lt::alert::piece_progress_notification);
+    pack.set_int(lt::settings_pack::alert_queue_size, 100000);
+    pack.set_str(lt::settings_pack::listen_interfaces, "127.0.0.1:0");
+    pack.set_bool(lt::settings_pack::enable_dht, false);
+    pack.set_bool(lt::settings_pack::enable_lsd, false);
+    pack.set_bool(lt::settings_pack::enable_upnp, false);
+    pack.set_bool(lt::settings_pack::enable_natpmp, false);
+    if (g_opt.file_pool > 0) pack.set_int(lt::settings_pack::file_pool_size, g_opt.file_pool);
+
+    lt::session_params params(std::move(pack));
+    if (!bt_disk_io_setup(backend, params)) die("unknown backend " + backend);
+    return std::make_unique<lt::session>(std::move(params));
+}
+
+// 等到 pred 返回 true；pred 逐个处理 alert
+template <typename Pred>
+void pump_alerts(lt::session& ses, Clock::time_point deadline, Pred&& pred)
+{
+    std::vector<lt::alert*> alerts;
+    while (Clock::now() < deadline) {
+        ses.wait_for_alert(std::chrono::milliseconds(200));
+        ses.pop_alerts(&alerts);
+        bool done = false;
+        for (auto* a : alerts) {
+            if (pred(a)) done = true;
+        }
+        if (done) return;
+    }
+    die("phase timed out");
+}
+
+// 返回耗时（秒）；写阶段 save_path 必须是空目录，读阶段以 seed_mode 加入跳过校验
+double run_phase(const std::string& backend, const std::string& save_path, Op op,
+                 const std::vector<int>& order)
+{
+    auto ses = make_session(backend);
+
+    lt::error_code ec;
+    lt::add_torrent_params p;
+    p.ti = std::make_shared<lt::torrent_info>(g_torrentPath, ec);
+    if (ec) die("load torrent: " + ec.message());
+    p.save_path = save_path;
+    p.storage_mode = g_opt.storage_mode;
+    if (op == Op::Read) p.flags |= lt::torrent_flags::seed_mode;
+    lt::torrent_handle h = ses->add_torrent(p, ec);
+    if (ec) die("add_torrent: " + ec.message());
+
+    auto deadline = Clock::now() + kPhaseTimeout;
+    pump_alerts(*ses, deadline, [](lt::alert* a) {
+        if (auto* e = lt::alert_cast<lt::torrent_error_alert>(a)) die("torrent error: " + e->error.message());
+        return lt::alert_cast<lt::torrent_checked_alert>(a) != nullptr;
+    });
+
+    size_t next = 0, done = 0;
+    int inflight = 0;
+    auto issue = [&]() {
+        while (inflight < g_opt.depth && next < order.size()) {
+            lt::piece_index_t pi(order[next++]);
+            if (op == Op::Write) h.add_piece(pi, g_pieceData[static_cast<int>(pi) % kDistinctPieces].data(), {});
+            else h.read_piece(pi);
+            ++inflight;
+        }
+    };
+
+    auto start = Clock::now();
+    issue();
+    pump_alerts(*ses, deadline, [&](lt::alert* a) {
+        if (op == Op::Write && lt::alert_cast<lt::piece_finished_alert>(a)) {
+            --inflight;
+            ++done;
+        } else if (op == Op::Write && lt::alert_cast<lt::hash_failed_alert>(a)) {
+            die("hash failed on add_piece");
+        } else if (auto* rp = lt::alert_cast<lt::read_piece_alert>(a)) {
+            if (op != Op::Read) return false;
+            if (rp->error) die("read_piece: " + rp->error.message());
+            --inflight;
+            ++done;
+        } else if (auto* fe = lt::alert_cast<lt::file_error_alert>(a)) {
+            die(std::string("file error: ") + fe->error.message());
+        } else {
+            return false;
+        }
+        issue();
+        return done == order.size();
+    });
+
+    // 写要落到存储上才算完成
+    if (op == Op::Write) {
+        ses.reset();
+        sync_and_drop(save_path);
+    }
+    double t = seconds(Clock::now() - start);
+    ses.reset();
+    return t;
+}
+
+double sha1_speed()
+{
+    auto start = Clock::now();
+    int64_t bytes = 0;
+    while (Clock::now() - start < std::chrono::milliseconds(500)) {
+        for (auto& buf : g_pieceData) {
+            lt::hasher h(buf.data(), int(buf.size()));
+            h.final();
+            bytes += int64_t(buf.size());
+        }
+    }
+    return mib(bytes) / seconds(Clock::now() - start);
+}
+
+void run_backend(const std::string& backend)
+{
+    std::string base = g_workdir + "/" + backend;
+    std::string seqDir = base + "/seq";
+    std::string randDir = base + "/rand";
+    ::mkdir(base.c_str(), 0755);
+    ::mkdir(seqDir.c_str(), 0755);
+    ::mkdir(randDir.c_str(), 0755);
+
+    std::vector<int> seq(static_cast<size_t>(g_numPieces));
+    for (int i = 0; i < g_numPieces; ++i) seq[size_t(i)] = i;
+    std::vector<int> rnd = seq;
+    std::shuffle(rnd.begin(), rnd.end(), std::mt19937(12345));   // 固定种子，各后端顺序一致
+
+    double ws = run_phase(backend, seqDir, Op::Write, seq);
+    double wr = run_phase(backend, randDir, Op::Write, rnd);
+    sync_and_drop(base);
+    double rs = run_phase(backend, seqDir, Op::Read, seq);
+    sync_and_drop(base);
+    double rr = run_phase(backend, randDir, Op::Read, rnd);
+
+    double total = mib(g_opt.size);
+    std::printf("%-12s seq write %8.1f  rand write %8.1f  seq read %8.1f  rand read %8.1f  MiB/s\n",
+                backend.c_str(), total / ws, total / wr, total / rs, total / rr);
+    std::fflush(stdout);
+
+    if (!g_opt.keep) nftw(base.c_str(), rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+[[noreturn]] void usage()
+{
+    std::fprintf(stderr,
+                 "usage: disk_bench [--dir DIR] [--backend all|default|mmap|posix|small_files]\n"
+                 "                  [--size N[k|m|g]] [--files N] [--piece-size-kb N] [--depth N]\n"
+                 "                  [--storage-mode sparse|allocate] [--file-pool N] [--keep]\n");
+    std::exit(2);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (a == "--dir" && v)                { g_opt.dir = v; ++i; }
+        else if (a == "--backend" && v)       { g_opt.backend = v; ++i; }
+        else if (a == "--size" && v)          { if (!parse_size(v, g_opt.size)) usage(); ++i; }
+        else if (a == "--files" && v)         { g_opt.files = std::atoi(v); ++i; }
+        else if (a == "--piece-size-kb" && v) { g_opt.piece_size_kb = std::atoi(v); ++i; }
+        else if (a == "--depth" && v)         { g_opt.depth = std::atoi(v); ++i; }
+        else if (a == "--file-pool" && v)     { g_opt.file_pool = std::atoi(v); ++i; }
+        else if (a == "--storage-mode" && v) {
+            if (!std::strcmp(v, "allocate")) g_opt.storage_mode = lt::storage_mode_allocate;
+            else if (!std::strcmp(v, "sparse")) g_opt.storage_mode = lt::storage_mode_sparse;
+            else usage();
+            ++i;
+        }
+        else if (a == "--keep")               { g_opt.keep = true; }
+        else usage();
+    }
+    if (g_opt.files < 1 || g_opt.depth < 1 || g_opt.piece_size_kb < 0 || g_opt.size < g_opt.files) usage();
+    if (g_opt.backend != "all" && !bt_disk_io_known(g_opt.backend)) usage();
+
+    std::string tmpl = g_opt.dir + "/disk_bench.XXXXXX";
+    std::vector<char> path(tmpl.begin(), tmpl.end());
+    path.push_back('\0');
+    if (!mkdtemp(path.data())) die("mkdtemp failed in " + g_opt.dir);
+    g_workdir = path.data();
+
+    make_torrent();
+    std::printf("workdir %s\n", g_workdir.c_str());
+    std::printf("payload %.1f MiB in %d file(s), %d pieces of %d KiB, depth %d, sha1 %.1f MiB/s\n\n",
+                mib(g_opt.size), g_opt.files, g_numPieces, g_pieceLength / 1024, g_opt.depth, sha1_speed());
+
+    static const char* all[] = { "default", "mmap", "posix", "small_files" };
+    for (const char* b : all) {
+        if (g_opt.backend == "all" || g_opt.backend == b) run_backend(b);
+    }
+
+    if (!g_opt.keep) nftw(g_workdir.c_str(), rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return 0;
+}
@@ -0,0 +1,535 @@
+// bench/rpc_bench.c
+//
+// RPC 吞吐 / 延迟基准：启动 vs1984-btd，通过管道发长度前缀的请求，回放几种负载，
+// 输出每秒请求数和 p50 / p99 / p999 延迟。
+//
+// 完全离线：DHT 关闭，torrent 由 daemon 的 seed_folder 从临时目录里的小文件生成。
+//
+//   rpc_bench --daemon ./vs1984-btd [--workload status|batch|churn|pause|mixed|all]
+//             [--torrents 200] [--requests 50000] [--depth 64] [--jobs 8]
+//             [--encoding json|msgpack] [--perf] [--keep]
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <cjson/cJSON.h>
+
+#include "bt_frame_io.h"
+#include "bt_msgpack.h"
+
+enum { OP_STATUS, OP_BATCH, OP_PAUSE, OP_RESUME, OP_REMOVE, OP_ADD, OP_OTHER };
+
+typedef struct BenchReq {
+    uint64_t send_ns;
+    uint64_t lat_ns;
+    int      op;
+    int      torrent;
+    int      done;
+} BenchReq;
+
+typedef struct Torrent {
+    char hex[72];
+    char torrent_path[512];
+    char save_dir[512];
+    int  busy;          // 有请求在途，churn / pause 不能同时对同一个 torrent 下两条
+    int  added;
+    int  paused;
+} Torrent;
+
+static struct {
+    const char *daemon;
+    const char *workload;
+    int  torrents;
+    int  requests;
+    int  depth;
+    int  jobs;
+    int  msgpack;
+    int  perf;
+    int  keep;
+} g_opt = { NULL, "all", 200, 50000, 64, 8, 0, 0, 0 };
+
+static pid_t          g_child = -1;
+static BtFrameWriter *g_writer;
+static BtFrameReader  g_reader;
+static char           g_workdir[256];
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_cv   = PTHREAD_COND_INITIALIZER;
+static BenchReq *g_reqs;            // 按 id - g_base_id 索引
+static int       g_base_id;
+static int       g_nreqs;
+static int       g_inflight;
+static int       g_completed;
+static int       g_errors;
+static int       g_reader_done;
+static cJSON    *g_last_result;     // 同步调用的结果，guarded by g_lock
+static Torrent  *g_torrents;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "rpc_bench: %s\n", msg);
+    if (g_child > 0) kill(g_child, SIGTERM);
+    exit(1);
+}
+
+/* ---------- 协议 ---------- */
+
+static void send_request(int id, const char *method, cJSON *params)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "id", id);
+    cJSON_AddStringToObject(root, "method", method);
+    cJSON_AddItemToObject(root, "params", params ? params : cJSON_CreateObject());
+
+    if (g_opt.msgpack) {
+        char stack[1024];
+        BtMpBuf b;
+        bt_mp_init(&b, stack, sizeof(stack));
+        bt_mp_from_cjson(&b, root);
+        if (b.failed || bt_frame_send(g_writer, b.data, b.len) != 0) die("send failed");
+        bt_mp_free(&b);
+    } else {
+        char *s = cJSON_PrintUnformatted(root);
+        if (!s || bt_frame_send(g_writer, s, strlen(s)) != 0) die("send failed");
+        free(s);
+    }
+    cJSON_Delete(root);
+}
+
+// 收到回复后更新 torrent 状态，调用时持有 g_lock
+static void on_reply(BenchReq *r, int ok, const cJSON *result)
+{
+    if (r->torrent < 0) return;
+    Torrent *t = &g_torrents[r->torrent];
+    t->busy = 0;
+    if (!ok) return;
+    switch (r->op) {
+        case OP_PAUSE:  t->paused = 1; break;
+        case OP_RESUME: t->paused = 0; break;
+        case OP_REMOVE: t->added = 0;  break;
+        case OP_ADD: {
+            const cJSON *hex = cJSON_GetObjectItem(result, "infohash_hex");
+            if (cJSON_IsString(hex)) snprintf(t->hex, sizeof(t->hex), "%s", hex->valuestring);
+            t->added = 1;
+            t->paused = 0;
+            break;
+        }
+        default: break;
+    }
+}
+
+static void *reader_main(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        const char *buf;
+        size_t len;
+        if (bt_frame_read(&g_reader, &buf, &len) != 0) break;
+        uint64_t t = now_ns();
+
+        cJSON *root = bt_mp_is_map(buf, len) ? bt_mp_to_cjson(buf, len) : cJSON_ParseWithLength(buf, len);
+        if (!root) continue;
+        const cJSON *id = cJSON_GetObjectItem(root, "id");
+        if (!cJSON_IsNumber(id)) {          // 事件帧
+            cJSON_Delete(root);
+            continue;
+        }
+        const cJSON *st = cJSON_GetObjectItem(root, "status");
+        int ok = cJSON_IsString(st) && strcmp(st->valuestring, "ok") == 0;
+
+        pthread_mutex_lock(&g_lock);
+        int idx = id->valueint - g_base_id;
+        if (idx >= 0 && idx < g_nreqs && !g_reqs[idx].done) {
+            BenchReq *r = &g_reqs[idx];
+            r->done = 1;
+            r->lat_ns = t - r->send_ns;
+            if (!ok) g_errors++;
+            on_reply(r, ok, cJSON_GetObjectItem(root, "result"));
+            if (g_nreqs == 1) {
+                cJSON_Delete(g_last_result);
+                g_last_result = cJSON_DetachItemFromObject(root, "result");
+            }
+            g_inflight--;
+            g_completed++;
+            pthread_cond_broadcast(&g_cv);
+        }
+        pthread_mutex_unlock(&g_lock);
+        cJSON_Delete(root);
+    }
+
+    pthread_mutex_lock(&g_lock);
+    g_reader_done = 1;
+    pthread_cond_broadcast(&g_cv);
+    pthread_mutex_unlock(&g_lock);
+    return NULL;
+}
+
+static int g_next_id = 1;
+
+static void batch_begin(int n)
+{
+    pthread_mutex_lock(&g_lock);
+    free(g_reqs);
+    g_reqs = calloc((size_t)n, sizeof(BenchReq));
+    if (!g_reqs) die("out of memory");
+    g_base_id = g_next_id;
+    g_nreqs = n;
+    g_inflight = 0;
+    g_completed = 0;
+    g_errors = 0;
+    pthread_mutex_unlock(&g_lock);
+    g_next_id += n;
+}
+
+static void batch_wait_all(void)
+{
+    pthread_mutex_lock(&g_lock);
+    while (g_completed < g_nreqs && !g_reader_done)
+        pthread_cond_wait(&g_cv, &g_lock);
+    pthread_mutex_unlock(&g_lock);
+    if (g_completed < g_nreqs) die("daemon exited");
+}
+
+// 同步调用一次，返回 result（调用方释放），失败返回 NULL
+static cJSON *call(const char *method, cJSON *params)
+{
+    batch_begin(1);
+    pthread_mutex_lock(&g_lock);
+    g_reqs[0].torrent = -1;
+    g_reqs[0].op = OP_OTHER;
+    g_reqs[0].send_ns = now_ns();
+    g_inflight = 1;
+    pthread_mutex_unlock(&g_lock);
+
+    send_request(g_base_id, method, params);
+    batch_wait_all();
+
+    pthread_mutex_lock(&g_lock);
+    cJSON *res = g_errors ? NULL : g_last_result;
+    if (g_errors) cJSON_Delete(g_last_result);
+    g_last_result = NULL;
+    pthread_mutex_unlock(&g_lock);
+    return res;
+}
+
+/* ---------- 负载 ---------- */
+
+// 选一个不在途、满足条件的 torrent，调用时持有 g_lock；找不到返回 -1
+static int pick_torrent(int need_added)
+{
+    for (int tries = 0; tries < 64; tries++) {
+        int i = rand() % g_opt.torrents;
+        Torrent *t = &g_torrents[i];
+        if (t->busy) continue;
+        if (need_added >= 0 && t->added != need_added) continue;
+        return i;
+    }
+    return -1;
+}
+
+// 生成下一条请求，调用时持有 g_lock；torrent 都在途时返回 NULL（等回复再试）
+static const char *next_request(const char *workload, BenchReq *r, cJSON **params)
+{
+    int dice = rand() % 100;
+    const char *w = workload;
+    if (strcmp(w, "mixed") == 0) {
+        w = dice < 70 ? "status" : dice < 80 ? "batch" : dice < 90 ? "pause" : "churn";
+    }
+
+    r->torrent = -1;
+    if (strcmp(w, "status") == 0) {
+        // mixed 里 churn 会删掉一部分，尽量查还在的
+        int i = rand() % g_opt.torrents;
+        for (int tries = 0; tries < 8 && !g_torrents[i].added; tries++) i = rand() % g_opt.torrents;
+        r->op = OP_STATUS;
+        *params = cJSON_CreateObject();
+        cJSON_AddStringToObject(*params, "infohash_hex", g_torrents[i].hex);
+        return "get_torrent_status";
+    }
+    if (strcmp(w, "batch") == 0) {
+        r->op = OP_BATCH;
+        *params = cJSON_CreateObject();
+        return "get_all_status";
+    }
+    if (strcmp(w, "pause") == 0) {
+        int i = pick_torrent(1);
+        if (i < 0) return NULL;
+        Torrent *t = &g_torrents[i];
+        t->busy = 1;
+        r->torrent = i;
+        r->op = t->paused ? OP_RESUME : OP_PAUSE;
+        *params = cJSON_CreateObject();
+        cJSON_AddStringToObject(*params, "infohash_hex", t->hex);
+        return t->paused ? "resume_torrent" : "pause_torrent";
+    }
+    if (strcmp(w, "churn") == 0) {
+        int i = pick_torrent(-1);
+        if (i < 0) return NULL;
+        Torrent *t = &g_torrents[i];
+        t->busy = 1;
+        r->torrent = i;
+        *params = cJSON_CreateObject();
+        if (t->added) {
+            r->op = OP_REMOVE;
+            cJSON_AddStringToObject(*params, "infohash_hex", t->hex);
+            cJSON_AddNumberToObject(*params, "remove_files", 0);
+            return "remove_torrent";
+        }
+        r->op = OP_ADD;
+        cJSON_AddStringToObject(*params, "torrent_path", t->torrent_path);
+        cJSON_AddStringToObject(*params, "save_dir", t->save_dir);
+        return "add_torrent_file";
+    }
+    die("unknown workload");
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double pct_us(const uint64_t *v, int n, double q)
+{
+    int i = (int)(q * (n - 1) + 0.5);
+    return (double)v[i] / 1000.0;
+}
+
+static void run_workload(const char *workload)
+{
+    int n = g_opt.requests;
+    batch_begin(n);
+
+    uint64_t t0 = now_ns();
+    for (int k = 0; k < n; k++) {
+        cJSON *params = NULL;
+        const char *method;
+
+        pthread_mutex_lock(&g_lock);
+        for (;;) {
+            while (g_inflight >= g_opt.depth && !g_reader_done)
+                pthread_cond_wait(&g_cv, &g_lock);
+            if (g_reader_done) {
+                pthread_mutex_unlock(&g_lock);
+                die("daemon exited");
+            }
+            method = next_request(workload, &g_reqs[k], &params);
+            if (method) break;
+            if (g_inflight == 0) die("no torrent available");
+            pthread_cond_wait(&g_cv, &g_lock);
+        }
+        g_reqs[k].send_ns = now_ns();
+        g_inflight++;
+        pthread_mutex_unlock(&g_lock);
+
+        send_request(g_base_id + k, method, params);
+    }
+    batch_wait_all();
+    uint64_t t1 = now_ns();
+
+    uint64_t *lat = malloc((size_t)n * sizeof(uint64_t));
+    if (!lat) die("out of memory");
+    for (int k = 0; k < n; k++) lat[k] = g_reqs[k].lat_ns;
+    qsort(lat, (size_t)n, sizeof(uint64_t), cmp_u64);
+
+    double secs = (double)(t1 - t0) / 1e9;
+    printf("%-8s %9d req %6d err %10.0f req/s   p50 %8.1f us  p99 %8.1f us  p999 %8.1f us  max %8.1f us\n",
+           workload, n, g_errors, n / secs,
+           pct_us(lat, n, 0.50), pct_us(lat, n, 0.99), pct_us(lat, n, 0.999), pct_us(lat, n, 1.0));
+    fflush(stdout);
+    free(lat);
+
+    if (g_opt.perf) {
+        cJSON *p = cJSON_CreateObject();
+        cJSON_AddBoolToObject(p, "reset", 1);
+        cJSON *res = call("get_perf_stats", p);
+        if (res) {
+            char *s = cJSON_Print(res);
+            printf("%s\n", s);
+            free(s);
+            cJSON_Delete(res);
+        }
+    }
+}
+
+/* ---------- 准备 ---------- */
+
+static void write_file(const char *path, size_t size)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) die("create payload failed");
+    char buf[4096];
+    while (size > 0) {
+        for (size_t i = 0; i < sizeof(buf); i++) buf[i] = (char)rand();
+        size_t n = size < sizeof(buf) ? size : sizeof(buf);
+        if (write(fd, buf, n) != (ssize_t)n) die("write payload failed");
+        size -= n;
+    }
+    close(fd);
+}
+
+static void spawn_daemon(void)
+{
+    int in[2], out[2];
+    if (pipe(in) != 0 || pipe(out) != 0) die("pipe failed");
+
+    g_child = fork();
+    if (g_child < 0) die("fork failed");
+    if (g_child == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+        char jobs[16];
+        snprintf(jobs, sizeof(jobs), "%d", g_opt.jobs);
+        execl(g_opt.daemon, g_opt.daemon, "-j", jobs, (char *)NULL);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+
+    g_writer = bt_frame_writer_start(in[1]);
+    if (!g_writer) die("frame writer failed");
+    bt_frame_reader_init(&g_reader, out[0]);
+}
+
+static void setup(void)
+{
+    char path[600];
+    snprintf(g_workdir, sizeof(g_workdir), "/tmp/rpc_bench.XXXXXX");
+    if (!mkdtemp(g_workdir)) die("mkdtemp failed");
+
+    // 随机端口段，避免和本机其它实例冲突
+    int port = 20000 + (int)(getpid() % 20000);
+    snprintf(path, sizeof(path), "%s/btd.conf", g_workdir);
+    FILE *f = fopen(path, "w");
+    if (!f) die("write config failed");
+    fprintf(f, "enable_dht = 0\nlisten_start = %d\nlisten_end = %d\nstats_interval = 0\n", port, port + 10);
+    fclose(f);
+
+    cJSON *p = cJSON_CreateObject();
+    cJSON_AddStringToObject(p, "config_path", path);
+    if (g_opt.msgpack) cJSON_AddStringToObject(p, "encoding", "msgpack");
+    cJSON *res = call("init", p);
+    if (!res) die("init failed");
+    cJSON_Delete(res);
+
+    g_torrents = calloc((size_t)g_opt.torrents, sizeof(Torrent));
+    if (!g_torrents) die("out of memory");
+
+    // 每个 torrent 一个目录两个小文件，seed_folder 生成 .torrent 并开始做种
+    snprintf(path, sizeof(path), "%s/data", g_workdir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/torrents", g_workdir);
+    mkdir(path, 0755);
+
+    batch_begin(g_opt.torrents);
+    for (int i = 0; i < g_opt.torrents; i++) {
+        Torrent *t = &g_torrents[i];
+        snprintf(t->save_dir, sizeof(t->save_dir), "%s/data", g_workdir);
+        snprintf(path, sizeof(path), "%s/data/t%d", g_workdir, i);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/data/t%d/a.bin", g_workdir, i);
+        write_file(path, 16 * 1024);
+        snprintf(path, sizeof(path), "%s/data/t%d/b.bin", g_workdir, i);
+        write_file(path, 1024 + (size_t)(rand() % 8192));
+        snprintf(t->torrent_path, sizeof(t->torrent_path), "%s/torrents/t%d.torrent", g_workdir, i);
+
+        pthread_mutex_lock(&g_lock);
+        while (g_inflight >= g_opt.depth) pthread_cond_wait(&g_cv, &g_lock);
+        g_reqs[i].torrent = i;
+        g_reqs[i].op = OP_ADD;          // 回复里带 infohash_hex，和 add_torrent_file 一样处理
+        g_reqs[i].send_ns = now_ns();
+        t->busy = 1;
+        g_inflight++;
+        pthread_mutex_unlock(&g_lock);
+
+        cJSON *sp = cJSON_CreateObject();
+        snprintf(path, sizeof(path), "%s/data/t%d", g_workdir, i);
+        cJSON_AddStringToObject(sp, "folder", path);
+        cJSON_AddStringToObject(sp, "torrent_out_path", t->torrent_path);
+        send_request(g_base_id + i, "seed_folder", sp);
+    }
+    batch_wait_all();
+    if (g_errors) die("seed_folder failed");
+    printf("setup    %d torrents in %s\n", g_opt.torrents, g_workdir);
+}
+
+static int rm_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+    (void)sb; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: rpc_bench --daemon PATH [--workload status|batch|churn|pause|mixed|all]\n"
+            "                 [--torrents N] [--requests N] [--depth N] [--jobs N]\n"
+            "                 [--encoding json|msgpack] [--perf] [--keep]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(a, "--daemon") && v)        { g_opt.daemon = v; i++; }
+        else if (!strcmp(a, "--workload") && v) { g_opt.workload = v; i++; }
+        else if (!strcmp(a, "--torrents") && v) { g_opt.torrents = atoi(v); i++; }
+        else if (!strcmp(a, "--requests") && v) { g_opt.requests = atoi(v); i++; }
+        else if (!strcmp(a, "--depth") && v)    { g_opt.depth = atoi(v); i++; }
+        else if (!strcmp(a, "--jobs") && v)     { g_opt.jobs = atoi(v); i++; }
+        else if (!strcmp(a, "--encoding") && v) { g_opt.msgpack = !strcmp(v, "msgpack"); i++; }
+        else if (!strcmp(a, "--perf"))          { g_opt.perf = 1; }
+        else if (!strcmp(a, "--keep"))          { g_opt.keep = 1; }
+        else usage();
+    }
+    if (!g_opt.daemon || g_opt.torrents < 1 || g_opt.requests < 1 || g_opt.depth < 1) usage();
+
+    signal(SIGPIPE, SIG_IGN);
+    srand(12345);   // 固定种子，多次运行回放相同的请求序列
+
+    spawn_daemon();
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, reader_main, NULL) != 0) die("pthread_create failed");
+
+    setup();
+
+    static const char *all[] = { "status", "batch", "pause", "churn", "mixed" };
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (!strcmp(g_opt.workload, "all") || !strcmp(g_opt.workload, all[i]))
+            run_workload(all[i]);
+    }
+
+    cJSON *res = call("shutdown", NULL);
+    cJSON_Delete(res);
+    bt_frame_writer_stop(g_writer);
+    pthread_join(reader, NULL);
+    waitpid(g_child, NULL, 0);
+    bt_frame_writer_free(g_writer);
+    bt_frame_reader_free(&g_reader);
+
+    if (!g_opt.keep) nftw(g_workdir, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+    free(g_reqs);
+    free(g_torrents);
+    return 0;
+}
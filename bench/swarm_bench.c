@@ -0,0 +1,361 @@
+// bench/swarm_bench.c
+//
+// 本机传输基准：生成测试数据，用 BtCore 的 seedFolder 建 .torrent 并做种，
+// 再起若干个下载 session 从 127.0.0.1 拉取，输出哈希耗时、首个 piece 时间、
+// 下载速度和每字节 CPU。
+//
+// 所有 session 在同一进程里（bt_api），DHT 关闭，下载端用 bt_connect_peer 手动连到
+// 做种端和之前的下载端。CPU 用 getrusage 统计整个进程，包含做种端（seed_mode 下
+// 第一次上传某个 piece 时会校验一次）。
+//
+//   swarm_bench [--payload single:10G] [--payload many:100000:16k] [--leechers 1]
+//               [--hash-threads 2] [--port 46000] [--timeout 600] [--dir DIR] [--keep]
+//               [--set preset=high_performance_seed] [--set lt.connections_limit=500]
+//
+// --set 的内容原样追加到每个 session 的配置文件里，用来对比不同的 settings_pack。
+//
+// 不指定 --payload 时跑 single:1G 和 many:10000:16k。
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bt_api.h"
+#include "bt_utils.h"
+
+#define MAX_PAYLOADS  16
+#define MAX_LEECHERS  32
+#define FILES_PER_DIR 1000
+#define MAX_SETS      32
+
+typedef struct Payload {
+    char     spec[64];
+    int      files;             // 1 表示单文件
+    uint64_t file_size;
+} Payload;
+
+typedef struct Leecher {
+    BtHandle *h;
+    uint64_t  first_piece_ns;
+    uint64_t  done_ns;
+    long      downloaded;
+} Leecher;
+
+static struct {
+    Payload payloads[MAX_PAYLOADS];
+    int     npayloads;
+    int     leechers;
+    int     hash_threads;
+    int     port;
+    int     timeout_s;
+    const char *dir;
+    int     keep;
+    const char *sets[MAX_SETS];
+    int     nsets;
+} g_opt = { .leechers = 1, .hash_threads = 2, .port = 46000, .timeout_s = 600 };
+
+static char g_workdir[512];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t cpu_ns(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ((uint64_t)ru.ru_utime.tv_sec + (uint64_t)ru.ru_stime.tv_sec) * 1000000000ull +
+           ((uint64_t)ru.ru_utime.tv_usec + (uint64_t)ru.ru_stime.tv_usec) * 1000ull;
+}
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "swarm_bench: %s\n", msg);
+    exit(1);
+}
+
+// 1234 / 16k / 10G，单位按 1024 算
+static int parse_size(const char *s, uint64_t *out)
+{
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s) return -1;
+    switch (*end) {
+        case 'k': case 'K': v <<= 10; end++; break;
+        case 'm': case 'M': v <<= 20; end++; break;
+        case 'g': case 'G': v <<= 30; end++; break;
+        default: break;
+    }
+    if (*end != '\0' && *end != ':') return -1;
+    *out = v;
+    return 0;
+}
+
+// single:SIZE 或 many:COUNT:SIZE
+static int parse_payload(const char *s, Payload *p)
+{
+    memset(p, 0, sizeof(*p));
+    snprintf(p->spec, sizeof(p->spec), "%s", s);
+    if (!strncmp(s, "single:", 7)) {
+        p->files = 1;
+        return parse_size(s + 7, &p->file_size) == 0 && p->file_size > 0 ? 0 : -1;
+    }
+    if (!strncmp(s, "many:", 5)) {
+        char *end;
+        long n = strtol(s + 5, &end, 10);
+        if (end == s + 5 || *end != ':' || n < 1) return -1;
+        p->files = (int)n;
+        return parse_size(end + 1, &p->file_size) == 0 && p->file_size > 0 ? 0 : -1;
+    }
+    return -1;
+}
+
+/* ---------- 测试数据 ---------- */
+
+// xorshift 填充，不可压缩，也不会被文件系统去重
+static void fill_random(uint64_t *buf, size_t words, uint64_t *state)
+{
+    uint64_t x = *state;
+    for (size_t i = 0; i < words; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = x;
+    }
+    *state = x;
+}
+
+static void write_file(const char *path, uint64_t size, uint64_t *state)
+{
+    static uint64_t buf[(1 << 20) / sizeof(uint64_t)];
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) die("create payload file failed");
+    while (size > 0) {
+        size_t n = size < sizeof(buf) ? (size_t)size : sizeof(buf);
+        fill_random(buf, (n + 7) / 8, state);
+        if (write(fd, buf, n) != (ssize_t)n) die("write payload failed");
+        size -= n;
+    }
+    close(fd);
+}
+
+// 小文件每 1000 个一个子目录，避免单目录过大
+static void make_payload(const char *root, const Payload *p)
+{
+    char path[768];
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    mkdir(root, 0755);
+    if (p->files == 1) {
+        snprintf(path, sizeof(path), "%s/data.bin", root);
+        write_file(path, p->file_size, &state);
+        return;
+    }
+    for (int i = 0; i < p->files; i++) {
+        if (i % FILES_PER_DIR == 0) {
+            snprintf(path, sizeof(path), "%s/d%05d", root, i / FILES_PER_DIR);
+            mkdir(path, 0755);
+        }
+        snprintf(path, sizeof(path), "%s/d%05d/f%06d.bin", root, i / FILES_PER_DIR, i);
+        write_file(path, p->file_size, &state);
+    }
+}
+
+/* ---------- session ---------- */
+
+static BtHandle *start_session(const char *dir, const char *name, int port)
+{
+    char path[768];
+    snprintf(path, sizeof(path), "%s/%s.conf", dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f) die("write config failed");
+    // 端口固定不重试，下载端要知道往哪连
+    fprintf(f,
+            "enable_dht = 0\n"
+            "listen_start = %d\n"
+            "listen_end = %d\n"
+            "hash_threads = %d\n"
+            "status_interval_ms = 20\n"
+            "stats_interval = 0\n"
+            "resume_save_interval = 0\n"
+            "allow_multiple_connections_per_ip = 1\n",
+            port, port, g_opt.hash_threads);
+    for (int i = 0; i < g_opt.nsets; i++) fprintf(f, "%s\n", g_opt.sets[i]);
+    fclose(f);
+
+    BtHandle *h = bt_init(path);
+    if (!h) die("bt_init failed");
+    return h;
+}
+
+static double mb(uint64_t bytes)
+{
+    return (double)bytes / (1024.0 * 1024.0);
+}
+
+static void run_payload(int index, const Payload *p)
+{
+    char dir[600], path[768], root[768], torrent[768];
+    uint64_t total = (uint64_t)p->files * p->file_size;
+
+    snprintf(dir, sizeof(dir), "%s/p%d", g_workdir, index);
+    mkdir(dir, 0755);
+    snprintf(path, sizeof(path), "%s/seed", dir);
+    mkdir(path, 0755);
+    snprintf(root, sizeof(root), "%s/seed/payload", dir);
+    snprintf(torrent, sizeof(torrent), "%s/payload.torrent", dir);
+
+    printf("payload  %-20s files %-7d total %.1f MiB\n", p->spec, p->files, mb(total));
+    fflush(stdout);
+
+    uint64_t t0 = now_ns();
+    make_payload(root, p);
+    printf("generate %-20s %.2f s\n", p->spec, (double)(now_ns() - t0) / 1e9);
+
+    // 每个 payload 换一段端口，避开上一轮的 TIME_WAIT
+    int base = g_opt.port + index * (g_opt.leechers + 1);
+    BtHandle *seeder = start_session(dir, "seed", base);
+
+    char hex[BT_INFOHASH_HEX_LEN];
+    uint64_t c0 = cpu_ns();
+    t0 = now_ns();
+    if (bt_seed_folder(seeder, root, torrent, hex, sizeof(hex)) != 0) die("seed_folder failed");
+    uint64_t hash_ns = now_ns() - t0;
+    uint64_t hash_cpu = cpu_ns() - c0;
+    printf("hash     %-20s %.2f s  %.1f MiB/s  cpu %.2f ns/B\n",
+           p->spec, (double)hash_ns / 1e9, mb(total) / ((double)hash_ns / 1e9),
+           (double)hash_cpu / (double)total);
+
+    Leecher lc[MAX_LEECHERS];
+    memset(lc, 0, sizeof(lc));
+    for (int i = 0; i < g_opt.leechers; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "leech%d", i);
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        mkdir(path, 0755);
+        lc[i].h = start_session(dir, name, base + 1 + i);
+        char out[BT_INFOHASH_HEX_LEN];
+        if (bt_add_torrent_file(lc[i].h, torrent, path, out, sizeof(out)) != 0) die("add_torrent_file failed");
+    }
+
+    // 计时从组网开始：每个下载端连做种端和之前的下载端
+    c0 = cpu_ns();
+    t0 = now_ns();
+    for (int i = 0; i < g_opt.leechers; i++) {
+        if (bt_connect_peer(lc[i].h, hex, "127.0.0.1", base) != 0) die("connect_peer failed");
+        for (int j = 0; j < i; j++) bt_connect_peer(lc[i].h, hex, "127.0.0.1", base + 1 + j);
+    }
+
+    uint64_t deadline = t0 + (uint64_t)g_opt.timeout_s * 1000000000ull;
+    int pending = g_opt.leechers;
+    while (pending > 0 && now_ns() < deadline) {
+        struct timespec ts = { 0, 10 * 1000000 };
+        nanosleep(&ts, NULL);
+        uint64_t t = now_ns();
+        for (int i = 0; i < g_opt.leechers; i++) {
+            Leecher *l = &lc[i];
+            BtTorrentStatus st;
+            if (l->done_ns || bt_get_torrent_status(l->h, hex, &st) != 0) continue;
+            l->downloaded = st.total_downloaded;
+            // 状态快照 20ms 刷新一次，首个 piece 的时间精度也就是这个量级
+            if (!l->first_piece_ns && st.progress > 0.0f) l->first_piece_ns = t;
+            if (st.is_seeding || st.progress >= 1.0f) {
+                if (!l->first_piece_ns) l->first_piece_ns = t;
+                l->done_ns = t;
+                pending--;
+            }
+        }
+    }
+    uint64_t end = now_ns();
+    uint64_t xfer_cpu = cpu_ns() - c0;
+
+    uint64_t moved = 0;
+    for (int i = 0; i < g_opt.leechers; i++) {
+        Leecher *l = &lc[i];
+        uint64_t elapsed = (l->done_ns ? l->done_ns : end) - t0;
+        uint64_t got = l->done_ns ? total : (uint64_t)(l->downloaded > 0 ? l->downloaded : 0);
+        moved += got;
+        printf("leech%-3d %-20s first piece %7.1f ms  %s %.2f s  %.1f MiB/s\n",
+               i, p->spec,
+               l->first_piece_ns ? (double)(l->first_piece_ns - t0) / 1e6 : -1.0,
+               l->done_ns ? "done" : "TIMEOUT", (double)elapsed / 1e9,
+               mb(got) / ((double)elapsed / 1e9));
+    }
+    double secs = (double)(end - t0) / 1e9;
+    printf("swarm    %-20s %d leecher(s)  %.2f s  %.1f MiB/s aggregate  cpu %.2f ns/B (%.0f%% of a core)\n\n",
+           p->spec, g_opt.leechers, secs, mb(moved) / secs,
+           moved ? (double)xfer_cpu / (double)moved : 0.0,
+           100.0 * (double)xfer_cpu / (double)(end - t0));
+
+    for (int i = 0; i < g_opt.leechers; i++) bt_shutdown(lc[i].h);
+    bt_shutdown(seeder);
+}
+
+static int rm_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+    (void)sb; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: swarm_bench [--payload single:SIZE|many:COUNT:SIZE]... [--leechers N]\n"
+            "                   [--hash-threads N] [--port BASE] [--timeout SEC] [--dir DIR] [--keep]\n"
+            "                   [--set KEY=VALUE]...\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(a, "--payload") && v) {
+            if (g_opt.npayloads == MAX_PAYLOADS) usage();
+            if (parse_payload(v, &g_opt.payloads[g_opt.npayloads++]) != 0) usage();
+            i++;
+        }
+        else if (!strcmp(a, "--leechers") && v)     { g_opt.leechers = atoi(v); i++; }
+        else if (!strcmp(a, "--hash-threads") && v) { g_opt.hash_threads = atoi(v); i++; }
+        else if (!strcmp(a, "--port") && v)         { g_opt.port = atoi(v); i++; }
+        else if (!strcmp(a, "--timeout") && v)      { g_opt.timeout_s = atoi(v); i++; }
+        else if (!strcmp(a, "--dir") && v)          { g_opt.dir = v; i++; }
+        else if (!strcmp(a, "--keep"))              { g_opt.keep = 1; }
+        else if (!strcmp(a, "--set") && v) {
+            if (g_opt.nsets == MAX_SETS || !strchr(v, '=')) usage();
+            g_opt.sets[g_opt.nsets++] = v;
+            i++;
+        }
+        else usage();
+    }
+    if (g_opt.leechers < 1 || g_opt.leechers > MAX_LEECHERS || g_opt.timeout_s < 1) usage();
+    if (g_opt.npayloads == 0) {
+        parse_payload("single:1G", &g_opt.payloads[g_opt.npayloads++]);
+        parse_payload("many:10000:16k", &g_opt.payloads[g_opt.npayloads++]);
+    }
+    if (g_opt.port < 1024 || g_opt.port + g_opt.npayloads * (g_opt.leechers + 1) > 65535) usage();
+
+    signal(SIGPIPE, SIG_IGN);
+    set_debug(BT_LOG_ERROR);
+
+    // 数据量大时用 --dir 指到真实磁盘上，/tmp 可能是 tmpfs
+    snprintf(g_workdir, sizeof(g_workdir), "%s/swarm_bench.XXXXXX", g_opt.dir ? g_opt.dir : "/tmp");
+    if (!mkdtemp(g_workdir)) die("mkdtemp failed");
+    printf("workdir  %s\n\n", g_workdir);
+
+    for (int i = 0; i < g_opt.npayloads; i++) run_payload(i, &g_opt.payloads[i]);
+
+    if (!g_opt.keep) nftw(g_workdir, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return 0;
+}
@@ -1,8 +1,14 @@
 // src/bt_api.c
 #include "bt_api.h"
 #include "bt_core.hpp"
+#include "bt_utils.h"
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 struct BtHandle {
     BtCore* core;
@@ -41,22 +47,39 @@ static int check_out_buf(char* out_infohash_hex, size_t out_len)
     return 0;
 }
 
+static int copy_out_hex(const std::string& hex, char* out_infohash_hex, size_t out_len)
+{
+    if (hex.size() >= out_len) return -1;
+    memcpy(out_infohash_hex, hex.c_str(), hex.size() + 1);
+    return 0;
+}
+
 int bt_add_magnet(BtHandle* handle,
                   const char* magnet_uri,
                   const char* save_dir,
                   char* out_infohash_hex,
                   size_t out_len)
 {
-    if (!handle || !handle->core || !magnet_uri || !save_dir) return -1;
+    if (!save_dir) return -1;
+    return bt_add_magnet_ex(handle, magnet_uri, save_dir, 0, out_infohash_hex, out_len);
+}
+
+int bt_add_magnet_ex(BtHandle* handle,
+                     const char* magnet_uri,
+                     const char* save_dir,
+                     unsigned flags,
+                     char* out_infohash_hex,
+                     size_t out_len)
+{
+    bool in_memory = (flags & BT_ADD_IN_MEMORY) != 0;
+    if (!handle || !handle->core || !magnet_uri || (!save_dir && !in_memory)) return -1;
     if (check_out_buf(out_infohash_hex, out_len) != 0) return -1;
 
     std::string info;
-    bool ok = handle->core->addMagnet(magnet_uri, save_dir, info);
+    bool ok = handle->core->addMagnet(magnet_uri, save_dir ? save_dir : "", in_memory, info);
     if (!ok) return -1;
 
-    strncpy(out_infohash_hex, info.c_str(), out_len - 1);
-    out_infohash_hex[out_len - 1] = '\0';
-    return 0;
+    return copy_out_hex(info, out_infohash_hex, out_len);
 }
 
 int bt_add_torrent_file(BtHandle* handle,
@@ -72,9 +95,7 @@ int bt_add_torrent_file(BtHandle* handle,
     bool ok = handle->core->addTorrentFile(torrent_path, save_dir, info);
     if (!ok) return -1;
 
-    strncpy(out_infohash_hex, info.c_str(), out_len - 1);
-    out_infohash_hex[out_len - 1] = '\0';
-    return 0;
+    return copy_out_hex(info, out_infohash_hex, out_len);
 }
 
 int bt_seed_folder(BtHandle* handle,
@@ -82,19 +103,67 @@ int bt_seed_folder(BtHandle* handle,
                    const char* torrent_out_path,
                    char* out_infohash_hex,
                    size_t out_len)
+{
+    return bt_seed_folder_ex(handle, folder, torrent_out_path, nullptr, out_infohash_hex, out_len);
+}
+
+int bt_seed_folder_async(BtHandle* handle,
+                         const char* folder,
+                         const char* torrent_out_path,
+                         unsigned long long* out_job_id)
+{
+    return bt_seed_folder_async_ex(handle, folder, torrent_out_path, nullptr, out_job_id);
+}
+
+int bt_seed_folder_ex(BtHandle* handle,
+                      const char* folder,
+                      const char* torrent_out_path,
+                      const BtSeedOptions* opts,
+                      char* out_infohash_hex,
+                      size_t out_len)
 {
     if (!handle || !handle->core || !folder || !torrent_out_path) return -1;
     if (check_out_buf(out_infohash_hex, out_len) != 0) return -1;
 
+    BtSeedOptions o{};
+    if (opts) o = *opts;
     std::string info;
-    bool ok = handle->core->seedFolder(folder, torrent_out_path, info);
+    bool ok = handle->core->seedFolder(folder, torrent_out_path, o, info);
     if (!ok) return -1;
 
-    strncpy(out_infohash_hex, info.c_str(), out_len - 1);
-    out_infohash_hex[out_len - 1] = '\0';
+    return copy_out_hex(info, out_infohash_hex, out_len);
+}
+
+int bt_seed_folder_async_ex(BtHandle* handle,
+                            const char* folder,
+                            const char* torrent_out_path,
+                            const BtSeedOptions* opts,
+                            unsigned long long* out_job_id)
+{
+    if (!handle || !handle->core || !folder || !torrent_out_path || !out_job_id) return -1;
+    BtSeedOptions o{};
+    if (opts) o = *opts;
+    uint64_t id = handle->core->seedFolderAsync(folder, torrent_out_path, o);
+    if (id == 0) return -1;
+    *out_job_id = id;
     return 0;
 }
 
+int bt_get_hash_job(BtHandle* handle, unsigned long long job_id, BtHashJobInfo* out_info)
+{
+    if (!handle || !handle->core || !out_info) return -1;
+    memset(out_info, 0, sizeof(*out_info));
+    bool ok = handle->core->getHashJob(job_id, *out_info);
+    return ok ? 0 : -1;
+}
+
+int bt_cancel_hash_job(BtHandle* handle, unsigned long long job_id)
+{
+    if (!handle || !handle->core) return -1;
+    bool ok = handle->core->cancelHashJob(job_id);
+    return ok ? 0 : -1;
+}
+
 int bt_pause_torrent(BtHandle* handle, const char* infohash_hex)
 {
     if (!handle || !handle->core || !infohash_hex) return -1;
@@ -116,6 +185,45 @@ int bt_remove_torrent(BtHandle* handle, const char* infohash_hex, int remove_fil
     return ok ? 0 : -1;
 }
 
+int bt_connect_peer(BtHandle* handle, const char* infohash_hex, const char* ip, int port)
+{
+    if (!handle || !handle->core || !infohash_hex || !ip) return -1;
+    bool ok = handle->core->connectPeer(infohash_hex, ip, port);
+    return ok ? 0 : -1;
+}
+
+int bt_read_range(BtHandle* handle,
+                  const char* infohash_hex,
+                  int file_index,
+                  long long offset,
+                  size_t length,
+                  int timeout_ms,
+                  char* out_buf,
+                  size_t* out_len)
+{
+    if (!handle || !handle->core || !infohash_hex || !out_len || (!out_buf && length > 0)) return -1;
+    *out_len = 0;
+    std::vector<char> data;
+    int rc = handle->core->readRange(infohash_hex, file_index, offset, (int64_t)length, timeout_ms, data);
+    if (rc != 0) return rc;
+    if (!data.empty()) memcpy(out_buf, data.data(), data.size());
+    *out_len = data.size();
+    return 0;
+}
+
+int bt_wait_range(BtHandle* handle,
+                  const char* infohash_hex,
+                  int file_index,
+                  long long offset,
+                  long long length,
+                  int timeout_ms,
+                  BtFileRange* out)
+{
+    if (!handle || !handle->core || !infohash_hex || !out) return -1;
+    memset(out, 0, sizeof(*out));
+    return handle->core->waitRange(infohash_hex, file_index, offset, length, timeout_ms, *out);
+}
+
 int bt_get_torrent_status(BtHandle* handle,
                           const char* infohash_hex,
                           BtTorrentStatus* out_status)
@@ -126,24 +234,128 @@ int bt_get_torrent_status(BtHandle* handle,
     return ok ? 0 : -1;
 }
 
-int bt_resume_all_torrents(BtHandle *handle,
-                           const char *bt_dir,
-                           const char *save_path)
+int bt_get_torrent_status_batch(BtHandle* handle,
+                                const char* const* infohashes,
+                                size_t count,
+                                BtTorrentStatusEntry** out_list,
+                                size_t* out_count)
 {
-    if (!handle || !bt_dir || !save_path) {
-        fprintf(stderr, "[bt] bt_resume_all_torrents: invalid argument\n");
+    if (!handle || !handle->core || !out_list || !out_count) return -1;
+    if (count > 0 && !infohashes) return -1;
+    *out_list = NULL;
+    *out_count = 0;
+
+    std::vector<std::string> req;
+    req.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (infohashes[i]) req.emplace_back(infohashes[i]);
+    }
+
+    std::vector<std::pair<std::string, BtTorrentStatus>> found;
+    std::vector<std::string> missing;
+    if (!handle->core->getStatusBatch(req, found, missing)) return -1;
+
+    size_t n = found.size() + missing.size();
+    if (n == 0) return 0;
+
+    auto* list = (BtTorrentStatusEntry*)calloc(n, sizeof(BtTorrentStatusEntry));
+    if (!list) return -1;
+
+    size_t i = 0;
+    for (auto& kv : found) {
+        snprintf(list[i].infohash_hex, sizeof(list[i].infohash_hex), "%s", kv.first.c_str());
+        list[i].found = 1;
+        list[i].status = kv.second;
+        ++i;
+    }
+    for (auto& hex : missing) {
+        snprintf(list[i].infohash_hex, sizeof(list[i].infohash_hex), "%s", hex.c_str());
+        list[i].found = 0;
+        ++i;
+    }
+
+    *out_list = list;
+    *out_count = n;
+    return 0;
+}
+
+void bt_free_status_list(BtTorrentStatusEntry* list)
+{
+    free(list);
+}
+
+int bt_get_metrics(BtHandle* handle,
+                   BtMetric** out_list,
+                   size_t* out_count,
+                   unsigned long long* out_timestamp_ms)
+{
+    if (!handle || !handle->core || !out_list || !out_count) return -1;
+    *out_list = NULL;
+    *out_count = 0;
+    if (out_timestamp_ms) *out_timestamp_ms = 0;
+
+    std::vector<BtMetric> metrics;
+    uint64_t ts = 0;
+    if (!handle->core->getMetrics(metrics, ts) || metrics.empty()) return 0;
+
+    auto* list = (BtMetric*)malloc(metrics.size() * sizeof(BtMetric));
+    if (!list) return -1;
+    memcpy(list, metrics.data(), metrics.size() * sizeof(BtMetric));
+
+    *out_list = list;
+    *out_count = metrics.size();
+    if (out_timestamp_ms) *out_timestamp_ms = ts;
+    return 0;
+}
+
+void bt_free_metrics(BtMetric* list)
+{
+    free(list);
+}
+
+int bt_set_event_callback(BtHandle* handle,
+                          unsigned mask,
+                          int progress_interval_ms,
+                          BtEventCallback cb,
+                          void* user)
+{
+    if (!handle || !handle->core) return -1;
+    if (!cb) {
+        handle->core->setEventCallback(nullptr, 0, 0);
+        return 0;
+    }
+    if (progress_interval_ms <= 0) progress_interval_ms = 1000;
+    handle->core->setEventCallback([cb, user](const BtEvent& ev) { cb(&ev, user); },
+                                   mask, progress_interval_ms);
+    return 0;
+}
+
+int bt_resume_all_torrents_ex(BtHandle *handle,
+                              const char *bt_dir,
+                              const char *save_path,
+                              BtResumeEntry **out_list,
+                              size_t *out_count)
+{
+    if (out_list) *out_list = NULL;
+    if (out_count) *out_count = 0;
+
+    if (!handle || !handle->core || !bt_dir || !save_path) {
+        iloge("[bt] bt_resume_all_torrents: invalid argument");
         return -1;
     }
 
+    // 配置里没有指定 resume_dir 时放在 torrents 目录下
+    handle->core->setResumeDir(std::string(bt_dir) + "/resume");
+
     DIR *dir = opendir(bt_dir);
     if (!dir) {
-        perror("[bt] opendir bt_dir failed");
+        iloge("[bt] opendir bt_dir failed: %s (%s)", bt_dir, strerror(errno));
         return -1;
     }
 
     struct dirent *ent;
-    int resumed_count = 0;
     char path[PATH_MAX];
+    std::vector<std::string> paths;
 
     while ((ent = readdir(dir)) != NULL) {
         if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
@@ -164,13 +376,13 @@ int bt_resume_all_torrents(BtHandle *handle,
 
         int n = snprintf(path, sizeof(path), "%s/%s", bt_dir, name);
         if (n <= 0 || (size_t)n >= sizeof(path)) {
-            fprintf(stderr, "[bt] path too long, skip: %s/%s\n", bt_dir, name);
+            iloge("[bt] path too long, skip: %s/%s", bt_dir, name);
             continue;
         }
 
         struct stat st;
         if (stat(path, &st) != 0) {
-            perror("[bt] stat failed");
+            iloge("[bt] stat failed: %s (%s)", path, strerror(errno));
             continue;
         }
         if (!S_ISREG(st.st_mode)) {
@@ -178,21 +390,53 @@ int bt_resume_all_torrents(BtHandle *handle,
             continue;
         }
 
-        char infohash[64] = {0};
-        int ret = bt_add_torrent_file(handle,
-                                      path,
-                                      save_path,
-                                      infohash,
-                                      sizeof(infohash));
-        if (ret == 0) {
+        paths.emplace_back(path);
+    }
+    closedir(dir);
+
+    std::vector<BtAddResult> results;
+    if (!handle->core->addTorrentFiles(paths, save_path, results)) {
+        return -1;
+    }
+
+    int resumed_count = 0;
+    for (auto& r : results) {
+        if (r.ok) {
             resumed_count++;
-            printf("[bt] resume seed from torrent: %s\n", path);
-            printf("[bt]   infohash = %s\n", infohash);
+            ilogi("[bt] resume seed from torrent: %s, infohash = %s", r.path.c_str(), r.infohash_hex.c_str());
         } else {
-            fprintf(stderr, "[bt] failed to add torrent file: %s (ret=%d)\n", path, ret);
+            iloge("[bt] failed to add torrent file: %s (%s)", r.path.c_str(), r.error.c_str());
         }
     }
 
-    closedir(dir);
+    if (out_list && out_count && !results.empty()) {
+        auto *list = (BtResumeEntry*)calloc(results.size(), sizeof(BtResumeEntry));
+        if (!list) return resumed_count;
+        for (size_t i = 0; i < results.size(); ++i) {
+            list[i].path = strdup(results[i].path.c_str());
+            list[i].ok = results[i].ok ? 1 : 0;
+            snprintf(list[i].infohash_hex, sizeof(list[i].infohash_hex), "%s",
+                     results[i].infohash_hex.c_str());
+            snprintf(list[i].error_msg, sizeof(list[i].error_msg), "%s",
+                     results[i].error.c_str());
+        }
+        *out_list = list;
+        *out_count = results.size();
+    }
+
     return resumed_count;
-}
\ No newline at end of file
+}
+
+void bt_free_resume_report(BtResumeEntry *list, size_t count)
+{
+    if (!list) return;
+    for (size_t i = 0; i < count; ++i) free(list[i].path);
+    free(list);
+}
+
+int bt_resume_all_torrents(BtHandle *handle,
+                           const char *bt_dir,
+                           const char *save_path)
+{
+    return bt_resume_all_torrents_ex(handle, bt_dir, save_path, NULL, NULL);
+}
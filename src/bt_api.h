@@ -10,6 +10,9 @@ extern "C" {
 
 typedef struct BtHandle BtHandle;
 
+// infohash hex 缓冲区大小：v1 为 40 位，v2-only torrent 为 64 位，含 '\0'
+#define BT_INFOHASH_HEX_LEN 65
+
 // 状态枚举（简化版）
 typedef enum BtState {
     BT_STATE_UNKNOWN = 0,
@@ -36,18 +39,134 @@ typedef struct BtTorrentStatus {
     char    error_msg[128];
 } BtTorrentStatus;
 
+// 批量查询结果
+typedef struct BtTorrentStatusEntry {
+    char            infohash_hex[BT_INFOHASH_HEX_LEN];
+    int             found;      // 0: 请求的 infohash 不存在
+    BtTorrentStatus status;
+} BtTorrentStatusEntry;
+
+// resume_all_torrents 的单个文件结果
+typedef struct BtResumeEntry {
+    char *path;
+    int   ok;
+    char  infohash_hex[BT_INFOHASH_HEX_LEN];
+    char  error_msg[128];
+} BtResumeEntry;
+
+// 做种任务（后台哈希）
+typedef enum BtHashJobState {
+    BT_HASH_QUEUED = 0,
+    BT_HASH_RUNNING,
+    BT_HASH_DONE,
+    BT_HASH_FAILED,
+    BT_HASH_CANCELLED
+} BtHashJobState;
+
+typedef struct BtHashJobInfo {
+    unsigned long long job_id;
+    BtHashJobState     state;
+    int                pieces_done;
+    int                pieces_total;
+    char               infohash_hex[BT_INFOHASH_HEX_LEN];   // DONE 时有效
+    char               error_msg[128];     // FAILED 时有效
+} BtHashJobInfo;
+
+// seed_folder 生成的 torrent 格式
+typedef enum BtTorrentFormat {
+    BT_TORRENT_HYBRID = 0,      // v1 + v2，新旧客户端都能用（libtorrent 2.0 的默认）
+    BT_TORRENT_V1,
+    BT_TORRENT_V2
+} BtTorrentFormat;
+
+typedef struct BtSeedOptions {
+    BtTorrentFormat format;
+    int piece_size_kb;          // 0 按总大小和文件数自动选；否则须为 >= 16 的 2 的幂
+    int hash_threads;           // 这个任务读盘和哈希用几个线程，0 用配置 seed_hash_threads
+} BtSeedOptions;
+
+// session 统计指标
+typedef enum BtMetricType {
+    BT_METRIC_COUNTER = 0,      // 单调递增
+    BT_METRIC_GAUGE
+} BtMetricType;
+
+typedef struct BtMetric {
+    char         name[64];      // libtorrent 的指标名，如 "net.sent_payload_bytes"；daemon 自己的以 "btd." 开头
+    BtMetricType type;
+    long long    value;
+} BtMetric;
+
+// bt_read_range / bt_wait_range 等待超时
+#define BT_ERR_TIMEOUT (-2)
+
+// bt_wait_range 的结果：这段数据已经在磁盘上，可以直接读文件
+typedef struct BtFileRange {
+    char      path[1024];       // 文件在磁盘上的完整路径，内存存储的 torrent 为空
+    long long file_size;
+    long long offset;
+    long long length;           // 已截到文件尾，0 表示 offset 就是文件尾
+} BtFileRange;
+
+// 事件类型
+typedef enum BtEventType {
+    BT_EVENT_STATE_CHANGED = 0,
+    BT_EVENT_METADATA_RECEIVED,
+    BT_EVENT_TORRENT_FINISHED,
+    BT_EVENT_ERROR,
+    BT_EVENT_PROGRESS,
+    BT_EVENT_HASH_JOB,
+    BT_EVENT_TYPE_COUNT
+} BtEventType;
+
+#define BT_EVENT_MASK(t)      (1u << (t))
+#define BT_EVENT_MASK_DEFAULT (BT_EVENT_MASK(BT_EVENT_STATE_CHANGED) | \
+                               BT_EVENT_MASK(BT_EVENT_METADATA_RECEIVED) | \
+                               BT_EVENT_MASK(BT_EVENT_TORRENT_FINISHED) | \
+                               BT_EVENT_MASK(BT_EVENT_ERROR) | \
+                               BT_EVENT_MASK(BT_EVENT_HASH_JOB))
+
+typedef struct BtEvent {
+    BtEventType type;
+    char        infohash_hex[BT_INFOHASH_HEX_LEN];
+    BtState     state;              // STATE_CHANGED / PROGRESS
+    BtState     prev_state;         // STATE_CHANGED
+    char        lt_state[24];       // libtorrent 原始状态名
+    int         error_code;         // ERROR
+    char        error_msg[128];     // ERROR
+    BtTorrentStatus status;         // PROGRESS
+    BtHashJobInfo   job;            // HASH_JOB
+} BtEvent;
+
+// 事件回调在 BT 线程里调用，不能阻塞，也不能在回调里调用 bt_* 同步接口
+typedef void (*BtEventCallback)(const BtEvent* ev, void* user);
+
 // 初始化 & 关闭
 BtHandle* bt_init(const char* config_path);
 void      bt_shutdown(BtHandle* handle);
 
 // 添加磁力链接
-// out_infohash_hex: 输出 40 字节 SHA1 hex（含 '\0' 至少 41 字节）
+// out_infohash_hex: 输出 infohash hex，有 v1 时为 40 位 SHA1，v2-only 时为 64 位 SHA256，
+//                   建议 BT_INFOHASH_HEX_LEN 字节；放不下时返回 -1
+// 其它接口传入的 infohash_hex 40 位（v1）或 64 位（v2）均可
 int bt_add_magnet(BtHandle* handle,
                   const char* magnet_uri,
                   const char* save_dir,
                   char* out_infohash_hex,
                   size_t out_len);
 
+// 同上，flags 为 BT_ADD_* 的组合
+// BT_ADD_IN_MEMORY: 数据只放在内存里不落盘，save_dir 可为 NULL；用于取完即删的小文件。
+//   内存总量由配置 mem_storage_mb 限制，超过时按最近使用淘汰已完成的此类 torrent；
+//   数据用 bt_read_range 读，bt_wait_range 返回的 path 为空；不保存 resume data
+#define BT_ADD_IN_MEMORY 0x1u
+int bt_add_magnet_ex(BtHandle* handle,
+                     const char* magnet_uri,
+                     const char* save_dir,
+                     unsigned flags,
+                     char* out_infohash_hex,
+                     size_t out_len);
+
 // 添加 torrent 文件
 int bt_add_torrent_file(BtHandle* handle,
                         const char* torrent_path,
@@ -63,20 +182,104 @@ int bt_seed_folder(BtHandle* handle,
                    size_t out_len);
 
 
+// 异步做种：立即返回 job id，哈希在后台线程池完成后自动加入 session
+int bt_seed_folder_async(BtHandle* handle,
+                         const char* folder,
+                         const char* torrent_out_path,
+                         unsigned long long* out_job_id);
+
+// 同上两个，opts 为 NULL 时全部取默认（hybrid、自动 piece 大小）
+int bt_seed_folder_ex(BtHandle* handle,
+                      const char* folder,
+                      const char* torrent_out_path,
+                      const BtSeedOptions* opts,
+                      char* out_infohash_hex,
+                      size_t out_len);
+int bt_seed_folder_async_ex(BtHandle* handle,
+                            const char* folder,
+                            const char* torrent_out_path,
+                            const BtSeedOptions* opts,
+                            unsigned long long* out_job_id);
+int bt_get_hash_job(BtHandle* handle, unsigned long long job_id, BtHashJobInfo* out_info);
+int bt_cancel_hash_job(BtHandle* handle, unsigned long long job_id);
+
 // 控制
 int bt_pause_torrent(BtHandle* handle, const char* infohash_hex);
 int bt_resume_torrent(BtHandle* handle, const char* infohash_hex);
 int bt_remove_torrent(BtHandle* handle, const char* infohash_hex, int remove_files);
+// 主动连接 peer，ip 为 IPv4 / IPv6 字面量
+int bt_connect_peer(BtHandle* handle, const char* infohash_hex, const char* ip, int port);
 
 // 查询状态
 int bt_get_torrent_status(BtHandle* handle,
                           const char* infohash_hex,
                           BtTorrentStatus* out_status);
 
+// 批量查询状态
+// infohashes 为 NULL 或 count 为 0 时返回全部 torrent
+// *out_list 由库分配，用 bt_free_status_list 释放
+int bt_get_torrent_status_batch(BtHandle* handle,
+                                const char* const* infohashes,
+                                size_t count,
+                                BtTorrentStatusEntry** out_list,
+                                size_t* out_count);
+void bt_free_status_list(BtTorrentStatusEntry* list);
+
+// 订阅事件，mask 为 BT_EVENT_MASK() 的组合；cb 为 NULL 表示取消订阅
+// progress_interval_ms: PROGRESS 事件的最小间隔，<= 0 时使用 1000
+int bt_set_event_callback(BtHandle* handle,
+                          unsigned mask,
+                          int progress_interval_ms,
+                          BtEventCallback cb,
+                          void* user);
+
+// 最近一次采样的 session 统计（配置 stats_interval 秒采一次）
+// *out_list 用 bt_free_metrics 释放；out_timestamp_ms 为采样时间（unix 毫秒），可为 NULL
+// 还没有采样时返回 0 且 *out_count 为 0
+int  bt_get_metrics(BtHandle* handle,
+                    BtMetric** out_list,
+                    size_t* out_count,
+                    unsigned long long* out_timestamp_ms);
+void bt_free_metrics(BtMetric* list);
+
+// 边下边读：读第 file_index 个文件 [offset, offset + length) 这一段。
+// 对应 piece 设 deadline 优先下载，之后再按配置 stream_read_ahead_kb 预读；
+// 磁力链接还没有 metadata 时先等 metadata。
+// out_buf 至少 length 字节，*out_len 为实际长度（到文件尾会变短），单次最多 16 MiB。
+// 返回 0 成功，BT_ERR_TIMEOUT 超时，-1 其它错误
+int bt_read_range(BtHandle* handle,
+                  const char* infohash_hex,
+                  int file_index,
+                  long long offset,
+                  size_t length,
+                  int timeout_ms,
+                  char* out_buf,
+                  size_t* out_len);
+
+// 同上，但只等这段下载完成、不拷贝数据，供调用方直接从 out->path 读（比如 sendfile）。
+// 单次同样最多 16 MiB，实际等到的范围看 out->offset / out->length，大文件分段调用
+int bt_wait_range(BtHandle* handle,
+                  const char* infohash_hex,
+                  int file_index,
+                  long long offset,
+                  long long length,
+                  int timeout_ms,
+                  BtFileRange* out);
+
+// 从目录恢复所有 .torrent，返回成功个数，失败返回 -1。
+// 配置里没有 resume_dir 时同时启用 <bt_dir>/resume 保存 resume data，不调用就不保存
 int bt_resume_all_torrents(BtHandle *handle,
                        const char *bt_dir,
                        const char *save_path);
 
+// 同上，额外输出每个文件的结果；*out_list 用 bt_free_resume_report 释放
+int bt_resume_all_torrents_ex(BtHandle *handle,
+                              const char *bt_dir,
+                              const char *save_path,
+                              BtResumeEntry **out_list,
+                              size_t *out_count);
+void bt_free_resume_report(BtResumeEntry *list, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,175 @@
+// src/bt_cmd_queue.hpp
+#ifndef VS_BT_CMD_QUEUE_HPP
+#define VS_BT_CMD_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// 只可移动的 void(Arg&) 可调用对象，闭包就地存放在 Cap 字节的缓冲区里，
+// 不做堆分配。闭包放不下时编译期报错。
+template <typename Arg, std::size_t Cap>
+class BtInplaceCommand {
+public:
+    BtInplaceCommand() = default;
+
+    template <typename F,
+              typename Fn = typename std::decay<F>::type,
+              typename = typename std::enable_if<!std::is_same<Fn, BtInplaceCommand>::value>::type>
+    BtInplaceCommand(F&& f)
+    {
+        static_assert(sizeof(Fn) <= Cap, "command closure too large, capture less or by pointer");
+        static_assert(alignof(Fn) <= alignof(std::max_align_t), "over-aligned command closure");
+        new (m_buf) Fn(std::forward<F>(f));
+        m_ops = &opsFor<Fn>();
+    }
+
+    BtInplaceCommand(BtInplaceCommand&& o) noexcept { moveFrom(o); }
+
+    BtInplaceCommand& operator=(BtInplaceCommand&& o) noexcept
+    {
+        if (this != &o) {
+            reset();
+            moveFrom(o);
+        }
+        return *this;
+    }
+
+    BtInplaceCommand(const BtInplaceCommand&) = delete;
+    BtInplaceCommand& operator=(const BtInplaceCommand&) = delete;
+
+    ~BtInplaceCommand() { reset(); }
+
+    void operator()(Arg& arg) { m_ops->invoke(m_buf, arg); }
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    void reset()
+    {
+        if (m_ops) {
+            m_ops->destroy(m_buf);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void*, Arg&);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void*);
+    };
+
+    template <typename Fn>
+    static const Ops& opsFor()
+    {
+        static const Ops ops = {
+            [](void* p, Arg& a) { (*static_cast<Fn*>(p))(a); },
+            [](void* dst, void* src) { new (dst) Fn(std::move(*static_cast<Fn*>(src))); },
+            [](void* p) { static_cast<Fn*>(p)->~Fn(); },
+        };
+        return ops;
+    }
+
+    void moveFrom(BtInplaceCommand& o)
+    {
+        if (!o.m_ops) return;
+        o.m_ops->move(m_buf, o.m_buf);
+        m_ops = o.m_ops;
+        o.reset();
+    }
+
+    alignas(std::max_align_t) unsigned char m_buf[Cap];
+    const Ops* m_ops = nullptr;
+};
+
+// 有界无锁多生产者单消费者队列（Vyukov 的环形队列，消费端去掉 CAS）。
+// N 必须是 2 的幂；满了 tryPush 返回 false，由调用方决定退让策略。
+template <typename T, std::size_t N>
+class BtMpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+    BtMpscQueue() : m_cells(new Cell[N])
+    {
+        for (std::size_t i = 0; i < N; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BtMpscQueue(const BtMpscQueue&) = delete;
+    BtMpscQueue& operator=(const BtMpscQueue&) = delete;
+
+    // 任意线程
+    bool tryPush(T&& v)
+    {
+        Cell* cell;
+        std::size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &m_cells[pos & (N - 1)];
+            std::size_t seq = cell->seq.load(std::memory_order_acquire);
+            std::intptr_t dif = (std::intptr_t)seq - (std::intptr_t)pos;
+            if (dif == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (dif < 0) {
+                return false;   // 满
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(v);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 只在消费线程调用
+    bool tryPop(T& out)
+    {
+        Cell& cell = m_cells[m_head & (N - 1)];
+        std::size_t seq = cell.seq.load(std::memory_order_acquire);
+        if ((std::intptr_t)seq - (std::intptr_t)(m_head + 1) < 0) {
+            return false;       // 空，或者生产者还没写完这一格
+        }
+        out = std::move(cell.data);
+        cell.data = T();
+        cell.seq.store(m_head + N, std::memory_order_release);
+        ++m_head;
+        return true;
+    }
+
+    // 只在消费线程调用
+    bool empty() const
+    {
+        const Cell& cell = m_cells[m_head & (N - 1)];
+        return (std::intptr_t)cell.seq.load(std::memory_order_acquire) - (std::intptr_t)(m_head + 1) < 0;
+    }
+
+    // 近似值，供监控用
+    std::size_t sizeApprox() const
+    {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        std::size_t head = m_headPublished.load(std::memory_order_relaxed);
+        return tail >= head ? tail - head : 0;
+    }
+
+    // 消费线程处理完一批后调用，更新 sizeApprox 用的 head
+    void publishHead() { m_headPublished.store(m_head, std::memory_order_relaxed); }
+
+    static constexpr std::size_t capacity() { return N; }
+
+private:
+    struct alignas(64) Cell {
+        std::atomic<std::size_t> seq;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    alignas(64) std::atomic<std::size_t> m_tail{0};
+    alignas(64) std::size_t m_head = 0;
+    std::atomic<std::size_t> m_headPublished{0};
+};
+
+#endif // VS_BT_CMD_QUEUE_HPP
@@ -0,0 +1,54 @@
+// src/bt_conn.h
+#ifndef VS_BT_CONN_H
+#define VS_BT_CONN_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * daemon 的客户端连接
+ *
+ * stdin/stdout 和 Unix socket 上的每个客户端各是一个 BtdConn，
+ * 编码协商和事件订阅都按连接记录。传输层只需要实现 send / destroy。
+ */
+enum { BTD_WIRE_JSON = 0, BTD_WIRE_MSGPACK = 1 };
+
+typedef struct BtdConn BtdConn;
+
+typedef struct BtdConnOps {
+    // 发送一帧，任意线程调用，不能阻塞在慢客户端上；连接已关闭时返回 -1
+    int  (*send)(BtdConn *c, const char *buf, size_t len);
+    // 引用计数归零时调用，可能在任意线程
+    void (*destroy)(BtdConn *c);
+    // 可选：交给 worker 的请求都处理完时在 worker 线程调用，停服时据此关闭连接
+    void (*idle)(BtdConn *c);
+} BtdConnOps;
+
+struct BtdConn {
+    const BtdConnOps *ops;
+    atomic_int refs;
+    atomic_int wire;                // BTD_WIRE_*
+    atomic_int requests;            // 已交给 worker、还没处理完的请求
+
+    // 以下由 bt_daemon.c 的 g_conn_lock 保护
+    unsigned   event_mask;
+    int        progress_interval_ms;
+    int        registered;
+    BtdConn   *next;
+};
+
+// 以下在 bt_daemon.c 实现
+
+// refs 初始为 1，由创建者持有
+void btd_conn_init(BtdConn *c, const BtdConnOps *ops);
+void btd_conn_retain(BtdConn *c);
+void btd_conn_release(BtdConn *c);
+
+// 加入 / 移出事件推送列表；unregister 返回后不会再有事件发到这个连接
+void btd_conn_register(BtdConn *c);
+void btd_conn_unregister(BtdConn *c);
+
+// 收到一帧请求：在调用线程解析，交给 worker 线程执行，不阻塞调用方
+void btd_conn_on_frame(BtdConn *c, const char *buf, size_t len);
+
+#endif // VS_BT_CONN_H
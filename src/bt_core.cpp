@@ -2,33 +2,127 @@
 #include "bt_core.hpp"
 #include "bt_api.h"
 #include "bt_utils.h"
+#include "bt_file.hpp"
+#include "bt_hasher.hpp"
+#include "bt_disk_io.hpp"
 #include <iostream>
 #include <fstream>
 #include <future>   // std::promise, std::future
 #include <vector>   // std::vector
 #include <chrono>   // std::chrono
+#include <cstring>
+#include <cstdio>
+#include <sys/stat.h>
+#include <atomic>
+#include <deque>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 
 #include <libtorrent/settings_pack.hpp>
 #include <libtorrent/sha1_hash.hpp>
 #include <libtorrent/info_hash.hpp>
 #include <libtorrent/read_resume_data.hpp>
 #include <libtorrent/write_resume_data.hpp>
+#include <libtorrent/alert_types.hpp>
+#include <libtorrent/address.hpp>
 namespace lt = libtorrent;
 
-static std::string sha1_to_hex(const lt::sha1_hash& h)
+// 事件和状态快照依赖的 alert，lt.alert_mask 不允许改
+static const lt::alert_category_t kBaseAlerts =
+    lt::alert::error_notification | lt::alert::status_notification | lt::alert::storage_notification;
+
+static bool load_resume_file(const std::string& dir,
+                             const std::string& infohash_hex,
+                             lt::add_torrent_params& p)
+{
+    if (dir.empty()) return false;
+
+    std::vector<char> buf;
+    if (!bt_read_file(dir + "/" + infohash_hex + ".fastresume", buf)) return false;
+
+    lt::error_code ec;
+    lt::add_torrent_params rp = lt::read_resume_data(buf, ec);
+    if (ec) {
+        iloge("[btd] read_resume_data error: %s (%s)", ec.message().c_str(), infohash_hex.c_str());
+        return false;
+    }
+    p = std::move(rp);
+    return true;
+}
+
+static void fill_status(const lt::torrent_status& st, BtTorrentStatus& out_status)
+{
+    out_status.progress         = st.progress;
+    out_status.download_rate    = st.download_rate;
+    out_status.upload_rate      = st.upload_rate;
+    out_status.total_downloaded = (long)st.total_download;
+    out_status.total_uploaded   = (long)st.total_upload;
+    out_status.num_peers        = st.num_peers;
+    out_status.num_seeds        = st.num_seeds;
+    out_status.num_leechers     = st.num_complete + st.num_incomplete;
+    out_status.has_metadata     = st.has_metadata ? 1 : 0;
+    out_status.is_seeding       = st.is_seeding ? 1 : 0;
+    out_status.error_code       = st.errc.value();
+    std::snprintf(out_status.error_msg, sizeof(out_status.error_msg),
+                  "%s", st.errc ? st.errc.message().c_str() : "");
+
+    if (st.is_seeding) {
+        out_status.state = BT_STATE_SEEDING;
+    } else if (st.paused) {
+        out_status.state = BT_STATE_PAUSED;
+    } else if (st.errc) {
+        out_status.state = BT_STATE_ERROR;
+    } else if (st.progress >= 0.9999f) {
+        out_status.state = BT_STATE_FINISHED;
+    } else {
+        out_status.state = BT_STATE_DOWNLOADING;
+    }
+}
+
+static void seed_status(const lt::add_torrent_params& p, BtTorrentStatus& out_status)
 {
-    std::string s = h.to_string();
-    static const char* hex = "0123456789abcdef";
+    out_status.has_metadata = p.ti ? 1 : 0;
+    if (p.flags & lt::torrent_flags::seed_mode) {
+        out_status.state = BT_STATE_SEEDING;
+        out_status.is_seeding = 1;
+        out_status.progress = 1.0f;
+    } else if (p.flags & lt::torrent_flags::paused) {
+        out_status.state = BT_STATE_PAUSED;
+    } else {
+        out_status.state = BT_STATE_DOWNLOADING;
+    }
+}
 
-    std::string out;
-    out.resize(s.size() * 2);
+static const char* lt_state_name(lt::torrent_status::state_t s)
+{
+    switch (s) {
+        case lt::torrent_status::checking_files:        return "checking_files";
+        case lt::torrent_status::downloading_metadata:  return "downloading_metadata";
+        case lt::torrent_status::downloading:           return "downloading";
+        case lt::torrent_status::finished:              return "finished";
+        case lt::torrent_status::seeding:               return "seeding";
+        case lt::torrent_status::checking_resume_data:  return "checking_resume_data";
+        default:                                        return "unknown";
+    }
+}
 
-    for (size_t i = 0; i < s.size(); ++i) {
-        unsigned char c = static_cast<unsigned char>(s[i]);
-        out[2 * i]     = hex[c >> 4];
-        out[2 * i + 1] = hex[c & 0x0F];
+static BtState lt_state_to_bt(lt::torrent_status::state_t s)
+{
+    switch (s) {
+        case lt::torrent_status::seeding:  return BT_STATE_SEEDING;
+        case lt::torrent_status::finished: return BT_STATE_FINISHED;
+        default:                           return BT_STATE_DOWNLOADING;
     }
-    return out;
+}
+
+static void init_event(BtEvent& ev, BtEventType type, const BtInfoHash& id)
+{
+    std::memset(&ev, 0, sizeof(ev));
+    ev.type = type;
+    std::snprintf(ev.infohash_hex, sizeof(ev.infohash_hex), "%s", id.toHex().c_str());
 }
 
 BtCore::BtCore() = default;
@@ -53,21 +147,53 @@ bool BtCore::init(const std::string& config_path)
         return false;
     }
 
+    m_resumeDir = m_cfg.resume_dir;
+    if (!m_resumeDir.empty()) {
+        ::mkdir(m_resumeDir.c_str(), 0755);
+    }
+
+    // 缓存坏了只是这次要全量重算，不影响启动
+    if (!m_cfg.hash_cache_file.empty()) {
+        m_hashCache = std::make_unique<BtHashCache>();
+        if (!m_hashCache->open(m_cfg.hash_cache_file)) {
+            iloge("[btd] hash cache %s unreadable, starting empty", m_cfg.hash_cache_file.c_str());
+        }
+        ilogi("[btd] hash cache %s: %zu files", m_cfg.hash_cache_file.c_str(), m_hashCache->size());
+    }
+
+    m_metricDefs = lt::session_stats_metrics();
+
+    // 打不开只是少了共享内存这条读路径，RPC 查询照常可用
+    if (!m_cfg.shm_status_path.empty()) {
+        m_shmStatus.open(m_cfg.shm_status_path, uint32_t(std::max(1, m_cfg.shm_max_torrents)));
+    }
+
     m_running = true;
     m_thread = std::thread(&BtCore::threadFunc, this);
+
+    {
+        std::lock_guard<std::mutex> guard(m_hashMutex);
+        m_hashStop = false;
+    }
+    int nhash = std::max(1, std::min(16, m_cfg.hash_threads));
+    for (int i = 0; i < nhash; ++i) {
+        m_hashThreads.emplace_back(&BtCore::hashThreadFunc, this);
+    }
     return true;
 }
 
 void BtCore::shutdown()
 {
-    {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        if (!m_running) return;
-        m_running = false;
-        m_cv.notify_all();
-    }
+    if (!m_running) return;
+
+    // 先停哈希线程：正在收尾的任务还要往 BT 线程提交 add_torrent
+    stopHashPool();
+
+    if (!m_running.exchange(false)) return;
+    wake();
     if (m_thread.joinable())
         m_thread.join();
+    m_shmStatus.close();
 }
 
 lt::session* BtCore::getSession()
@@ -75,6 +201,106 @@ lt::session* BtCore::getSession()
     return m_session.get();
 }
 
+/* ---------- settings_pack 透传 ---------- */
+
+// 几个枚举类型的整数配置允许写名字
+struct LtEnumName {
+    const char* setting;
+    const char* name;
+    int         value;
+};
+
+static const LtEnumName kLtEnumNames[] = {
+    { "choking_algorithm",      "fixed_slots_choker", lt::settings_pack::fixed_slots_choker },
+    { "choking_algorithm",      "rate_based_choker",  lt::settings_pack::rate_based_choker },
+    { "seed_choking_algorithm", "round_robin",        lt::settings_pack::round_robin },
+    { "seed_choking_algorithm", "fastest_upload",     lt::settings_pack::fastest_upload },
+    { "seed_choking_algorithm", "anti_leech",         lt::settings_pack::anti_leech },
+};
+
+static bool is_known_preset(const std::string& name)
+{
+    return name == "high_performance_seed" || name == "low_memory";
+}
+
+static lt::settings_pack preset_pack(const std::string& name)
+{
+    if (name == "high_performance_seed") return lt::high_performance_seed();
+    if (name == "low_memory") return lt::min_memory_usage();
+    return lt::settings_pack();
+}
+
+// 把 src 里设置过的项覆盖到 dst
+static void merge_settings(lt::settings_pack& dst, const lt::settings_pack& src)
+{
+    using sp = lt::settings_pack;
+    for (int i = 0; i < sp::num_string_settings; ++i) {
+        int n = sp::string_type_base + i;
+        if (src.has_val(n)) dst.set_str(n, src.get_str(n));
+    }
+    for (int i = 0; i < sp::num_int_settings; ++i) {
+        int n = sp::int_type_base + i;
+        if (src.has_val(n)) dst.set_int(n, src.get_int(n));
+    }
+    for (int i = 0; i < sp::num_bool_settings; ++i) {
+        int n = sp::bool_type_base + i;
+        if (src.has_val(n)) dst.set_bool(n, src.get_bool(n));
+    }
+}
+
+// 解析 lt.<name> = val，失败时 err 为原因
+static bool parse_lt_setting(const std::string& name, const std::string& val,
+                             BtLtSetting& out, std::string& err)
+{
+    using sp = lt::settings_pack;
+    int n = lt::setting_by_name(name);
+    if (n < 0) {
+        err = "unknown setting";
+        return false;
+    }
+    // 事件和状态快照依赖这几类 alert，不允许改
+    if (n == sp::alert_mask) {
+        err = "managed by daemon";
+        return false;
+    }
+
+    out = BtLtSetting{};
+    out.name = n;
+    switch (n & sp::type_mask) {
+        case sp::string_type_base:
+            out.str = val;
+            return true;
+        case sp::bool_type_base:
+            if (val == "1" || val == "true" || val == "on") out.num = 1;
+            else if (val == "0" || val == "false" || val == "off") out.num = 0;
+            else {
+                err = "expect bool";
+                return false;
+            }
+            return true;
+        case sp::int_type_base: {
+            for (const auto& e : kLtEnumNames) {
+                if (name == e.setting && val == e.name) {
+                    out.num = e.value;
+                    return true;
+                }
+            }
+            char* end = nullptr;
+            errno = 0;
+            long v = std::strtol(val.c_str(), &end, 0);
+            if (val.empty() || *end != '\0' || errno == ERANGE || v < INT_MIN || v > INT_MAX) {
+                err = "expect int";
+                return false;
+            }
+            out.num = int(v);
+            return true;
+        }
+        default:
+            err = "unknown type";
+            return false;
+    }
+}
+
 bool BtCore::loadConfig(const std::string& path, BtConfig& out)
 {
     if (path.empty()) {
@@ -145,6 +371,49 @@ bool BtCore::loadConfig(const std::string& path, BtConfig& out)
             cfg.download_limit = std::stoi(val) * 1024;
         } else if (key == "dht_router") {
             cfg.dht_routers.push_back(val);
+        } else if (key == "resume_dir") {
+            cfg.resume_dir = val;
+        } else if (key == "resume_save_interval") {
+            cfg.resume_save_interval = std::stoi(val);
+        } else if (key == "hash_threads") {
+            cfg.hash_threads = std::stoi(val);
+        } else if (key == "seed_hash_threads") {
+            cfg.seed_hash_threads = std::stoi(val);
+        } else if (key == "hash_cache_file") {
+            cfg.hash_cache_file = val;
+        } else if (key == "status_interval_ms") {
+            cfg.status_interval_ms = std::stoi(val);
+        } else if (key == "shm_status_path") {
+            cfg.shm_status_path = val;
+        } else if (key == "shm_max_torrents") {
+            cfg.shm_max_torrents = std::stoi(val);
+        } else if (key == "stats_interval") {
+            cfg.stats_interval = std::stoi(val);
+        } else if (key == "metrics_file") {
+            cfg.metrics_file = val;
+        } else if (key == "disk_io") {
+            if (bt_disk_io_known(val)) cfg.disk_io = val;
+            else iloge("[btd] config: unknown disk_io %s, use default", val.c_str());
+        } else if (key == "file_pool_size") {
+            cfg.file_pool_size = std::stoi(val);
+        } else if (key == "storage_mode") {
+            if (val == "allocate") cfg.storage_mode = lt::storage_mode_allocate;
+            else if (val == "sparse") cfg.storage_mode = lt::storage_mode_sparse;
+            else iloge("[btd] config: unknown storage_mode %s, use sparse", val.c_str());
+        } else if (key == "mem_storage_mb") {
+            cfg.mem_storage_mb = std::stoi(val);
+        } else if (key == "stream_read_ahead_kb") {
+            cfg.stream_read_ahead_kb = std::stoi(val);
+        } else if (key == "allow_multiple_connections_per_ip") {
+            cfg.allow_multiple_connections_per_ip = (val == "1" || val == "true" || val == "on");
+        } else if (key == "preset") {
+            if (is_known_preset(val)) cfg.presets.push_back(val);
+            else iloge("[btd] config: unknown preset %s, ignored", val.c_str());
+        } else if (key.compare(0, 3, "lt.") == 0) {
+            BtLtSetting st;
+            std::string err;
+            if (parse_lt_setting(key.substr(3), val, st, err)) cfg.lt_settings.push_back(st);
+            else iloge("[btd] config: %s = %s: %s, ignored", key.c_str(), val.c_str(), err.c_str());
         }
     }
 
@@ -160,22 +429,72 @@ bool BtCore::loadConfig(const std::string& path, BtConfig& out)
     return true;
 }
 
-void BtCore::postCommand(const std::function<void(lt::session&)>& cmd)
+bool BtCore::postCommand(const char* name, BtCommand cmd)
 {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    if (!m_running) return;
-    m_cmdQueue.push(cmd);
-    m_cv.notify_all();
+    // 先登记再看 m_running，与 threadFunc 收尾时的检查配对：
+    // 要么这里看到已停止，要么 BT 线程等这条命令入队后再做最后一次取空
+    m_posters.fetch_add(1, std::memory_order_seq_cst);
+    if (!m_running.load(std::memory_order_seq_cst)) {
+        m_posters.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+
+    BtQueuedCommand qc;
+    qc.fn = std::move(cmd);
+    qc.perf = bt_perf_method(BT_PERF_CMD, name);
+    qc.postNs = bt_perf_now_ns();
+
+    // 队列满时让出 CPU 等 BT 线程消费，不丢命令；停止时 BT 线程也会一直取到没有登记的投递者
+    while (!m_cmdQueue.tryPush(std::move(qc))) {
+        wake();
+        std::this_thread::yield();
+    }
+    m_posters.fetch_sub(1, std::memory_order_release);
+    bt_perf_queue_depth(BT_PERF_CMD, long(m_cmdQueue.sizeApprox()));
+
+    // 与 threadFunc 里 m_sleeping 的 store + fence 配对：要么这里看到 BT 线程
+    // 准备睡眠并唤醒它，要么 BT 线程睡前检查队列时看到这条命令
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed)) {
+        wake();
+    }
+    return true;
+}
+
+void BtCore::runCommand(BtQueuedCommand& cmd)
+{
+    uint64_t start = bt_perf_now_ns();
+    cmd.fn(*m_session);
+    uint64_t end = bt_perf_now_ns();
+    cmd.fn.reset();
+
+    bt_perf_record(cmd.perf, BT_PERF_QUEUE, start - cmd.postNs);
+    bt_perf_record(cmd.perf, BT_PERF_EXEC, end - start);
+    bt_perf_record(cmd.perf, BT_PERF_TOTAL, end - cmd.postNs);
+}
+
+// 可能在 libtorrent 网络线程里调用（alert notify），只能碰 m_wakeMutex，
+// 注册表锁可能正被 BT 线程持有并同步等待网络线程
+void BtCore::wake()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_wakeMutex);
+        m_wakeup = true;
+    }
+    m_cv.notify_one();
 }
 
 void BtCore::threadFunc()
 {
     lt::settings_pack pack;
 
-    pack.set_int(lt::settings_pack::alert_mask,
-        lt::alert::error_notification |
-        lt::alert::status_notification |
-        lt::alert::storage_notification);
+    for (auto& name : m_cfg.presets) {
+        merge_settings(pack, preset_pack(name));
+        ilogi("[btd] settings preset %s", name.c_str());
+    }
+
+    // piece_progress_notification 每个 piece 一条，只在有 wait_range 等待时打开，见 syncPieceAlerts
+    pack.set_int(lt::settings_pack::alert_mask, kBaseAlerts);
 
     // Listen port
     int port = m_cfg.listen_start;
@@ -194,8 +513,31 @@ void BtCore::threadFunc()
         pack.set_int(lt::settings_pack::download_rate_limit, m_cfg.download_limit);
 
     pack.set_bool(lt::settings_pack::enable_dht, m_cfg.enable_dht);
+    pack.set_bool(lt::settings_pack::allow_multiple_connections_per_ip,
+                  m_cfg.allow_multiple_connections_per_ip);
 
-    m_session = std::make_unique<lt::session>(pack);
+    if (m_cfg.file_pool_size > 0)
+        pack.set_int(lt::settings_pack::file_pool_size, m_cfg.file_pool_size);
+
+    for (auto& st : m_cfg.lt_settings) {
+        switch (st.name & lt::settings_pack::type_mask) {
+            case lt::settings_pack::string_type_base: pack.set_str(st.name, st.str); break;
+            case lt::settings_pack::bool_type_base:   pack.set_bool(st.name, st.num != 0); break;
+            default:                                  pack.set_int(st.name, st.num); break;
+        }
+    }
+    if (!m_cfg.lt_settings.empty())
+        ilogi("[btd] settings: %zu lt.* overrides", m_cfg.lt_settings.size());
+
+    // 后端自己的默认参数垫在最下面，不覆盖上面设置过的项
+    lt::session_params params(std::move(pack));
+    bt_disk_io_setup(m_cfg.disk_io, params);
+    ilogi("[btd] disk_io %s, hasher %s", m_cfg.disk_io.c_str(), bt_hasher_backend());
+    if (m_cfg.mem_storage_mb > 0) {
+        m_memUsage = std::make_shared<BtMemUsage>(int64_t(m_cfg.mem_storage_mb) * 1024 * 1024);
+        bt_mem_storage_setup(m_memUsage, params);
+    }
+    m_session = std::make_unique<lt::session>(std::move(params));
 
     if (m_cfg.enable_dht) {
         for (auto& s : m_cfg.dht_routers) {
@@ -208,44 +550,528 @@ void BtCore::threadFunc()
         m_session->start_dht();
     }
 
+    // alert 队列由空变非空时 libtorrent 回调这里，唤醒 BT 线程
+    m_session->set_alert_notify([this] { wake(); });
+
+    std::vector<lt::alert*> alerts;
+    BtQueuedCommand cmd;
+    const std::chrono::milliseconds statusInterval(std::max(0, m_cfg.status_interval_ms));
+    const std::chrono::seconds statsInterval(std::max(0, m_cfg.stats_interval));
+
     while (m_running) {
-        // 处理命令
-        std::function<void(lt::session&)> cmd;
+        std::chrono::milliseconds progress{0};
         {
-            std::unique_lock<std::mutex> lock(m_mutex);
-            if (m_cmdQueue.empty()) {
-                m_cv.wait_for(lock, std::chrono::milliseconds(500));
+            std::lock_guard<std::mutex> guard(m_eventMutex);
+            if (m_eventCb && (m_eventMask & BT_EVENT_MASK(BT_EVENT_PROGRESS)))
+                progress = m_progressInterval;
+        }
+
+        // 睡到有命令、有 alert 或者下一个定时任务到期
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        if (!m_resumeDir.empty() && m_cfg.resume_save_interval > 0)
+            deadline = std::min(deadline, m_resumeSaveTime + std::chrono::seconds(m_cfg.resume_save_interval));
+        if (statusInterval.count() > 0)
+            deadline = std::min(deadline, m_statusPostTime + statusInterval);
+        if (progress.count() > 0)
+            deadline = std::min(deadline, m_progressEmitTime + progress);
+        if (statsInterval.count() > 0)
+            deadline = std::min(deadline, m_statsPostTime + statsInterval);
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            m_cv.wait_until(lock, deadline, [this] {
+                return m_wakeup || !m_running || !m_cmdQueue.empty();
+            });
+            m_sleeping.store(false, std::memory_order_relaxed);
+            m_wakeup = false;
+        }
+        if (!m_running) break;
+
+        // 一次取空命令队列
+        while (m_cmdQueue.tryPop(cmd)) {
+            runCommand(cmd);
+        }
+        m_cmdQueue.publishHead();
+        bt_perf_queue_depth(BT_PERF_CMD, long(m_cmdQueue.sizeApprox()));
+
+        // 批量处理 alert
+        m_session->pop_alerts(&alerts);
+        for (auto* a : alerts) {
+            handleAlert(a);
+        }
+
+        if (m_memUsage) evictMemTorrents();
+
+        // 定期保存有变化的 resume data
+        if (!m_resumeDir.empty() && m_cfg.resume_save_interval > 0) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - m_resumeSaveTime >= std::chrono::seconds(m_cfg.resume_save_interval)) {
+                saveAllResumeData(lt::torrent_handle::only_if_modified);
+                m_resumeSaveTime = now;
             }
-            if (!m_running) break;
-            if (!m_cmdQueue.empty()) {
-                cmd = std::move(m_cmdQueue.front());
-                m_cmdQueue.pop();
+        }
+
+        // 定期拉一次有变化的 torrent 刷新状态快照；暂停、出错等状态切换后立即拉
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (m_statusDirty || (statusInterval.count() > 0 && now - m_statusPostTime >= statusInterval)) {
+                m_session->post_torrent_updates();
+                m_statusPostTime = now;
+                m_statusDirty = false;
+            }
+        }
+
+        // session 计数器，结果从 session_stats_alert 收
+        if (statsInterval.count() > 0) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - m_statsPostTime >= statsInterval) {
+                m_session->post_session_stats();
+                m_statsPostTime = now;
             }
         }
-        if (cmd) {
-            cmd(*m_session);
+
+        // 订阅了进度事件时按间隔把有变化的 torrent 发出去
+        if (progress.count() > 0) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - m_progressEmitTime >= progress) {
+                emitProgressEvents();
+                m_progressEmitTime = now;
+            }
         }
+    }
+
+    // 退出前把已经入队的命令执行完，避免调用方一直等 promise。
+    // m_running 已经是 false，之后的 postCommand 都会失败；已经过了检查的投递者可能还没入队，
+    // 等它们都走完再取最后一次
+    for (;;) {
+        bool idle = m_posters.load(std::memory_order_seq_cst) == 0;
+        while (m_cmdQueue.tryPop(cmd)) {
+            runCommand(cmd);
+        }
+        if (idle) break;
+        std::this_thread::yield();
+    }
+
+    failPendingAdds("shutdown");
+    failRangeReads(BtInfoHash());
+    flushResumeData();
+    m_session->set_alert_notify([] {});
+    m_session.reset();
+}
+
+std::string BtCore::resumePath(const std::string& infohash_hex) const
+{
+    return m_resumeDir + "/" + infohash_hex + ".fastresume";
+}
+
+bool BtCore::loadResumeData(const std::string& infohash_hex, lt::add_torrent_params& p)
+{
+    return load_resume_file(m_resumeDir, infohash_hex, p);
+}
+
+void BtCore::saveAllResumeData(lt::resume_data_flags_t flags)
+{
+    std::vector<lt::torrent_handle> handles;
+    {
+        std::lock_guard<std::shared_mutex> guard(m_torrentsMutex);
+        handles.reserve(m_torrents.size());
+        m_torrents.forEach([&](const BtInfoHash& key, TorrentEntry& e) {
+            // 跳过别名；内存里的数据重启后就没了，磁力链接没有 .torrent 文件，
+            // resume_all_torrents 只按 .torrent 恢复，都不保存
+            if (key == e.id && !e.in_memory && !e.magnet) handles.push_back(e.handle);
+        });
+    }
+    for (auto& h : handles) {
+        if (!h.is_valid()) continue;
+        h.save_resume_data(flags);
+        ++m_resumePending;
+    }
+}
 
+// 退出前把所有 torrent 的 resume data 落盘
+void BtCore::flushResumeData()
+{
+    if (m_resumeDir.empty() || !m_session) return;
+
+    m_session->pause();
+    saveAllResumeData(lt::torrent_handle::flush_disk_cache | lt::torrent_handle::save_info_dict);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (m_resumePending > 0 && std::chrono::steady_clock::now() < deadline) {
+        if (!m_session->wait_for_alert(std::chrono::milliseconds(500))) continue;
         std::vector<lt::alert*> alerts;
         m_session->pop_alerts(&alerts);
         for (auto* a : alerts) {
-            iloge("[btd] alert: %s", a->message().c_str());
+            handleAlert(a);
         }
     }
+    if (m_resumePending > 0) {
+        iloge("[btd] flushResumeData: %d torrents timed out", m_resumePending);
+    }
+}
 
-    m_session.reset();
+void BtCore::setResumeDir(const std::string& dir)
+{
+    postCommand("set_resume_dir", [this, dir](lt::session&) {
+        if (!m_resumeDir.empty()) return;
+        ::mkdir(dir.c_str(), 0755);
+        m_resumeDir = dir;
+    });
+}
+
+bool BtCore::findTorrent(const BtInfoHash& key, TorrentEntry& out)
+{
+    std::shared_lock<std::shared_mutex> guard(m_torrentsMutex);
+    const TorrentEntry* e = m_torrents.find(key);
+    if (!e) return false;
+    out = *e;
+    return true;
+}
+
+// 已登记的 torrent 用登记时的主 key（v2 磁力链接拿到 hybrid metadata 后主 key 不变）
+BtInfoHash BtCore::torrentId(const lt::info_hash_t& ih)
+{
+    TorrentEntry e;
+    if (findTorrent(bt_primary_key(ih), e)) return e.id;
+    BtInfoHash alias = bt_alias_key(ih);
+    if (!alias.empty() && findTorrent(alias, e)) return e.id;
+    return bt_primary_key(ih);
+}
+
+std::string BtCore::registerTorrent(const lt::torrent_handle& h, const lt::add_torrent_params* added,
+                                    bool in_memory, bool magnet)
+{
+    lt::info_hash_t ih = h.info_hashes();
+    TorrentEntry e;
+    e.handle = h;
+    e.id = bt_primary_key(ih);
+    e.alias = bt_alias_key(ih);
+    e.in_memory = in_memory;
+    e.magnet = magnet;
+    if (in_memory) touchMemTorrent(e.id, false);
+
+    // 批量添加时不做同步 status()，先按添加参数填个大概，下一次 state_update_alert 补上
+    BtTorrentStatus st{};
+    if (added) seed_status(*added, st);
+    else fill_status(h.status(), st);
+
+    {
+        std::lock_guard<std::shared_mutex> guard(m_torrentsMutex);
+        m_torrents.insert(e.id, e);
+        if (!e.alias.empty()) m_torrents.insert(e.alias, e);
+    }
+    m_statusTable.put(e.id, e.alias, st);
+    m_shmStatus.put(e.id, e.alias, st);
+    return e.id.toHex();
+}
+
+// 磁力链接拿到 metadata 后才知道是不是 hybrid，补登记另一个 key
+void BtCore::addAlias(const lt::info_hash_t& ih)
+{
+    BtInfoHash k1 = bt_primary_key(ih);
+    BtInfoHash k2 = bt_alias_key(ih);
+    if (k2.empty()) return;
+
+    std::lock_guard<std::shared_mutex> guard(m_torrentsMutex);
+    TorrentEntry* e = m_torrents.find(k1);
+    if (!e) e = m_torrents.find(k2);
+    if (!e || !e->alias.empty()) return;
+
+    TorrentEntry copy = *e;
+    copy.alias = (copy.id == k1) ? k2 : k1;
+    m_torrents.insert(copy.id, copy);
+    m_torrents.insert(copy.alias, copy);
+}
+
+void BtCore::handleAlert(lt::alert* a)
+{
+    if (auto* su = lt::alert_cast<lt::state_update_alert>(a)) {
+        onStateUpdate(su->status);
+        return;
+    }
+    if (auto* ss = lt::alert_cast<lt::session_stats_alert>(a)) {
+        onSessionStats(ss);
+        return;
+    }
+    if (auto* rd = lt::alert_cast<lt::save_resume_data_alert>(a)) {
+        if (m_resumePending > 0) --m_resumePending;
+        if (m_resumeDir.empty()) return;
+        // 已经 remove 的不再写回
+        TorrentEntry e;
+        if (!findTorrent(bt_primary_key(rd->params.info_hashes), e) &&
+            !findTorrent(bt_alias_key(rd->params.info_hashes), e)) return;
+        std::string hex = e.id.toHex();
+        std::vector<char> buf = lt::write_resume_data_buf(rd->params);
+        if (!bt_write_file_atomic(resumePath(hex), buf)) {
+            iloge("[btd] write resume data failed: %s", resumePath(hex).c_str());
+        }
+        return;
+    }
+    if (auto* at = lt::alert_cast<lt::add_torrent_alert>(a)) {
+        onTorrentAdded(at);
+        return;
+    }
+    if (lt::alert_cast<lt::save_resume_data_failed_alert>(a)) {
+        // only_if_modified 下没有变化也会走这里，不算错误
+        if (m_resumePending > 0) --m_resumePending;
+        return;
+    }
+    if (auto* rp = lt::alert_cast<lt::read_piece_alert>(a)) {
+        onRangePiece(torrentId(rp->handle.info_hashes()), static_cast<int>(rp->piece),
+                     rp->buffer.get(), rp->size, bool(rp->error));
+        return;
+    }
+    if (auto* td = lt::alert_cast<lt::torrent_deleted_alert>(a)) {
+        onMemTorrentDeleted(td->info_hashes);
+        return;
+    }
+    if (auto* tdf = lt::alert_cast<lt::torrent_delete_failed_alert>(a)) {
+        onMemTorrentDeleted(tdf->info_hashes);
+        return;
+    }
+    if (auto* pf = lt::alert_cast<lt::piece_finished_alert>(a)) {
+        if (!m_rangeReads.empty())
+            onRangePiece(torrentId(pf->handle.info_hashes()), static_cast<int>(pf->piece_index),
+                         nullptr, 0, false);
+        return;
+    }
+    if (log_enabled(BT_LOG_DEBUG)) {
+        ilogii("[btd] alert: %s", a->message().c_str());
+    }
+
+    if (lt::alert_cast<lt::state_changed_alert>(a) || lt::alert_cast<lt::torrent_paused_alert>(a) ||
+        lt::alert_cast<lt::torrent_resumed_alert>(a) || lt::alert_cast<lt::torrent_finished_alert>(a) ||
+        lt::alert_cast<lt::torrent_error_alert>(a) || lt::alert_cast<lt::metadata_received_alert>(a)) {
+        m_statusDirty = true;
+    }
+
+    BtEvent ev;
+    if (auto* sc = lt::alert_cast<lt::state_changed_alert>(a)) {
+        if (!wantEvent(BT_EVENT_STATE_CHANGED)) return;
+        init_event(ev, BT_EVENT_STATE_CHANGED, torrentId(sc->handle.info_hashes()));
+        ev.state = lt_state_to_bt(sc->state);
+        ev.prev_state = lt_state_to_bt(sc->prev_state);
+        std::snprintf(ev.lt_state, sizeof(ev.lt_state), "%s", lt_state_name(sc->state));
+        emitEvent(ev);
+    } else if (auto* tp = lt::alert_cast<lt::torrent_paused_alert>(a)) {
+        if (!wantEvent(BT_EVENT_STATE_CHANGED)) return;
+        init_event(ev, BT_EVENT_STATE_CHANGED, torrentId(tp->handle.info_hashes()));
+        ev.state = BT_STATE_PAUSED;
+        ev.prev_state = BT_STATE_UNKNOWN;
+        std::snprintf(ev.lt_state, sizeof(ev.lt_state), "%s", "paused");
+        emitEvent(ev);
+    } else if (auto* tr = lt::alert_cast<lt::torrent_resumed_alert>(a)) {
+        if (!wantEvent(BT_EVENT_STATE_CHANGED)) return;
+        BtInfoHash id = torrentId(tr->handle.info_hashes());
+        init_event(ev, BT_EVENT_STATE_CHANGED, id);
+        // 恢复后可能是做种或已完成；快照里还是暂停前的进度，不在这里同步查 status()
+        BtTorrentStatus st{};
+        if (!m_statusTable.get(id, st)) ev.state = BT_STATE_DOWNLOADING;
+        else if (st.is_seeding) ev.state = BT_STATE_SEEDING;
+        else if (st.progress >= 0.9999f) ev.state = BT_STATE_FINISHED;
+        else ev.state = BT_STATE_DOWNLOADING;
+        ev.prev_state = BT_STATE_PAUSED;
+        std::snprintf(ev.lt_state, sizeof(ev.lt_state), "%s", "resumed");
+        emitEvent(ev);
+    } else if (auto* mr = lt::alert_cast<lt::metadata_received_alert>(a)) {
+        addAlias(mr->handle.info_hashes());
+        armRangeReads(torrentId(mr->handle.info_hashes()), mr->handle);
+        if (!wantEvent(BT_EVENT_METADATA_RECEIVED)) return;
+        init_event(ev, BT_EVENT_METADATA_RECEIVED, torrentId(mr->handle.info_hashes()));
+        emitEvent(ev);
+    } else if (auto* tf = lt::alert_cast<lt::torrent_finished_alert>(a)) {
+        if (!m_memTorrents.empty()) touchMemTorrent(torrentId(tf->handle.info_hashes()), true);
+        if (!wantEvent(BT_EVENT_TORRENT_FINISHED)) return;
+        init_event(ev, BT_EVENT_TORRENT_FINISHED, torrentId(tf->handle.info_hashes()));
+        ev.state = BT_STATE_FINISHED;
+        emitEvent(ev);
+    } else if (auto* te = lt::alert_cast<lt::torrent_error_alert>(a)) {
+        if (!wantEvent(BT_EVENT_ERROR)) return;
+        init_event(ev, BT_EVENT_ERROR, torrentId(te->handle.info_hashes()));
+        ev.state = BT_STATE_ERROR;
+        ev.error_code = te->error.value();
+        std::snprintf(ev.error_msg, sizeof(ev.error_msg), "%s", te->error.message().c_str());
+        emitEvent(ev);
+    } else if (auto* fe = lt::alert_cast<lt::file_error_alert>(a)) {
+        if (!wantEvent(BT_EVENT_ERROR)) return;
+        init_event(ev, BT_EVENT_ERROR, torrentId(fe->handle.info_hashes()));
+        ev.state = BT_STATE_ERROR;
+        ev.error_code = fe->error.value();
+        std::snprintf(ev.error_msg, sizeof(ev.error_msg), "%s: %s",
+                      fe->filename(), fe->error.message().c_str());
+        emitEvent(ev);
+    } else if (auto* mf = lt::alert_cast<lt::metadata_failed_alert>(a)) {
+        if (!wantEvent(BT_EVENT_ERROR)) return;
+        init_event(ev, BT_EVENT_ERROR, torrentId(mf->handle.info_hashes()));
+        ev.error_code = mf->error.value();
+        std::snprintf(ev.error_msg, sizeof(ev.error_msg), "%s", mf->error.message().c_str());
+        emitEvent(ev);
+    }
+}
+
+void BtCore::setEventCallback(std::function<void(const BtEvent&)> cb,
+                              unsigned mask,
+                              int progress_interval_ms)
+{
+    std::lock_guard<std::mutex> guard(m_eventMutex);
+    m_eventCb = std::move(cb);
+    m_eventMask = m_eventCb ? mask : 0;
+    m_progressInterval = std::chrono::milliseconds(progress_interval_ms);
+}
+
+bool BtCore::wantEvent(BtEventType type)
+{
+    std::lock_guard<std::mutex> guard(m_eventMutex);
+    return m_eventCb && (m_eventMask & BT_EVENT_MASK(type));
+}
+
+void BtCore::emitEvent(const BtEvent& ev)
+{
+    std::function<void(const BtEvent&)> cb;
+    {
+        std::lock_guard<std::mutex> guard(m_eventMutex);
+        if (!m_eventCb || !(m_eventMask & BT_EVENT_MASK(ev.type))) return;
+        cb = m_eventCb;
+    }
+    cb(ev);
+}
+
+void BtCore::onStateUpdate(const std::vector<lt::torrent_status>& sts)
+{
+    bool progress = wantEvent(BT_EVENT_PROGRESS);
+    BtTorrentStatus bst;
+
+    for (auto& st : sts) {
+        std::memset(&bst, 0, sizeof(bst));
+        fill_status(st, bst);
+
+        // 只更新已登记的，避免 remove 之后旧的 update 把条目带回来；
+        // v2 磁力链接登记时主 key 是 v2，拿到 hybrid metadata 后要反过来找
+        BtInfoHash k1 = bt_primary_key(st.info_hashes);
+        BtInfoHash k2 = bt_alias_key(st.info_hashes);
+        const BtInfoHash* id = &k1;
+        if (!m_statusTable.update(k1, k2, bst)) {
+            if (k2.empty() || !m_statusTable.update(k2, k1, bst)) continue;
+            id = &k2;
+        }
+        // 共享内存槽位曾经用满时这里补上
+        m_shmStatus.put(*id, id == &k1 ? k2 : k1, bst);
+
+        if (progress) m_progressDirty.insert(*id, int(st.state));
+    }
+    m_shmStatus.publish();
+}
+
+void BtCore::onSessionStats(lt::session_stats_alert* a)
+{
+    auto counters = a->counters();
+    uint64_t ts = uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    {
+        std::lock_guard<std::mutex> guard(m_metricsMutex);
+        m_metricValues.assign(counters.begin(), counters.end());
+        m_metricsTime = ts;
+    }
+
+    if (!m_cfg.metrics_file.empty()) {
+        std::vector<BtMetric> metrics;
+        uint64_t t = 0;
+        if (getMetrics(metrics, t)) writeMetricsFile(metrics, t);
+    }
+}
+
+bool BtCore::getMetrics(std::vector<BtMetric>& out, uint64_t& timestamp_ms)
+{
+    out.clear();
+    {
+        std::lock_guard<std::mutex> guard(m_metricsMutex);
+        if (m_metricsTime == 0) return false;
+        timestamp_ms = m_metricsTime;
+        out.reserve(m_metricDefs.size() + 3);
+        for (auto& m : m_metricDefs) {
+            if (m.value_index < 0 || size_t(m.value_index) >= m_metricValues.size()) continue;
+            BtMetric bm{};
+            std::snprintf(bm.name, sizeof(bm.name), "%s", m.name);
+            bm.type = m.type == lt::metric_type_t::gauge ? BT_METRIC_GAUGE : BT_METRIC_COUNTER;
+            bm.value = m_metricValues[size_t(m.value_index)];
+            out.push_back(bm);
+        }
+    }
+
+    // daemon 自己的几项，取值时刻的近似值
+    auto add = [&](const char* name, long long v) {
+        BtMetric bm{};
+        std::snprintf(bm.name, sizeof(bm.name), "%s", name);
+        bm.type = BT_METRIC_GAUGE;
+        bm.value = v;
+        out.push_back(bm);
+    };
+    add("btd.torrents", (long long)m_statusTable.size());
+    add("btd.cmd_queue_depth", (long long)m_cmdQueue.sizeApprox());
+    {
+        std::lock_guard<std::mutex> guard(m_hashMutex);
+        add("btd.hash_jobs_queued", (long long)m_hashQueue.size());
+    }
+    return true;
+}
+
+// Prometheus 文本格式："net.sent_bytes" -> libtorrent_net_sent_bytes，先写临时文件再 rename
+void BtCore::writeMetricsFile(const std::vector<BtMetric>& metrics, uint64_t timestamp_ms)
+{
+    std::string text;
+    text.reserve(metrics.size() * 96);
+    char line[160];
+    for (auto& m : metrics) {
+        std::string name = std::strncmp(m.name, "btd.", 4) == 0 ? "vs1984_" : "libtorrent_";
+        for (const char* p = m.name; *p; ++p) {
+            name += std::isalnum((unsigned char)*p) ? *p : '_';
+        }
+        const char* type = m.type == BT_METRIC_GAUGE ? "gauge" : "counter";
+        std::snprintf(line, sizeof(line), "# TYPE %s %s\n%s %lld\n",
+                      name.c_str(), type, name.c_str(), m.value);
+        text += line;
+    }
+    std::snprintf(line, sizeof(line), "# TYPE vs1984_metrics_timestamp_ms gauge\nvs1984_metrics_timestamp_ms %llu\n",
+                  (unsigned long long)timestamp_ms);
+    text += line;
+
+    if (!bt_write_file_atomic(m_cfg.metrics_file, std::vector<char>(text.begin(), text.end()))) {
+        iloge("[btd] write metrics file failed: %s", m_cfg.metrics_file.c_str());
+    }
+}
+
+void BtCore::emitProgressEvents()
+{
+    if (m_progressDirty.empty()) return;
+
+    std::vector<BtEvent> events;
+    events.reserve(m_progressDirty.size());
+    m_progressDirty.forEach([&](const BtInfoHash& id, int lt_state) {
+        BtEvent ev;
+        init_event(ev, BT_EVENT_PROGRESS, id);
+        if (!m_statusTable.get(id, ev.status)) return;
+        ev.state = ev.status.state;
+        std::snprintf(ev.lt_state, sizeof(ev.lt_state), "%s",
+                      lt_state_name(lt::torrent_status::state_t(lt_state)));
+        events.push_back(ev);
+    });
+    m_progressDirty.clear();
+
+    for (auto& ev : events) emitEvent(ev);
 }
 
 
 bool BtCore::addMagnet(const std::string& magnet,
                        const std::string& save_dir,
+                       bool in_memory,
                        std::string& out_infohash_hex)
 {
     bool ok = false;
     std::promise<void> done;
     auto fut = done.get_future();
 
-    postCommand([&](lt::session& ses) {
+    if (!postCommand("add_magnet", [&](lt::session& ses) {
         lt::error_code ec;
         lt::add_torrent_params p = lt::parse_magnet_uri(magnet, ec);
         if (ec) {
@@ -253,7 +1079,17 @@ bool BtCore::addMagnet(const std::string& magnet,
             done.set_value();
             return;
         }
-        p.save_path = save_dir;
+        if (in_memory) {
+            if (!m_memUsage) {
+                iloge("[btd] add_magnet: in-memory storage disabled (mem_storage_mb = 0)");
+                done.set_value();
+                return;
+            }
+            p.save_path = kBtMemSavePath;
+        } else {
+            p.save_path = save_dir;
+            p.storage_mode = m_cfg.storage_mode;
+        }
         p.flags |= lt::torrent_flags::auto_managed;
         p.flags |= lt::torrent_flags::paused; // 先暂停，再手动 resume
 
@@ -264,20 +1100,12 @@ bool BtCore::addMagnet(const std::string& magnet,
             return;
         }
 
-        lt::info_hash_t ih = h.info_hashes();
-        lt::sha1_hash v1 = ih.v1;
-        std::string hex = sha1_to_hex(v1);
-
-        {
-            std::lock_guard<std::mutex> guard(m_mutex);
-            m_torrents[hex] = h;
-        }
-        out_infohash_hex = hex;
+        out_infohash_hex = registerTorrent(h, nullptr, in_memory, true);
 
         h.resume();
         ok = true;
         done.set_value();
-    });
+    })) return false;
 
     fut.wait();
     return ok;
@@ -291,7 +1119,7 @@ bool BtCore::addTorrentFile(const std::string& torrent_path,
     std::promise<void> done;
     auto fut = done.get_future();
 
-    postCommand([&](lt::session& ses) {
+    if (!postCommand("add_torrent_file", [&](lt::session& ses) {
         lt::error_code ec;
         auto ti = std::make_shared<lt::torrent_info>(torrent_path, ec);
         if (ec) {
@@ -300,9 +1128,14 @@ bool BtCore::addTorrentFile(const std::string& torrent_path,
             return;
         }
 
+        // 有 resume data 时跳过重新校验；做种的 save_path 以 resume data 为准
         lt::add_torrent_params p;
+        if (!loadResumeData(bt_infohash_hex(ti->info_hashes()), p)) {
+            p = lt::add_torrent_params{};
+            p.storage_mode = m_cfg.storage_mode;
+        }
         p.ti = ti;
-        p.save_path = save_dir;
+        if (p.save_path.empty()) p.save_path = save_dir;
         p.flags |= lt::torrent_flags::auto_managed;
 
         lt::torrent_handle h = ses.add_torrent(p, ec);
@@ -312,151 +1145,409 @@ bool BtCore::addTorrentFile(const std::string& torrent_path,
             return;
         }
 
-        lt::info_hash_t ih = h.info_hashes();
-        lt::sha1_hash v1 = ih.v1;
-        std::string hex = sha1_to_hex(v1);
-
-        {
-            std::lock_guard<std::mutex> guard(m_mutex);
-            m_torrents[hex] = h;
-        }
-        out_infohash_hex = hex;
+        out_infohash_hex = registerTorrent(h);
 
         ok = true;
         done.set_value();
-    });
+    })) return false;
 
     fut.wait();
     return ok;
 }
 
+static std::string parent_dir(const std::string& folder)
+{
+    auto pos = folder.find_last_of("/\\");
+    if (pos == std::string::npos) return ".";
+    if (pos == 0) return "/";
+    return folder.substr(0, pos);
+}
+
+struct BtHashJob {
+    uint64_t    id = 0;
+    std::string folder;
+    std::string torrent_out;
+    BtSeedOptions opts{};
+
+    std::atomic<bool> cancel{false};
+    std::atomic<int>  state{BT_HASH_QUEUED};
+    std::atomic<int>  pieces_done{0};
+    std::atomic<int>  pieces_total{0};
+
+    std::mutex  mutex;          // 保护 infohash_hex / error
+    std::string infohash_hex;
+    std::string error;
+
+    std::promise<void>       done;
+    std::shared_future<void> finished = done.get_future().share();
+
+    std::chrono::steady_clock::time_point last_event;   // 只在哈希线程里用
+
+    void info(BtHashJobInfo& out)
+    {
+        std::memset(&out, 0, sizeof(out));
+        out.job_id       = id;
+        out.state        = (BtHashJobState)state.load();
+        out.pieces_done  = pieces_done.load();
+        out.pieces_total = pieces_total.load();
+        std::lock_guard<std::mutex> guard(mutex);
+        std::snprintf(out.infohash_hex, sizeof(out.infohash_hex), "%s", infohash_hex.c_str());
+        std::snprintf(out.error_msg, sizeof(out.error_msg), "%s", error.c_str());
+    }
+};
+
+static const size_t kMaxFinishedHashJobs = 256;
+
 bool BtCore::seedFolder(const std::string& folder,
                         const std::string& torrent_out,
+                        const BtSeedOptions& opts,
                         std::string& out_infohash_hex)
 {
-    bool ok = false;
-    std::promise<void> done;
-    auto fut = done.get_future();
+    auto job = submitHashJob(folder, torrent_out, opts);
+    if (!job) return false;
 
-    postCommand([&](lt::session& ses) {
-        lt::file_storage fs;
+    job->finished.wait();
+    if (job->state.load() != BT_HASH_DONE) return false;
 
-        lt::add_files(fs, folder);
-        if (fs.num_files() == 0) {
-            iloge("[btd] seedFolder: no files in folder: %s", folder.c_str());
-            done.set_value();
-            return;
-        }
+    std::lock_guard<std::mutex> guard(job->mutex);
+    out_infohash_hex = job->infohash_hex;
+    return true;
+}
 
-        const int piece_size = 0;
-        lt::create_torrent ct(fs, piece_size);
+uint64_t BtCore::seedFolderAsync(const std::string& folder,
+                                 const std::string& torrent_out,
+                                 const BtSeedOptions& opts)
+{
+    auto job = submitHashJob(folder, torrent_out, opts);
+    return job ? job->id : 0;
+}
 
-        std::string parent = folder;
-        {
-            auto pos = parent.find_last_of("/\\");
-            if (pos == std::string::npos) {
-                parent = ".";
-            } else if (pos == 0) {
-                parent = "/";
+std::shared_ptr<BtHashJob> BtCore::submitHashJob(const std::string& folder,
+                                                 const std::string& torrent_out,
+                                                 const BtSeedOptions& opts)
+{
+    if (!m_running) return nullptr;
+
+    int kb = opts.piece_size_kb;
+    if (int(opts.format) < BT_TORRENT_HYBRID || int(opts.format) > BT_TORRENT_V2 || opts.hash_threads < 0 ||
+        kb < 0 || (kb > 0 && (kb < 16 || (kb & (kb - 1)) != 0))) {
+        iloge("[btd] seedFolder: bad options (format=%d piece_size_kb=%d hash_threads=%d)",
+              int(opts.format), kb, opts.hash_threads);
+        return nullptr;
+    }
+
+    auto job = std::make_shared<BtHashJob>();
+    job->folder = folder;
+    job->torrent_out = torrent_out;
+    job->opts = opts;
+
+    {
+        std::lock_guard<std::mutex> guard(m_hashMutex);
+        if (m_hashStop) return nullptr;
+
+        // 已结束的任务只保留最近一批，供 get_hash_job 查询
+        size_t finished = 0;
+        for (auto& kv : m_hashJobs) {
+            if (kv.second->state.load() >= BT_HASH_DONE) ++finished;
+        }
+        for (auto it = m_hashJobs.begin();
+             it != m_hashJobs.end() && finished > kMaxFinishedHashJobs;) {
+            if (it->second->state.load() >= BT_HASH_DONE) {
+                it = m_hashJobs.erase(it);
+                --finished;
             } else {
-                parent = parent.substr(0, pos);
+                ++it;
             }
         }
 
-        lt::error_code ec;
-        lt::set_piece_hashes(ct, parent, ec);
-        if (ec) {
-            iloge("[btd] set_piece_hashes error: %s (parent=%s)", ec.message().c_str(), parent.c_str());
-            done.set_value();
-            return;
-        }
+        job->id = m_nextJobId++;
+        m_hashJobs[job->id] = job;
+        m_hashQueue.push_back(job);
+    }
+    m_hashCv.notify_one();
 
-        lt::entry e = ct.generate();
-        std::vector<char> buf;
-        lt::bencode(std::back_inserter(buf), e);
+    emitHashEvent(job, true);
+    return job;
+}
 
-        std::ofstream out(torrent_out, std::ios::binary);
-        if (!out) {
-            iloge("[btd] cannot open torrent_out: %s", torrent_out.c_str());
-            done.set_value();
-            return;
+bool BtCore::getHashJob(uint64_t job_id, BtHashJobInfo& out)
+{
+    std::shared_ptr<BtHashJob> job;
+    {
+        std::lock_guard<std::mutex> guard(m_hashMutex);
+        auto it = m_hashJobs.find(job_id);
+        if (it == m_hashJobs.end()) return false;
+        job = it->second;
+    }
+    job->info(out);
+    return true;
+}
+
+bool BtCore::cancelHashJob(uint64_t job_id)
+{
+    std::shared_ptr<BtHashJob> job;
+    {
+        std::lock_guard<std::mutex> guard(m_hashMutex);
+        auto it = m_hashJobs.find(job_id);
+        if (it == m_hashJobs.end()) return false;
+        job = it->second;
+        if (job->state.load() >= BT_HASH_DONE) return false;
+
+        job->cancel = true;
+
+        // 还在排队的直接结束，正在算的由哈希线程在下一个 piece 前退出
+        auto qt = std::find(m_hashQueue.begin(), m_hashQueue.end(), job);
+        if (qt == m_hashQueue.end()) return true;
+        m_hashQueue.erase(qt);
+    }
+    finishHashJob(job, BT_HASH_CANCELLED, "", "cancelled");
+    return true;
+}
+
+void BtCore::stopHashPool()
+{
+    std::deque<std::shared_ptr<BtHashJob>> queued;
+    {
+        std::lock_guard<std::mutex> guard(m_hashMutex);
+        m_hashStop = true;
+        queued.swap(m_hashQueue);
+        for (auto& kv : m_hashJobs) kv.second->cancel = true;
+    }
+    m_hashCv.notify_all();
+
+    for (auto& job : queued) {
+        finishHashJob(job, BT_HASH_CANCELLED, "", "shutdown");
+    }
+    for (auto& t : m_hashThreads) {
+        if (t.joinable()) t.join();
+    }
+    m_hashThreads.clear();
+}
+
+void BtCore::hashThreadFunc()
+{
+    for (;;) {
+        std::shared_ptr<BtHashJob> job;
+        {
+            std::unique_lock<std::mutex> lock(m_hashMutex);
+            m_hashCv.wait(lock, [this] { return m_hashStop || !m_hashQueue.empty(); });
+            if (m_hashStop) return;
+            job = m_hashQueue.front();
+            m_hashQueue.pop_front();
         }
-        out.write(buf.data(), buf.size());
-        out.close();
+        runHashJob(job);
+    }
+}
 
-        auto ti = std::make_shared<lt::torrent_info>(torrent_out, ec);
-        if (ec) {
-            iloge("[btd] torrent_info from file error: %s", ec.message().c_str());
-            done.set_value();
-            return;
+void BtCore::finishHashJob(const std::shared_ptr<BtHashJob>& job, BtHashJobState state,
+                           const std::string& hex, const std::string& err)
+{
+    {
+        std::lock_guard<std::mutex> guard(job->mutex);
+        job->infohash_hex = hex;
+        job->error = err;
+    }
+    job->state = state;
+    emitHashEvent(job, true);
+    job->done.set_value();
+}
+
+void BtCore::emitHashEvent(const std::shared_ptr<BtHashJob>& job, bool force)
+{
+    if (!wantEvent(BT_EVENT_HASH_JOB)) return;
+
+    // 进度事件每个任务最多 500ms 一次，状态变化总是发
+    if (!force) {
+        auto now = std::chrono::steady_clock::now();
+        if (now - job->last_event < std::chrono::milliseconds(500)) return;
+        job->last_event = now;
+    }
+
+    BtEvent ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.type = BT_EVENT_HASH_JOB;
+    job->info(ev.job);
+    std::snprintf(ev.infohash_hex, sizeof(ev.infohash_hex), "%s", ev.job.infohash_hex);
+
+    // 这里可能在哈希线程、RPC 线程或调用方线程，快照交给 BT 线程去回调
+    auto snap = std::make_shared<BtEvent>(ev);
+    postCommand("hash_event", [this, snap](lt::session&) { emitEvent(*snap); });
+}
+
+// 在哈希线程里执行：建 torrent、算哈希、写 .torrent，最后交给 BT 线程加入 session
+void BtCore::runHashJob(const std::shared_ptr<BtHashJob>& job)
+{
+    if (job->cancel.load()) {
+        finishHashJob(job, BT_HASH_CANCELLED, "", "cancelled");
+        return;
+    }
+    job->state = BT_HASH_RUNNING;
+    emitHashEvent(job, true);
+
+    const std::string& folder = job->folder;
+    const std::string& torrent_out = job->torrent_out;
+
+    lt::file_storage fs;
+    lt::add_files(fs, folder);
+    if (fs.num_files() == 0) {
+        iloge("[btd] seedFolder: no files in folder: %s", folder.c_str());
+        finishHashJob(job, BT_HASH_FAILED, "", "no files in folder");
+        return;
+    }
+
+    lt::create_flags_t flags{};
+    if (job->opts.format == BT_TORRENT_V1) flags = lt::create_torrent::v1_only;
+    else if (job->opts.format == BT_TORRENT_V2) flags = lt::create_torrent::v2_only;
+    int piece_size = job->opts.piece_size_kb > 0
+        ? job->opts.piece_size_kb * 1024
+        : bt_auto_piece_size(fs, job->opts.format != BT_TORRENT_V1);
+    lt::create_torrent ct(fs, piece_size, flags);
+    job->pieces_total = ct.num_pieces();
+
+    std::string parent = parent_dir(folder);
+    int threads = job->opts.hash_threads > 0 ? job->opts.hash_threads : m_cfg.seed_hash_threads;
+    ilogi("[btd] seedFolder %s: %d files, %d pieces of %d KiB", folder.c_str(),
+          fs.num_files(), ct.num_pieces(), piece_size / 1024);
+
+    std::string err;
+    int reused = 0;
+    bool hashed = bt_hash_pieces(ct, parent, threads, m_hashCache.get(), &reused, &job->cancel, [&](int done) {
+        job->pieces_done.store(done, std::memory_order_relaxed);
+        emitHashEvent(job, false);
+    }, err);
+    if (!hashed) {
+        if (job->cancel.load()) {
+            finishHashJob(job, BT_HASH_CANCELLED, "", "cancelled");
+        } else {
+            iloge("[btd] hash pieces error: %s (parent=%s)", err.c_str(), parent.c_str());
+            finishHashJob(job, BT_HASH_FAILED, "", err);
         }
+        return;
+    }
+    if (m_hashCache) {
+        ilogi("[btd] seedFolder %s: %d of %d pieces from hash cache", folder.c_str(), reused, ct.num_pieces());
+        if (!m_hashCache->save()) iloge("[btd] save hash cache failed: %s", m_cfg.hash_cache_file.c_str());
+    }
 
+    lt::entry e = ct.generate();
+    std::vector<char> buf;
+    lt::bencode(std::back_inserter(buf), e);
+
+    if (!bt_write_file_atomic(torrent_out, buf)) {
+        iloge("[btd] write torrent_out failed: %s", torrent_out.c_str());
+        finishHashJob(job, BT_HASH_FAILED, "", "cannot write torrent_out");
+        return;
+    }
+
+    lt::error_code ec;
+    auto ti = std::make_shared<lt::torrent_info>(torrent_out, ec);
+    if (ec) {
+        iloge("[btd] torrent_info from file error: %s", ec.message().c_str());
+        finishHashJob(job, BT_HASH_FAILED, "", ec.message());
+        return;
+    }
+
+    std::string hex;
+    std::string add_err = "session stopped";
+    std::promise<void> added;
+    auto fut = added.get_future();
+
+    bool posted = postCommand("seed_add", [&](lt::session& ses) {
         lt::add_torrent_params p;
         p.ti = ti;
         p.save_path = parent;
+        p.storage_mode = m_cfg.storage_mode;
         p.flags |= lt::torrent_flags::seed_mode;
 
-        lt::torrent_handle h = ses.add_torrent(p, ec);
-        if (ec) {
-            iloge("[btd] add_torrent(seed) error: %s", ec.message().c_str());
-            done.set_value();
-            return;
+        lt::error_code aec;
+        lt::torrent_handle h = ses.add_torrent(p, aec);
+        if (aec) {
+            iloge("[btd] add_torrent(seed) error: %s", aec.message().c_str());
+            add_err = aec.message();
+        } else {
+            hex = registerTorrent(h);
+            add_err.clear();
         }
+        added.set_value();
+    });
 
-        lt::info_hash_t ih = h.info_hashes();
-        lt::sha1_hash v1 = ih.v1;
-        std::string hex = sha1_to_hex(v1);
+    if (posted) fut.wait();
 
-        {
-            std::lock_guard<std::mutex> guard(m_mutex);
-            m_torrents[hex] = h;
-        }
-        out_infohash_hex = hex;
+    if (hex.empty()) {
+        finishHashJob(job, BT_HASH_FAILED, "", add_err);
+    } else {
+        finishHashJob(job, BT_HASH_DONE, hex, "");
+    }
+}
 
-        ok = true;
+
+bool BtCore::pauseTorrent(const std::string& infohash_hex)
+{
+    BtInfoHash key;
+    if (!BtInfoHash::fromHex(infohash_hex, key)) return false;
+
+    std::promise<void> done;
+    auto fut = done.get_future();
+    bool ok = false;
+
+    if (!postCommand("pause", [&](lt::session&) {
+        TorrentEntry e;
+        if (findTorrent(key, e)) {
+            e.handle.pause();
+            ok = true;
+        }
         done.set_value();
-    });
+    })) return false;
 
     fut.wait();
     return ok;
 }
 
-
-bool BtCore::pauseTorrent(const std::string& infohash_hex)
+bool BtCore::resumeTorrent(const std::string& infohash_hex)
 {
+    BtInfoHash key;
+    if (!BtInfoHash::fromHex(infohash_hex, key)) return false;
+
     std::promise<void> done;
     auto fut = done.get_future();
     bool ok = false;
 
-    postCommand([&](lt::session&) {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        auto it = m_torrents.find(infohash_hex);
-        if (it != m_torrents.end()) {
-            it->second.pause();
+    if (!postCommand("resume", [&](lt::session&) {
+        TorrentEntry e;
+        if (findTorrent(key, e)) {
+            e.handle.resume();
             ok = true;
         }
         done.set_value();
-    });
+    })) return false;
 
     fut.wait();
     return ok;
 }
 
-bool BtCore::resumeTorrent(const std::string& infohash_hex)
+bool BtCore::connectPeer(const std::string& infohash_hex, const std::string& ip, int port)
 {
+    BtInfoHash key;
+    if (!BtInfoHash::fromHex(infohash_hex, key)) return false;
+    if (port <= 0 || port > 65535) return false;
+
+    lt::error_code ec;
+    lt::address addr = lt::make_address(ip, ec);
+    if (ec) return false;
+    lt::tcp::endpoint ep(addr, static_cast<unsigned short>(port));
+
     std::promise<void> done;
     auto fut = done.get_future();
     bool ok = false;
 
-    postCommand([&](lt::session&) {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        auto it = m_torrents.find(infohash_hex);
-        if (it != m_torrents.end()) {
-            it->second.resume();
+    if (!postCommand("connect_peer", [&](lt::session&) {
+        TorrentEntry e;
+        if (findTorrent(key, e)) {
+            e.handle.connect_peer(ep);
             ok = true;
         }
         done.set_value();
-    });
+    })) return false;
 
     fut.wait();
     return ok;
@@ -464,74 +1555,651 @@ bool BtCore::resumeTorrent(const std::string& infohash_hex)
 
 bool BtCore::removeTorrent(const std::string& infohash_hex, bool remove_files)
 {
+    BtInfoHash key;
+    if (!BtInfoHash::fromHex(infohash_hex, key)) return false;
+
     std::promise<void> done;
     auto fut = done.get_future();
     bool ok = false;
 
-    postCommand([&](lt::session& ses) {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        auto it = m_torrents.find(infohash_hex);
-        if (it != m_torrents.end()) {
-            lt::remove_flags_t flags{};
-            if (remove_files) {
-                flags = lt::session::delete_files;
-            }
-            ses.remove_torrent(it->second, flags);
-            m_torrents.erase(it);
-            ok = true;
+    if (!postCommand("remove", [&](lt::session&) {
+        lt::remove_flags_t flags{};
+        if (remove_files) {
+            flags = lt::session::delete_files;
         }
+        ok = dropTorrent(key, flags);
         done.set_value();
-    });
+    })) return false;
 
     fut.wait();
     return ok;
 }
 
+bool BtCore::dropTorrent(const BtInfoHash& key, lt::remove_flags_t flags)
+{
+    TorrentEntry e;
+    {
+        std::lock_guard<std::shared_mutex> guard(m_torrentsMutex);
+        const TorrentEntry* found = m_torrents.find(key);
+        if (!found) return false;
+        e = *found;
+        m_torrents.erase(e.id);
+        if (!e.alias.empty()) m_torrents.erase(e.alias);
+    }
+
+    // 内存里的数据总是删掉，delete_files 让存储立即释放
+    if (e.in_memory) {
+        flags |= lt::session::delete_files;
+        m_memTorrents.erase(e.id);
+    }
+    m_session->remove_torrent(e.handle, flags);
+    m_statusTable.erase(e.id);
+    m_shmStatus.erase(e.id);
+    m_progressDirty.erase(e.id);
+    failRangeReads(e.id);
+    if (!m_resumeDir.empty()) {
+        std::remove(resumePath(e.id.toHex()).c_str());
+    }
+    return true;
+}
+
+void BtCore::touchMemTorrent(const BtInfoHash& id, bool finished)
+{
+    MemEntry* me = m_memTorrents.find(id);
+    if (!me) {
+        // 只有 registerTorrent 登记内存 torrent 时会新建
+        if (finished) return;
+        me = &m_memTorrents.insert(id, MemEntry{});
+    }
+    me->lastUse = std::chrono::steady_clock::now();
+    if (finished && !me->finished) {
+        TorrentEntry e;
+        if (!findTorrent(id, e)) return;
+        auto ti = e.handle.torrent_file();
+        me->finished = true;
+        me->size = ti ? ti->total_size() : 0;
+    }
+}
+
+// 淘汰的 torrent 带 delete_files 移除，收到这个 alert 时内存已经释放
+void BtCore::onMemTorrentDeleted(const lt::info_hash_t& ih)
+{
+    if (m_memEvicting.empty()) return;
+    BtInfoHash keys[2] = { bt_primary_key(ih), bt_alias_key(ih) };
+    for (auto& k : keys) {
+        const int64_t* size = k.empty() ? nullptr : m_memEvicting.find(k);
+        if (!size) continue;
+        m_memReleasing -= *size;
+        m_memEvicting.erase(k);
+        return;
+    }
+}
+
+// 内存存储超过上限的 7/8 时，按最近使用时间淘汰已完成的 torrent，降到 3/4 为止。
+// 淘汰后到网络线程真正释放之间用量还没降，按预估大小扣掉，避免多删
+void BtCore::evictMemTorrents()
+{
+    int64_t used = m_memUsage->used.load(std::memory_order_relaxed) - m_memReleasing;
+    if (used <= m_memUsage->cap / 8 * 7) return;
+    int64_t target = m_memUsage->cap / 4 * 3;
+
+    while (used > target) {
+        BtInfoHash victim;
+        const MemEntry* oldest = nullptr;
+        m_memTorrents.forEach([&](const BtInfoHash& id, MemEntry& me) {
+            if (me.finished && (!oldest || me.lastUse < oldest->lastUse)) {
+                oldest = &me;
+                victim = id;
+            }
+        });
+        if (!oldest) break;     // 剩下的都还在下载，写满时新 piece 会写失败
+
+        int64_t size = oldest->size;
+        ilogi("[btd] mem storage: evict %s (%lld bytes)", victim.toHex().c_str(), (long long)size);
+        if (!dropTorrent(victim, lt::remove_flags_t{})) {
+            m_memTorrents.erase(victim);
+            continue;
+        }
+        m_memEvicting.insert(victim, size);
+        m_memReleasing += size;
+        used -= size;
+    }
+}
+
+// 两个查询都直接读状态快照，不经过 BT 线程；快照最多落后 status_interval_ms
 bool BtCore::getStatus(const std::string& infohash_hex, BtTorrentStatus& out_status)
 {
+    BtInfoHash key;
+    if (!m_running || !BtInfoHash::fromHex(infohash_hex, key)) return false;
+    return m_statusTable.get(key, out_status);
+}
+
+bool BtCore::getStatusBatch(const std::vector<std::string>& infohashes,
+                            std::vector<std::pair<std::string, BtTorrentStatus>>& out,
+                            std::vector<std::string>& missing)
+{
+    if (!m_running) return false;
+
+    if (infohashes.empty()) {
+        std::vector<std::pair<BtInfoHash, BtTorrentStatus>> all;
+        m_statusTable.getAll(all);
+        out.reserve(all.size());
+        for (auto& kv : all) out.emplace_back(kv.first.toHex(), kv.second);
+        return true;
+    }
+
+    out.reserve(infohashes.size());
+    BtTorrentStatus st;
+    BtInfoHash key;
+    for (auto& hex : infohashes) {
+        if (BtInfoHash::fromHex(hex, key) && m_statusTable.get(key, st)) {
+            out.emplace_back(hex, st);
+        } else {
+            missing.push_back(hex);
+        }
+    }
+    return true;
+}
+
+/*
+ * 批量添加
+ *
+ * 调用线程起一组解析线程并行读 .torrent 和 resume 文件，解析好的参数放进
+ * job->ready，每攒够一批就 post 一个 pump 命令。pump 在 BT 线程里用
+ * async_add_torrent 提交，同时在途的数量限制在 kAddWindow 以内，避免
+ * add_torrent_alert 把 alert 队列撑爆。job->remaining 归零时唤醒调用方。
+ */
+static const int    kAddWindow = 256;
+static const size_t kAddBatch  = 64;
+
+struct BtCore::AddJob {
+    std::mutex mutex;
+    std::deque<std::pair<size_t, lt::add_torrent_params>> ready;   // 已解析待提交
+    bool parse_done = false;
+
+    std::vector<BtAddResult> results;
+    std::atomic<size_t> remaining{0};
     std::promise<void> done;
-    auto fut = done.get_future();
-    bool ok = false;
 
-    postCommand([&](lt::session&) {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        auto it = m_torrents.find(infohash_hex);
-        if (it == m_torrents.end()) {
-            done.set_value();
+    void finish(size_t idx, bool ok, const std::string& hex, const std::string& err)
+    {
+        results[idx].ok = ok;
+        results[idx].infohash_hex = hex;
+        results[idx].error = err;
+        if (remaining.fetch_sub(1) == 1) done.set_value();
+    }
+};
+
+bool BtCore::addTorrentFiles(const std::vector<std::string>& paths,
+                             const std::string& save_dir,
+                             std::vector<BtAddResult>& results)
+{
+    results.clear();
+    if (!m_running) return false;
+    if (paths.empty()) return true;
+
+    // resume 目录只在 BT 线程里改，走一次命令拿到当前值
+    std::string resume_dir;
+    {
+        std::promise<void> got;
+        auto fut = got.get_future();
+        if (!postCommand("get_resume_dir", [&](lt::session&) {
+            resume_dir = m_resumeDir;
+            got.set_value();
+        })) return false;
+        fut.wait();
+    }
+
+    auto job = std::make_shared<AddJob>();
+    job->results.resize(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) job->results[i].path = paths[i];
+    job->remaining = paths.size();
+    auto fut = job->done.get_future();
+
+    auto pump = [this, job]() {
+        bool posted = postCommand("add_torrent_files", [this, job](lt::session&) {
+            if (std::find(m_addJobs.begin(), m_addJobs.end(), job) == m_addJobs.end())
+                m_addJobs.push_back(job);
+            pumpAdds();
+        });
+        if (posted) return;
+
+        // 已经在停止，BT 线程不会再来取 ready，自己结束掉；
+        // 之前投递成功的那些由 failPendingAdds 结束，两边都在 job->mutex 下取走，不会重复
+        std::lock_guard<std::mutex> guard(job->mutex);
+        for (auto& item : job->ready) {
+            job->finish(item.first, false, "", "shutdown");
+        }
+        job->ready.clear();
+    };
+
+    std::atomic<size_t> next{0};
+    auto parse = [&]() {
+        for (;;) {
+            size_t i = next.fetch_add(1);
+            if (i >= paths.size()) break;
+
+            lt::error_code ec;
+            auto ti = std::make_shared<lt::torrent_info>(paths[i], ec);
+            if (ec) {
+                iloge("[btd] load torrent file error: %s (%s)", ec.message().c_str(), paths[i].c_str());
+                job->finish(i, false, "", ec.message());
+                continue;
+            }
+
+            lt::add_torrent_params p;
+            if (!load_resume_file(resume_dir, bt_infohash_hex(ti->info_hashes()), p)) {
+                p = lt::add_torrent_params{};
+                p.storage_mode = m_cfg.storage_mode;
+            }
+            p.ti = ti;
+            if (p.save_path.empty()) p.save_path = save_dir;
+            p.flags |= lt::torrent_flags::auto_managed;
+
+            bool flush = false;
+            {
+                std::lock_guard<std::mutex> guard(job->mutex);
+                job->ready.emplace_back(i, std::move(p));
+                flush = job->ready.size() >= kAddBatch;
+            }
+            if (flush) pump();
+        }
+    };
+
+    unsigned nthreads = std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+    nthreads = (unsigned)std::min<size_t>(nthreads, paths.size());
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < nthreads; ++t) workers.emplace_back(parse);
+    parse();
+    for (auto& w : workers) w.join();
+
+    {
+        std::lock_guard<std::mutex> guard(job->mutex);
+        job->parse_done = true;
+    }
+    pump();
+
+    fut.wait();
+    results = std::move(job->results);
+    return true;
+}
+
+void BtCore::pumpAdds()
+{
+    for (auto jt = m_addJobs.begin(); jt != m_addJobs.end();) {
+        auto job = *jt;
+        bool drained = false;
+
+        while (m_addInflight < kAddWindow) {
+            std::pair<size_t, lt::add_torrent_params> item;
+            {
+                std::lock_guard<std::mutex> guard(job->mutex);
+                if (job->ready.empty()) {
+                    drained = job->parse_done;
+                    break;
+                }
+                item = std::move(job->ready.front());
+                job->ready.pop_front();
+            }
+
+            BtInfoHash key = bt_primary_key(item.second.ti->info_hashes());
+            if (m_pendingAdds.contains(key)) {
+                job->finish(item.first, false, key.toHex(), "duplicate torrent");
+                continue;
+            }
+            m_pendingAdds.insert(key, {job, item.first});
+            ++m_addInflight;
+            m_session->async_add_torrent(std::move(item.second));
+        }
+
+        if (drained) jt = m_addJobs.erase(jt);
+        else ++jt;
+
+        if (m_addInflight >= kAddWindow) break;
+    }
+}
+
+void BtCore::onTorrentAdded(lt::add_torrent_alert* a)
+{
+    BtInfoHash key = bt_primary_key(a->params.ti ? a->params.ti->info_hashes()
+                                                 : a->params.info_hashes);
+    std::string hex = key.toHex();
+
+    // 同步 add_torrent 也会产生 add_torrent_alert，不是批量提交的直接忽略
+    auto* pending = m_pendingAdds.find(key);
+    if (!pending) return;
+
+    auto job = pending->first;
+    size_t idx = pending->second;
+    m_pendingAdds.erase(key);
+    --m_addInflight;
+
+    if (a->error) {
+        iloge("[btd] async_add_torrent error: %s (%s)", a->error.message().c_str(), hex.c_str());
+        job->finish(idx, false, hex, a->error.message());
+    } else {
+        job->finish(idx, true, registerTorrent(a->handle, &a->params), "");
+        m_statusDirty = true;   // 下一轮就拉真实状态
+    }
+
+    pumpAdds();
+}
+
+void BtCore::failPendingAdds(const char* reason)
+{
+    m_pendingAdds.forEach([&](const BtInfoHash& key, std::pair<std::shared_ptr<AddJob>, size_t>& v) {
+        v.first->finish(v.second, false, key.toHex(), reason);
+    });
+    m_pendingAdds.clear();
+    m_addInflight = 0;
+
+    for (auto& job : m_addJobs) {
+        std::lock_guard<std::mutex> guard(job->mutex);
+        for (auto& item : job->ready) {
+            job->finish(item.first, false, "", reason);
+        }
+        job->ready.clear();
+    }
+    m_addJobs.clear();
+}
+
+/* ---------- 边下边读 ---------- */
+
+static const int64_t kMaxRangeRead   = 16 * 1024 * 1024;   // read_range / wait_range 单次上限
+static const int     kDeadlineStepMs = 50;     // 请求段内相邻 piece 的 deadline 间隔
+static const int     kReadAheadMs    = 2000;   // 预读段从这个 deadline 开始
+
+struct BtRangeRead {
+    BtInfoHash id;
+    int        file_index = 0;
+    int64_t    offset = 0;
+    int64_t    length = 0;          // arm 时截到文件尾
+    bool       copy = false;        // true: read_piece 取数据；false: 只等 piece 下载完成
+
+    // 以下只在 BT 线程里访问
+    bool       armed = false;       // 有 metadata 之后才能换算 piece
+    bool       finished = false;
+    int64_t    begin = 0;           // torrent 线性空间里的 [begin, end)
+    int64_t    end = 0;
+    int64_t    pieceLength = 0;
+    int        firstPiece = 0;
+    int        lastDeadline = -1;   // 设过 deadline 的最后一个 piece，含预读
+    std::vector<uint8_t> pending;   // 下标 piece - firstPiece，1 表示还在等
+    int        remaining = 0;
+
+    std::vector<char> data;         // copy 模式的结果
+    BtFileRange       file{};
+    std::promise<int> done;
+
+    void finish(int rc)
+    {
+        if (finished) return;
+        finished = true;
+        done.set_value(rc);
+    }
+};
+
+int BtCore::readRange(const std::string& infohash_hex, int file_index, int64_t offset, int64_t length,
+                      int timeout_ms, std::vector<char>& out)
+{
+    auto rr = std::make_shared<BtRangeRead>();
+    if (!BtInfoHash::fromHex(infohash_hex, rr->id) || file_index < 0 || offset < 0 || length < 0)
+        return -1;
+    rr->file_index = file_index;
+    rr->offset = offset;
+    rr->length = std::min(length, kMaxRangeRead);
+    rr->copy = true;
+
+    int rc = rangeRequest(rr, timeout_ms);
+    if (rc == 0) out.swap(rr->data);
+    return rc;
+}
+
+int BtCore::waitRange(const std::string& infohash_hex, int file_index, int64_t offset, int64_t length,
+                      int timeout_ms, BtFileRange& out)
+{
+    auto rr = std::make_shared<BtRangeRead>();
+    if (!BtInfoHash::fromHex(infohash_hex, rr->id) || file_index < 0 || offset < 0 || length < 0)
+        return -1;
+    rr->file_index = file_index;
+    rr->offset = offset;
+    rr->length = std::min(length, kMaxRangeRead);
+
+    int rc = rangeRequest(rr, timeout_ms);
+    if (rc == 0) out = rr->file;
+    return rc;
+}
+
+// 调用方线程：投递到 BT 线程后等结果；超时的请求再投一条命令撤掉
+int BtCore::rangeRequest(const std::shared_ptr<BtRangeRead>& rr, int timeout_ms)
+{
+    if (!m_running) return -1;
+    if (timeout_ms <= 0) timeout_ms = 30000;
+    auto fut = rr->done.get_future();
+
+    bool posted = postCommand(rr->copy ? "read_range" : "wait_range", [this, rr](lt::session&) {
+        TorrentEntry e;
+        if (!findTorrent(rr->id, e)) {
+            rr->finish(-1);
+            return;
+        }
+        rr->id = e.id;
+        if (e.in_memory) touchMemTorrent(e.id, false);
+        // 先打开 piece_finished_alert 再查已有 piece：两者在网络线程里按顺序执行，不会漏掉
+        if (!rr->copy) setPieceAlerts(true);
+        if (e.handle.torrent_file()) armRangeRead(rr, e.handle);
+        if (rr->finished) {
+            syncPieceAlerts();
             return;
         }
-        lt::torrent_status st = it->second.status();
-
-        out_status.progress         = st.progress;
-        out_status.download_rate    = st.download_rate;
-        out_status.upload_rate      = st.upload_rate;
-        out_status.total_downloaded = (long)st.total_download;
-        out_status.total_uploaded   = (long)st.total_upload;
-        out_status.num_peers        = st.num_peers;
-        out_status.num_seeds        = st.num_seeds;
-        out_status.num_leechers     = st.num_complete + st.num_incomplete;
-        out_status.has_metadata     = st.has_metadata ? 1 : 0;
-        out_status.is_seeding       = st.is_seeding ? 1 : 0;
-        out_status.error_code       = st.errc.value();
-        std::snprintf(out_status.error_msg, sizeof(out_status.error_msg),
-                      "%s", st.errc ? st.errc.message().c_str() : "");
-
-        if (st.is_seeding) {
-            out_status.state = BT_STATE_SEEDING;
-        } else if (st.paused) {
-            out_status.state = BT_STATE_PAUSED;
-        } else if (st.errc) {
-            out_status.state = BT_STATE_ERROR;
-        } else if (st.progress >= 0.9999f) {
-            out_status.state = BT_STATE_FINISHED;
+
+        auto* list = m_rangeReads.find(rr->id);
+        if (!list) list = &m_rangeReads.insert(rr->id, {});
+        list->push_back(rr);
+    });
+    if (!posted) return -1;
+
+    if (fut.wait_for(std::chrono::milliseconds(timeout_ms)) == std::future_status::ready) {
+        return fut.get();
+    }
+    postCommand("range_cancel", [this, rr](lt::session&) { cancelRangeRead(rr); });
+    return BT_ERR_TIMEOUT;
+}
+
+void BtCore::armRangeRead(const std::shared_ptr<BtRangeRead>& rr, const lt::torrent_handle& h)
+{
+    auto ti = h.torrent_file();
+    if (!ti) return;
+    const lt::file_storage& fs = ti->files();
+    if (rr->file_index >= fs.num_files()) {
+        rr->finish(-1);
+        return;
+    }
+
+    lt::file_index_t fi(rr->file_index);
+    int64_t fsize = fs.file_size(fi);
+    if (rr->offset > fsize) {
+        rr->finish(-1);
+        return;
+    }
+    rr->length = std::min(rr->length, fsize - rr->offset);
+    rr->armed = true;
+
+    // 同步查询，一次把 save_path 和（wait 模式要的）已有 piece 都取回来，不按 piece 逐个问
+    lt::status_flags_t query = lt::torrent_handle::query_save_path;
+    if (!rr->copy) query |= lt::torrent_handle::query_pieces;
+    lt::torrent_status st = h.status(query);
+
+    // 内存存储没有文件可读，path 留空
+    const std::string& save_path = st.save_path;
+    if (save_path == kBtMemSavePath) rr->file.path[0] = '\0';
+    else std::snprintf(rr->file.path, sizeof(rr->file.path), "%s", fs.file_path(fi, save_path).c_str());
+    rr->file.file_size = fsize;
+    rr->file.offset = rr->offset;
+    rr->file.length = rr->length;
+    if (rr->length == 0) {
+        rr->finish(0);
+        return;
+    }
+
+    // 没选中的文件也要能读：至少恢复成默认优先级，数据才会写进文件而不是 part file
+    if (h.file_priority(fi) == lt::dont_download) h.file_priority(fi, lt::default_priority);
+
+    rr->begin = fs.file_offset(fi) + rr->offset;
+    rr->end = rr->begin + rr->length;
+    rr->pieceLength = fs.piece_length();
+    rr->firstPiece = int(rr->begin / rr->pieceLength);
+    int lastPiece = int((rr->end - 1) / rr->pieceLength);
+    rr->remaining = lastPiece - rr->firstPiece + 1;
+    rr->pending.assign(size_t(rr->remaining), 1);
+    if (rr->copy) rr->data.resize(size_t(rr->length));
+
+    for (int p = rr->firstPiece; p <= lastPiece; ++p) {
+        lt::piece_index_t pi(p);
+        int deadline = (p - rr->firstPiece) * kDeadlineStepMs;
+        if (rr->copy) {
+            // 已经有的 piece 会立刻读盘，没有的下载完成后再发 read_piece_alert
+            h.set_piece_deadline(pi, deadline, lt::torrent_handle::alert_when_available);
+        } else if (st.is_seeding || (p < st.pieces.size() && st.pieces.get_bit(pi))) {
+            rr->pending[size_t(p - rr->firstPiece)] = 0;
+            --rr->remaining;
         } else {
-            out_status.state = BT_STATE_DOWNLOADING;
+            h.set_piece_deadline(pi, deadline);
         }
+    }
 
-        ok = true;
-        done.set_value();
+    // 预读：已有的 piece 上设 deadline 不会有任何动作
+    int ahead = int(int64_t(std::max(0, m_cfg.stream_read_ahead_kb)) * 1024 / rr->pieceLength);
+    int lastAhead = std::min(lastPiece + ahead, fs.num_pieces() - 1);
+    for (int p = lastPiece + 1; p <= lastAhead; ++p) {
+        h.set_piece_deadline(lt::piece_index_t(p), kReadAheadMs + (p - lastPiece) * kDeadlineStepMs);
+    }
+    rr->lastDeadline = std::max(lastPiece, lastAhead);
+
+    if (rr->remaining == 0) rr->finish(0);
+}
+
+// 磁力链接拿到 metadata 后换算之前挂起的请求
+void BtCore::armRangeReads(const BtInfoHash& id, const lt::torrent_handle& h)
+{
+    auto* list = m_rangeReads.find(id);
+    if (!list) return;
+    for (auto& rr : *list) {
+        if (!rr->armed && !rr->finished) armRangeRead(rr, h);
+    }
+    list->erase(std::remove_if(list->begin(), list->end(),
+                               [](const std::shared_ptr<BtRangeRead>& rr) { return rr->finished; }),
+                list->end());
+    if (list->empty()) m_rangeReads.erase(id);
+    syncPieceAlerts();
+}
+
+// read_piece_alert（有 data 或 failed）只给 copy 模式，piece_finished_alert（data 为空）只给 wait 模式
+void BtCore::onRangePiece(const BtInfoHash& id, int piece, const char* data, int size, bool failed)
+{
+    auto* list = m_rangeReads.find(id);
+    if (!list) return;
+
+    std::vector<std::shared_ptr<BtRangeRead>> failedReads;
+    for (auto& rr : *list) {
+        if (!rr->armed || rr->finished) continue;
+        if (rr->copy != (data != nullptr || failed)) continue;
+        int idx = piece - rr->firstPiece;
+        if (idx < 0 || idx >= int(rr->pending.size()) || !rr->pending[size_t(idx)]) continue;
+        if (failed) {
+            rr->finish(-1);
+            failedReads.push_back(rr);
+            continue;
+        }
+
+        if (rr->copy) {
+            int64_t pieceBegin = int64_t(piece) * rr->pieceLength;
+            int64_t from = std::max(pieceBegin, rr->begin);
+            int64_t to = std::min(pieceBegin + size, rr->end);
+            if (to > from) {
+                std::memcpy(rr->data.data() + (from - rr->begin), data + (from - pieceBegin), size_t(to - from));
+            }
+        }
+        rr->pending[size_t(idx)] = 0;
+        if (--rr->remaining == 0) rr->finish(0);
+    }
+
+    list->erase(std::remove_if(list->begin(), list->end(),
+                               [](const std::shared_ptr<BtRangeRead>& rr) { return rr->finished; }),
+                list->end());
+    if (list->empty()) m_rangeReads.erase(id);
+    for (auto& rr : failedReads) resetRangeDeadlines(*rr);
+    syncPieceAlerts();
+}
+
+// 超时的请求：调用方已经不等了，撤掉它设的 deadline，否则这些 piece 一直按紧急处理
+void BtCore::cancelRangeRead(const std::shared_ptr<BtRangeRead>& rr)
+{
+    auto* list = m_rangeReads.find(rr->id);
+    if (!list || rr->finished) return;
+    list->erase(std::remove(list->begin(), list->end(), rr), list->end());
+    if (list->empty()) m_rangeReads.erase(rr->id);
+    rr->finish(BT_ERR_TIMEOUT);
+    resetRangeDeadlines(*rr);
+    syncPieceAlerts();
+}
+
+// 完成的请求保留预读的 deadline；没完成就结束的撤掉，还被其它等待中请求覆盖的 piece 除外
+void BtCore::resetRangeDeadlines(const BtRangeRead& rr)
+{
+    if (!rr.armed || rr.lastDeadline < rr.firstPiece) return;
+    TorrentEntry e;
+    if (!findTorrent(rr.id, e)) return;
+
+    const auto* others = m_rangeReads.find(rr.id);
+    for (int p = rr.firstPiece; p <= rr.lastDeadline; ++p) {
+        bool shared = false;
+        if (others) {
+            for (auto& o : *others) {
+                if (o->armed && !o->finished && p >= o->firstPiece && p <= o->lastDeadline) {
+                    shared = true;
+                    break;
+                }
+            }
+        }
+        if (!shared) e.handle.reset_piece_deadline(lt::piece_index_t(p));
+    }
+}
+
+// 只有 wait 模式靠 piece_finished_alert，没有这种请求时关掉，省掉每个 piece 一条 alert
+void BtCore::syncPieceAlerts()
+{
+    bool want = false;
+    m_rangeReads.forEach([&](const BtInfoHash&, std::vector<std::shared_ptr<BtRangeRead>>& list) {
+        for (auto& rr : list) want = want || !rr->copy;
     });
+    setPieceAlerts(want);
+}
 
-    fut.wait();
-    return ok;
+void BtCore::setPieceAlerts(bool on)
+{
+    if (on == m_pieceAlerts || !m_session) return;
+    m_pieceAlerts = on;
+    lt::settings_pack pack;
+    pack.set_int(lt::settings_pack::alert_mask,
+                 on ? kBaseAlerts | lt::alert::piece_progress_notification : kBaseAlerts);
+    m_session->apply_settings(std::move(pack));
+}
+
+// torrent 删除时让等待者立刻返回；id 为空表示全部（退出时）
+void BtCore::failRangeReads(const BtInfoHash& id)
+{
+    if (id.empty()) {
+        m_rangeReads.forEach([](const BtInfoHash&, std::vector<std::shared_ptr<BtRangeRead>>& list) {
+            for (auto& rr : list) rr->finish(-1);
+        });
+        m_rangeReads.clear();
+        return;
+    }
+    auto* list = m_rangeReads.find(id);
+    if (!list) return;
+    for (auto& rr : *list) rr->finish(-1);
+    m_rangeReads.erase(id);
+    syncPieceAlerts();
 }
@@ -8,7 +8,15 @@
 #include <unordered_map>
 #include <mutex>
 #include <condition_variable>
+#include <shared_mutex>
 #include <queue>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <vector>
+#include <future>
+#include <chrono>
+#include <functional>
 
 #include "../third_party/libtorrent/include/libtorrent/session.hpp"
 #include "../third_party/libtorrent/include/libtorrent/session_params.hpp"
@@ -21,8 +29,24 @@
 #include "../third_party/libtorrent/include/libtorrent/torrent_flags.hpp"
 #include "../third_party/libtorrent/include/libtorrent/session.hpp"
 #include "../third_party/libtorrent/include/libtorrent/bencode.hpp"
+#include "../third_party/libtorrent/include/libtorrent/session_stats.hpp"
+#include "../third_party/libtorrent/include/libtorrent/alert_types.hpp"
 
-struct BtTorrentStatus; // from C header
+#include "bt_api.h"
+#include "bt_cmd_queue.hpp"
+#include "bt_perf.h"
+#include "bt_status_table.hpp"
+#include "bt_shm_status.hpp"
+#include "bt_infohash.hpp"
+#include "bt_mem_storage.hpp"
+#include "bt_hash_cache.hpp"
+
+// 配置里 lt.<名字> = 值 的一项，loadConfig 时已按类型校验
+struct BtLtSetting {
+    int         name = 0;       // lt::settings_pack 的下标，含类型位
+    std::string str;            // 字符串类型
+    int         num = 0;        // 整数 / 布尔类型
+};
 
 struct BtConfig {
     bool enable_bt      = true;
@@ -32,6 +56,38 @@ struct BtConfig {
     int  upload_limit   = 0;    // bytes/s, 0 = unlimited
     int  download_limit = 0;    // bytes/s, 0 = unlimited
     std::vector<std::string> dht_routers;
+    // 为空时由 resume_all_torrents 设为 <torrents_dir>/resume；
+    // 两者都没有时不保存 resume data，重启后要重新校验
+    std::string resume_dir;
+    int  resume_save_interval = 60;      // 秒，定期保存 resume data
+    int  hash_threads   = 2;             // 同时进行的 seed_folder 任务数
+    int  seed_hash_threads = 0;          // 单个 seed_folder 任务读盘和哈希的线程数，0 为所有核
+    std::string hash_cache_file;         // 非空时 seed_folder 按文件缓存哈希，没变的文件不再重读，见 bt_hash_cache.hpp
+    int  status_interval_ms = 500;       // 状态快照刷新周期
+    std::string shm_status_path;         // 非空时把状态快照发布到这个共享内存文件，见 bt_shm.h
+    int  shm_max_torrents = 4096;        // 共享内存里的槽位数
+    int  stats_interval = 5;             // 秒，定期 post_session_stats，0 关闭
+    std::string metrics_file;            // 非空时每次采样后写一份 Prometheus 文本格式
+    std::string disk_io = "default";     // 磁盘后端，见 bt_disk_io.hpp
+    int  file_pool_size = 0;             // 同时打开的文件数，0 为 libtorrent 默认
+    libtorrent::storage_mode_t storage_mode = libtorrent::storage_mode_sparse;   // sparse / allocate，只影响新加的 torrent
+    int  mem_storage_mb = 256;           // 内存存储（add_magnet in_memory）总上限，0 关闭
+    int  stream_read_ahead_kb = 8192;    // read_range 请求段之后再预读多少，按 piece 设 deadline
+    bool allow_multiple_connections_per_ip = false;  // 同一 IP 多个 peer，本机多实例测试时打开
+    // settings_pack 的叠加顺序：preset（按出现顺序）< 上面的专用配置 < lt.* 显式配置
+    std::vector<std::string> presets;    // preset = high_performance_seed / low_memory，可写多行
+    std::vector<BtLtSetting> lt_settings;
+};
+
+struct BtHashJob; // bt_core.cpp
+struct BtRangeRead; // bt_core.cpp
+
+// 批量添加时每个文件的结果
+struct BtAddResult {
+    std::string path;
+    std::string infohash_hex;
+    bool        ok = false;
+    std::string error;
 };
 
 class BtCore {
@@ -42,42 +98,231 @@ public:
     bool init(const std::string& config_path);
     void shutdown();
 
+    // in_memory 时数据只放在内存里（见 bt_mem_storage.hpp），忽略 save_dir
     bool addMagnet(const std::string& magnet,
                    const std::string& save_dir,
+                   bool in_memory,
                    std::string& out_infohash_hex);
 
     bool addTorrentFile(const std::string& torrent_path,
                         const std::string& save_dir,
                         std::string& out_infohash_hex);
 
+    // 批量添加 .torrent：解析在线程池里并行，提交用 async_add_torrent，
+    // 结果从 add_torrent_alert 收集。results 与 paths 一一对应
+    bool addTorrentFiles(const std::vector<std::string>& paths,
+                         const std::string& save_dir,
+                         std::vector<BtAddResult>& results);
+
     bool seedFolder(const std::string& folder,
                     const std::string& torrent_out,
+                    const BtSeedOptions& opts,
                     std::string& out_infohash_hex);
 
+    // 后台做种：返回 job id，0 表示失败
+    uint64_t seedFolderAsync(const std::string& folder,
+                             const std::string& torrent_out,
+                             const BtSeedOptions& opts);
+    bool getHashJob(uint64_t job_id, BtHashJobInfo& out);
+    bool cancelHashJob(uint64_t job_id);
+
     bool pauseTorrent(const std::string& infohash_hex);
     bool resumeTorrent(const std::string& infohash_hex);
     bool removeTorrent(const std::string& infohash_hex, bool remove_files);
 
+    // 主动连接一个 peer（没有 DHT / tracker 时手动组网）
+    bool connectPeer(const std::string& infohash_hex, const std::string& ip, int port);
+
+    // 边下边读，见 bt_read_range / bt_wait_range；返回 0、BT_ERR_TIMEOUT 或 -1
+    int readRange(const std::string& infohash_hex, int file_index, int64_t offset, int64_t length,
+                  int timeout_ms, std::vector<char>& out);
+    int waitRange(const std::string& infohash_hex, int file_index, int64_t offset, int64_t length,
+                  int timeout_ms, BtFileRange& out);
+
+    // 状态查询直接读 state_update_alert 维护的快照，不经过 BT 线程，
+    // 可以在任意线程并发调用；快照最多落后 status_interval_ms。
     bool getStatus(const std::string& infohash_hex, BtTorrentStatus& out_status);
 
+    // 批量查询：infohashes 为空表示全部。
+    bool getStatusBatch(const std::vector<std::string>& infohashes,
+                        std::vector<std::pair<std::string, BtTorrentStatus>>& out,
+                        std::vector<std::string>& missing);
+
+    // 最近一次 session_stats_alert 的计数器（加上 daemon 自己的几项），任意线程；
+    // timestamp_ms 为采样时间，还没有采样时返回 false
+    bool getMetrics(std::vector<BtMetric>& out, uint64_t& timestamp_ms);
+
+    // 配置里没有 resume_dir 时由调用方指定，已设置则忽略。
+    // 在此之前保存 resume data 是关闭的，定期保存和退出前落盘都会跳过
+    void setResumeDir(const std::string& dir);
+
+    // 事件推送，cb 在 BT 线程里调用
+    void setEventCallback(std::function<void(const BtEvent&)> cb,
+                          unsigned mask,
+                          int progress_interval_ms);
+
 private:
     void threadFunc();
-    void postCommand(const std::function<void(libtorrent::session&)>& cmd);
+    // 命令闭包就地存放，超过 kCmdInlineSize 字节编译期报错
+    static constexpr size_t kCmdInlineSize = 96;
+    static constexpr size_t kCmdQueueSize  = 4096;
+    using BtCommand = BtInplaceCommand<libtorrent::session, kCmdInlineSize>;
+
+    // 队列里的一条命令，带上名字和投递时间做延迟统计（bt_perf.h）
+    struct BtQueuedCommand {
+        BtCommand     fn;
+        BtPerfMethod* perf = nullptr;
+        uint64_t      postNs = 0;
+    };
+
+    // name 必须是字符串常量，按名字统计排队和执行耗时
+    // BT 线程已经停止或正在停止时返回 false，命令不会执行，调用方不要再等它
+    bool postCommand(const char* name, BtCommand cmd);
+    void runCommand(BtQueuedCommand& cmd);
+    void wake();
 
     libtorrent::session* getSession(); // only in BT thread
 
+    // 以下只在 BT 线程调用
+    struct TorrentEntry {
+        libtorrent::torrent_handle handle;
+        BtInfoHash id;      // 对外的主 key
+        BtInfoHash alias;   // hybrid 的 v2 key
+        bool in_memory = false;
+        bool magnet = false;   // 没有 .torrent 文件，重启时恢复不了
+    };
+
+    // 内存存储的 torrent，按最近使用时间淘汰已完成的
+    struct MemEntry {
+        bool    finished = false;
+        int64_t size = 0;   // 完成时的总大小，淘汰时预估释放量
+        std::chrono::steady_clock::time_point lastUse;
+    };
+
+    // added 非空（批量添加）时不做同步 status()，按添加参数给个初始状态
+    std::string registerTorrent(const libtorrent::torrent_handle& h,
+                                const libtorrent::add_torrent_params* added = nullptr,
+                                bool in_memory = false, bool magnet = false);
+    // 从 session 和注册表里移除，key 可以是主 key 或别名；找不到返回 false
+    bool dropTorrent(const BtInfoHash& key, libtorrent::remove_flags_t flags);
+    void addAlias(const libtorrent::info_hash_t& ih);
+    // 任意线程；key 可以是主 key 或别名
+    bool findTorrent(const BtInfoHash& key, TorrentEntry& out);
+    BtInfoHash torrentId(const libtorrent::info_hash_t& ih);
+    void handleAlert(libtorrent::alert* a);
+    void onStateUpdate(const std::vector<libtorrent::torrent_status>& st);
+    void emitProgressEvents();
+    void emitEvent(const BtEvent& ev);
+    void onSessionStats(libtorrent::session_stats_alert* a);
+    void writeMetricsFile(const std::vector<BtMetric>& metrics, uint64_t timestamp_ms);
+    void touchMemTorrent(const BtInfoHash& id, bool finished);
+    void onMemTorrentDeleted(const libtorrent::info_hash_t& ih);
+    void evictMemTorrents();
+
+    // resume data，只在 BT 线程调用
+    std::string resumePath(const std::string& infohash_hex) const;
+    bool loadResumeData(const std::string& infohash_hex, libtorrent::add_torrent_params& p);
+    void saveAllResumeData(libtorrent::resume_data_flags_t flags);
+    void flushResumeData();
+
+    // 哈希线程池
+    std::shared_ptr<BtHashJob> submitHashJob(const std::string& folder,
+                                             const std::string& torrent_out,
+                                             const BtSeedOptions& opts);
+    void hashThreadFunc();
+    void runHashJob(const std::shared_ptr<BtHashJob>& job);
+    void finishHashJob(const std::shared_ptr<BtHashJob>& job, BtHashJobState state,
+                       const std::string& hex, const std::string& err);
+    // 任意线程调用，事件经命令队列在 BT 线程回调
+    void emitHashEvent(const std::shared_ptr<BtHashJob>& job, bool force);
+    void stopHashPool();
+
+    // 边下边读，除 rangeRequest 外只在 BT 线程调用
+    int rangeRequest(const std::shared_ptr<BtRangeRead>& rr, int timeout_ms);
+    void armRangeRead(const std::shared_ptr<BtRangeRead>& rr, const libtorrent::torrent_handle& h);
+    void armRangeReads(const BtInfoHash& id, const libtorrent::torrent_handle& h);
+    void onRangePiece(const BtInfoHash& id, int piece, const char* data, int size, bool failed);
+    void cancelRangeRead(const std::shared_ptr<BtRangeRead>& rr);
+    void resetRangeDeadlines(const BtRangeRead& rr);
+    void syncPieceAlerts();
+    void setPieceAlerts(bool on);
+    void failRangeReads(const BtInfoHash& id);
+
+    struct AddJob;
+    void pumpAdds();
+    void onTorrentAdded(libtorrent::add_torrent_alert* a);
+    void failPendingAdds(const char* reason);
+    bool wantEvent(BtEventType type);
+
 private:
     BtConfig m_cfg;
     bool loadConfig(const std::string& path, BtConfig& out);
     std::thread m_thread;
-    bool        m_running = false;
+    std::atomic<bool> m_running{false};
 
-    std::mutex m_mutex;
+    std::mutex m_wakeMutex;          // 只配合 m_cv 使用，不嵌套其它锁
     std::condition_variable m_cv;
-    std::queue<std::function<void(libtorrent::session&)>> m_cmdQueue;
+    bool m_wakeup = false;           // guarded by m_wakeMutex
+    std::atomic<bool> m_sleeping{false};
+    BtMpscQueue<BtQueuedCommand, kCmdQueueSize> m_cmdQueue;
+    std::atomic<int> m_posters{0};   // 已过 m_running 检查、还没入队的 postCommand 个数
 
     std::unique_ptr<libtorrent::session> m_session;
-    std::unordered_map<std::string, libtorrent::torrent_handle> m_torrents; // infohash_hex -> handle
+    // 注册表只在 BT 线程里写，其它线程可以拿共享锁读
+    std::shared_mutex m_torrentsMutex;
+    BtInfoHashMap<TorrentEntry> m_torrents;   // 主 key 和别名各一条
+
+    // state_update_alert 维护的状态快照，读端无锁
+    BtStatusTable m_statusTable;
+    std::chrono::steady_clock::time_point m_statusPostTime;           // only in BT thread
+    bool m_statusDirty = false;                                       // only in BT thread
+    BtShmStatus m_shmStatus;   // 快照表的共享内存副本，only in BT thread
+
+    // session 统计
+    std::vector<libtorrent::stats_metric> m_metricDefs;   // 初始化后只读
+    std::mutex m_metricsMutex;
+    std::vector<std::int64_t> m_metricValues;          // guarded by m_metricsMutex，下标为 value_index
+    uint64_t m_metricsTime = 0;                        // guarded by m_metricsMutex
+    std::chrono::steady_clock::time_point m_statsPostTime;            // only in BT thread
+
+    // 事件订阅
+    std::mutex m_eventMutex;
+    std::function<void(const BtEvent&)> m_eventCb;
+    unsigned m_eventMask = 0;
+    std::chrono::milliseconds m_progressInterval{1000};
+    std::chrono::steady_clock::time_point m_progressEmitTime;         // only in BT thread
+    // 上次发进度事件以来有变化的 torrent -> libtorrent 状态, only in BT thread
+    BtInfoHashMap<int> m_progressDirty;
+
+    // resume data, only in BT thread
+    std::string m_resumeDir;
+    int m_resumePending = 0;   // 已请求、还没收到 save_resume_data(_failed)_alert 的个数
+    std::chrono::steady_clock::time_point m_resumeSaveTime;
+
+    // 批量添加, only in BT thread
+    std::vector<std::shared_ptr<AddJob>> m_addJobs;
+    BtInfoHashMap<std::pair<std::shared_ptr<AddJob>, size_t>> m_pendingAdds; // 主 key -> (job, index)
+    int m_addInflight = 0;
+
+    // 等待中的 read_range / wait_range，主 key -> 请求, only in BT thread
+    BtInfoHashMap<std::vector<std::shared_ptr<BtRangeRead>>> m_rangeReads;
+    bool m_pieceAlerts = false;   // alert_mask 里是否开了 piece_progress_notification, only in BT thread
+
+    // 内存存储，mem_storage_mb 为 0 时为空
+    std::shared_ptr<BtMemUsage> m_memUsage;
+    BtInfoHashMap<MemEntry> m_memTorrents;     // 主 key -> 使用情况, only in BT thread
+    BtInfoHashMap<int64_t> m_memEvicting;        // 已淘汰、还没收到 torrent_deleted_alert 的 -> 预估大小, only in BT thread
+    int64_t m_memReleasing = 0;                  // m_memEvicting 的总和, only in BT thread
+
+    // 哈希线程池
+    std::mutex m_hashMutex;
+    std::condition_variable m_hashCv;
+    std::deque<std::shared_ptr<BtHashJob>> m_hashQueue;
+    std::map<uint64_t, std::shared_ptr<BtHashJob>> m_hashJobs;   // job_id -> job，含已结束的
+    std::vector<std::thread> m_hashThreads;
+    std::unique_ptr<BtHashCache> m_hashCache;   // hash_cache_file 为空时为空，start 后只读指针
+    uint64_t m_nextJobId = 1;
+    bool m_hashStop = false;
 };
 
 #endif // VS_BT_CORE_HPP
@@ -1,31 +1,64 @@
 // vs1984-bt-daemon.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <cjson/cJSON.h>
+
+#include "bt_api.h"
+#include "bt_conn.h"
+#include "bt_frame_io.h"
+#include "bt_msgpack.h"
+#include "bt_perf.h"
+#include "bt_server.h"
+#include "bt_stream.h"
+#include "bt_utils.h"
+#include "../ver/version.h"
 
 static BtHandle* bt_instance = NULL;
 
+static pthread_mutex_t g_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 服务模式下多个客户端都会发 init，只有第一个生效
 int bt_core_init(const char *config_path) {
+    int rc = 0;
+    pthread_mutex_lock(&g_init_lock);
     if (bt_instance == NULL) {
         bt_instance = bt_init(config_path);
         if (bt_instance == NULL) {
-            return 1;
+            rc = 1;
         }
     }
-
-    return 0;
+    pthread_mutex_unlock(&g_init_lock);
+    return rc;
 }
 
+// 可以重复调用，只有第一次生效
 void bt_core_shutdown(void) {
-    if (bt_instance == NULL) {
+    pthread_mutex_lock(&g_init_lock);
+    BtHandle *h = bt_instance;
+    bt_instance = NULL;
+    pthread_mutex_unlock(&g_init_lock);
+    if (h == NULL) {
         return;
     }
-    bt_shutdown(bt_instance);
+    btd_stream_stop_all();
+    bt_shutdown(h);
 }
 
 int bt_core_add_magnet(const char *magnet_uri,
                        const char *save_dir,
+                       int in_memory,
                        char *out_infohash_hex,
                        size_t out_len)
 {
-    return bt_add_magnet(bt_instance,magnet_uri, save_dir, out_infohash_hex, out_len);
+    return bt_add_magnet_ex(bt_instance, magnet_uri, save_dir, in_memory ? BT_ADD_IN_MEMORY : 0,
+                            out_infohash_hex, out_len);
 }
 
 int bt_core_add_torrent_file(const char *torrent_path,
@@ -38,24 +71,81 @@ int bt_core_add_torrent_file(const char *torrent_path,
 
 int bt_core_seed_folder(const char *folder,
                         const char *torrent_out_path,
+                        const BtSeedOptions *opts,
                         char *out_infohash_hex,
                         size_t out_len)
 {
-    return bt_seed_folder(bt_instance, folder, torrent_out_path, out_infohash_hex, out_len);
+    return bt_seed_folder_ex(bt_instance, folder, torrent_out_path, opts, out_infohash_hex, out_len);
+}
+
+int bt_core_seed_folder_async(const char *folder,
+                              const char *torrent_out_path,
+                              const BtSeedOptions *opts,
+                              unsigned long long *out_job_id)
+{
+    return bt_seed_folder_async_ex(bt_instance, folder, torrent_out_path, opts, out_job_id);
+}
+
+int bt_core_get_hash_job(unsigned long long job_id, BtHashJobInfo *info)
+{
+    return bt_get_hash_job(bt_instance, job_id, info);
+}
+
+int bt_core_cancel_hash_job(unsigned long long job_id)
+{
+    return bt_cancel_hash_job(bt_instance, job_id);
 }
 
 int bt_core_pause(const char *infohash_hex) { return bt_pause_torrent(bt_instance, infohash_hex); }
 int bt_core_resume(const char *infohash_hex) { return bt_resume_torrent(bt_instance, infohash_hex); }
 int bt_core_remove(const char *infohash_hex, int remove_files) { return bt_remove_torrent(bt_instance, infohash_hex, remove_files); }
+int bt_core_connect_peer(const char *infohash_hex, const char *ip, int port) { return bt_connect_peer(bt_instance, infohash_hex, ip, port); }
+
+int bt_core_read_range(const char *infohash_hex, int file_index, long long offset, size_t length,
+                       int timeout_ms, char *out_buf, size_t *out_len)
+{
+    return bt_read_range(bt_instance, infohash_hex, file_index, offset, length, timeout_ms, out_buf, out_len);
+}
+
+int bt_core_stream_range(const char *infohash_hex, int file_index, long long offset, long long length,
+                         const char *socket_path, int timeout_ms, unsigned long long *out_id)
+{
+    return btd_stream_start(bt_instance, infohash_hex, file_index, offset, length,
+                            socket_path, timeout_ms, out_id);
+}
 
 int bt_core_get_status(const char *infohash_hex, BtTorrentStatus *st)
 {
     return bt_get_torrent_status(bt_instance, infohash_hex, st);
 }
 
-int bt_core_resume_all(const char *dir_torrent, const char *dir_data)
+int bt_core_get_status_batch(const char *const *infohashes, size_t count,
+                             BtTorrentStatusEntry **out_list, size_t *out_count)
 {
-    return bt_resume_all_torrents(bt_instance, dir_torrent, dir_data);
+    return bt_get_torrent_status_batch(bt_instance, infohashes, count, out_list, out_count);
+}
+
+static void on_bt_event(const BtEvent *ev, void *user);
+
+int bt_core_subscribe(unsigned mask, int progress_interval_ms)
+{
+    return bt_set_event_callback(bt_instance, mask, progress_interval_ms, on_bt_event, NULL);
+}
+
+int bt_core_unsubscribe(void)
+{
+    return bt_set_event_callback(bt_instance, 0, 0, NULL, NULL);
+}
+
+int bt_core_get_metrics(BtMetric **out_list, size_t *out_count, unsigned long long *out_ts)
+{
+    return bt_get_metrics(bt_instance, out_list, out_count, out_ts);
+}
+
+int bt_core_resume_all(const char *dir_torrent, const char *dir_data,
+                       BtResumeEntry **out_list, size_t *out_count)
+{
+    return bt_resume_all_torrents_ex(bt_instance, dir_torrent, dir_data, out_list, out_count);
 }
 
 static const char* bt_state_to_string(BtState s) {
@@ -69,9 +159,7 @@ static const char* bt_state_to_string(BtState s) {
     }
 }
 
-static char* bt_status_to_result_json(const BtTorrentStatus *st) {
-    cJSON *obj = cJSON_CreateObject();
-
+static void bt_status_fill_json(cJSON *obj, const BtTorrentStatus *st) {
     cJSON_AddStringToObject(obj, "state", bt_state_to_string(st->state));
     cJSON_AddNumberToObject(obj, "progress", st->progress);
     cJSON_AddNumberToObject(obj, "download_rate", st->download_rate);
@@ -85,52 +173,143 @@ static char* bt_status_to_result_json(const BtTorrentStatus *st) {
     cJSON_AddNumberToObject(obj, "has_metadata", st->has_metadata);
     cJSON_AddNumberToObject(obj, "error_code", st->error_code);
     cJSON_AddStringToObject(obj, "error_msg", st->error_msg);
+}
+
+// 字段顺序、名字和 bt_status_fill_json 保持一致
+#define BT_STATUS_MP_FIELDS 13
+
+static void bt_status_write_mp(BtMpBuf *b, const BtTorrentStatus *st, const char *infohash_hex) {
+    bt_mp_map(b, BT_STATUS_MP_FIELDS + (infohash_hex ? 1 : 0));
+    if (infohash_hex) {
+        bt_mp_str(b, "infohash_hex");     bt_mp_str(b, infohash_hex);
+    }
+    bt_mp_str(b, "state");                bt_mp_str(b, bt_state_to_string(st->state));
+    bt_mp_str(b, "progress");             bt_mp_float(b, st->progress);
+    bt_mp_str(b, "download_rate");        bt_mp_int(b, st->download_rate);
+    bt_mp_str(b, "upload_rate");          bt_mp_int(b, st->upload_rate);
+    bt_mp_str(b, "total_downloaded");     bt_mp_int(b, st->total_downloaded);
+    bt_mp_str(b, "total_uploaded");       bt_mp_int(b, st->total_uploaded);
+    bt_mp_str(b, "num_peers");            bt_mp_int(b, st->num_peers);
+    bt_mp_str(b, "num_seeds");            bt_mp_int(b, st->num_seeds);
+    bt_mp_str(b, "num_leechers");         bt_mp_int(b, st->num_leechers);
+    bt_mp_str(b, "is_seeding");           bt_mp_int(b, st->is_seeding);
+    bt_mp_str(b, "has_metadata");         bt_mp_int(b, st->has_metadata);
+    bt_mp_str(b, "error_code");           bt_mp_int(b, st->error_code);
+    bt_mp_str(b, "error_msg");            bt_mp_str(b, st->error_msg);
+}
+
+static const char *bt_event_names[BT_EVENT_TYPE_COUNT] = {
+    [BT_EVENT_STATE_CHANGED]     = "state_changed",
+    [BT_EVENT_METADATA_RECEIVED] = "metadata_received",
+    [BT_EVENT_TORRENT_FINISHED]  = "torrent_finished",
+    [BT_EVENT_ERROR]             = "error",
+    [BT_EVENT_PROGRESS]          = "progress",
+    [BT_EVENT_HASH_JOB]          = "hash_job",
+};
+
+static const char* bt_hash_state_to_string(BtHashJobState s) {
+    switch (s) {
+        case BT_HASH_QUEUED:    return "queued";
+        case BT_HASH_RUNNING:   return "running";
+        case BT_HASH_DONE:      return "done";
+        case BT_HASH_FAILED:    return "failed";
+        case BT_HASH_CANCELLED: return "cancelled";
+        default:                return "unknown";
+    }
+}
+
+static void bt_hash_job_fill_json(cJSON *obj, const BtHashJobInfo *job) {
+    cJSON_AddNumberToObject(obj, "job_id", (double)job->job_id);
+    cJSON_AddStringToObject(obj, "state", bt_hash_state_to_string(job->state));
+    cJSON_AddNumberToObject(obj, "pieces_done", job->pieces_done);
+    cJSON_AddNumberToObject(obj, "pieces_total", job->pieces_total);
+    cJSON_AddNumberToObject(obj, "progress",
+        job->pieces_total > 0 ? (double)job->pieces_done / job->pieces_total : 0.0);
+    if (job->state == BT_HASH_DONE)
+        cJSON_AddStringToObject(obj, "infohash_hex", job->infohash_hex);
+    if (job->state == BT_HASH_FAILED || job->state == BT_HASH_CANCELLED)
+        cJSON_AddStringToObject(obj, "error_msg", job->error_msg);
+}
+
+static int bt_event_from_string(const char *name) {
+    for (int i = 0; i < BT_EVENT_TYPE_COUNT; i++) {
+        if (strcmp(name, bt_event_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static char* bt_status_to_result_json(const BtTorrentStatus *st) {
+    cJSON *obj = cJSON_CreateObject();
+    bt_status_fill_json(obj, st);
 
     char *out = cJSON_PrintUnformatted(obj);
     cJSON_Delete(obj);
     return out;
 }
 
-static int recv_frame(char **buf_out, size_t *len_out) {
-    uint32_t len_net;
-    ssize_t r = read(STDIN_FILENO, &len_net, 4);
-    if (r == 0) return 1;   // EOF: parent closed
-    if (r != 4) return -1;
+/*
+ * 编码协商：init 的 params.encoding 可选 "json"（默认）或 "msgpack"，按连接生效。
+ * init 的响应仍按原编码发送，之后的响应和事件都用新编码。
+ * 请求帧按首字节自动识别，两种编码随时都能收。
+ */
+static int wire_msgpack(BtdConn *c) {
+    return atomic_load_explicit(&c->wire, memory_order_relaxed) == BTD_WIRE_MSGPACK;
+}
+
+static int send_frame(BtdConn *c, const char *buf, size_t len) {
+    return c->ops->send(c, buf, len);
+}
 
-    uint32_t len = ntohl(len_net);
-    char *buf = malloc(len + 1);
-    if (!buf) return -1;
+static void send_mp(BtdConn *c, BtMpBuf *b) {
+    if (!b->failed) send_frame(c, b->data, b->len);
+    bt_mp_free(b);
+}
 
-    size_t readn = 0;
-    while (readn < len) {
-        r = read(STDIN_FILENO, buf + readn, len - readn);
-        if (r <= 0) {
-            free(buf);
-            return -1;
-        }
-        readn += r;
-    }
+// {"id":..,"status":..,"result": 之后由调用方写 result 的值，再调 mp_response_end
+static void mp_response_begin(BtMpBuf *b, int id, const char *status) {
+    bt_mp_map(b, 4);
+    bt_mp_str(b, "id");      bt_mp_int(b, id);
+    bt_mp_str(b, "status");  bt_mp_str(b, status);
+    bt_mp_str(b, "result");
+}
 
-    buf[len] = '\0';
-    *buf_out = buf;
-    *len_out = len;
-    return 0;
+static void mp_response_end(BtMpBuf *b) {
+    bt_mp_str(b, "error");   bt_mp_nil(b);
 }
 
-static int send_frame(const char *buf, size_t len) {
-    uint32_t len_net = htonl((uint32_t)len);
-    if (write(STDOUT_FILENO, &len_net, 4) != 4)
-        return -1;
-    size_t written = 0;
-    while (written < len) {
-        ssize_t w = write(STDOUT_FILENO, buf + written, len - written);
-        if (w <= 0) return -1;
-        written += w;
+// 按当前编码发送任意对象，不接管 obj
+static void send_object(BtdConn *c, const cJSON *obj) {
+    if (wire_msgpack(c)) {
+        char stack[1024];
+        BtMpBuf b;
+        bt_mp_init(&b, stack, sizeof(stack));
+        bt_mp_from_cjson(&b, obj);
+        send_mp(c, &b);
+        return;
+    }
+
+    char *out = cJSON_PrintUnformatted(obj);
+    if (out) {
+        send_frame(c, out, strlen(out));
+        free(out);
     }
-    return 0;
 }
 
-static void send_error_response(int id, int code, const char *msg) {
+static void send_error_response(BtdConn *c, int id, int code, const char *msg) {
+    if (wire_msgpack(c)) {
+        char stack[256];
+        BtMpBuf b;
+        bt_mp_init(&b, stack, sizeof(stack));
+        mp_response_begin(&b, id, "error");
+        bt_mp_nil(&b);
+        bt_mp_str(&b, "error");
+        bt_mp_map(&b, 2);
+        bt_mp_str(&b, "code");     bt_mp_int(&b, code);
+        bt_mp_str(&b, "message");  bt_mp_str(&b, msg);
+        send_mp(c, &b);
+        return;
+    }
+
     cJSON *root = cJSON_CreateObject();
     cJSON_AddNumberToObject(root, "id", id);
     cJSON_AddStringToObject(root, "status", "error");
@@ -142,18 +321,316 @@ static void send_error_response(int id, int code, const char *msg) {
     cJSON_AddItemToObject(root, "error", err);
 
     char *json = cJSON_PrintUnformatted(root);
-    send_frame(json, strlen(json));
+    send_frame(c, json, strlen(json));
 
     cJSON_Delete(root);
     free(json);
 }
 
-static int parse_request(const char *json,
-                         int *out_id,
-                         char **out_method,
-                         cJSON **out_params)
+// 接管 res 的所有权
+static void send_result_response(BtdConn *c, int id, cJSON *res) {
+    cJSON *resp = cJSON_CreateObject();
+    cJSON_AddNumberToObject(resp, "id", id);
+    cJSON_AddStringToObject(resp, "status", "ok");
+    cJSON_AddItemToObject(resp, "result", res ? res : cJSON_CreateObject());
+    cJSON_AddNullToObject(resp, "error");
+
+    send_object(c, resp);
+    cJSON_Delete(resp);
+}
+
+static void send_empty_ok(BtdConn *c, int id) {
+    if (wire_msgpack(c)) {
+        char stack[64];
+        BtMpBuf b;
+        bt_mp_init(&b, stack, sizeof(stack));
+        mp_response_begin(&b, id, "ok");
+        bt_mp_map(&b, 0);
+        mp_response_end(&b);
+        send_mp(c, &b);
+        return;
+    }
+
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf),
+                     "{\"id\":%d,\"status\":\"ok\",\"result\":{},\"error\":null}", id);
+    send_frame(c, buf, (size_t)n);
+}
+
+static const char *param_str(const cJSON *params, const char *key) {
+    const cJSON *v = cJSON_GetObjectItem(params, key);
+    return cJSON_IsString(v) ? v->valuestring : NULL;
+}
+
+static int param_int(const cJSON *params, const char *key, int def) {
+    const cJSON *v = cJSON_GetObjectItem(params, key);
+    if (cJSON_IsNumber(v)) return v->valueint;
+    if (cJSON_IsBool(v)) return cJSON_IsTrue(v) ? 1 : 0;
+    return def;
+}
+
+// 文件偏移会超过 int，按 double 取（2^53 以内精确）
+static long long param_ll(const cJSON *params, const char *key, long long def) {
+    const cJSON *v = cJSON_GetObjectItem(params, key);
+    return cJSON_IsNumber(v) ? (long long)v->valuedouble : def;
+}
+
+/*
+ * 连接管理和事件推送
+ *
+ * 所有连接挂在 g_conns 上，subscribe 按连接记录事件掩码和进度间隔，
+ * 向 BT 核心注册的是所有连接的并集和最小间隔。BT 线程回调时按连接分发无 id 的事件帧
+ * {"event":"state_changed","infohash_hex":"...",...}，同一种编码只序列化一次。
+ */
+static pthread_mutex_t g_conn_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_sub_lock  = PTHREAD_MUTEX_INITIALIZER;
+static BtdConn        *g_conns     = NULL;
+
+void btd_conn_init(BtdConn *c, const BtdConnOps *ops)
 {
-    cJSON *root = cJSON_Parse(json);
+    memset(c, 0, sizeof(*c));
+    c->ops = ops;
+    atomic_init(&c->refs, 1);
+    atomic_init(&c->wire, BTD_WIRE_JSON);
+    atomic_init(&c->requests, 0);
+}
+
+void btd_conn_retain(BtdConn *c)
+{
+    atomic_fetch_add(&c->refs, 1);
+}
+
+void btd_conn_release(BtdConn *c)
+{
+    if (atomic_fetch_sub(&c->refs, 1) == 1)
+        c->ops->destroy(c);
+}
+
+void btd_conn_register(BtdConn *c)
+{
+    pthread_mutex_lock(&g_conn_lock);
+    c->next = g_conns;
+    g_conns = c;
+    c->registered = 1;
+    pthread_mutex_unlock(&g_conn_lock);
+}
+
+// 按所有连接的订阅重新设置 BT 核心的回调
+static int update_subscription(void)
+{
+    pthread_mutex_lock(&g_sub_lock);
+
+    unsigned mask = 0;
+    int interval = 0;
+    pthread_mutex_lock(&g_conn_lock);
+    for (BtdConn *c = g_conns; c; c = c->next) {
+        mask |= c->event_mask;
+        if ((c->event_mask & BT_EVENT_MASK(BT_EVENT_PROGRESS)) &&
+            (interval == 0 || c->progress_interval_ms < interval))
+            interval = c->progress_interval_ms;
+    }
+    pthread_mutex_unlock(&g_conn_lock);
+
+    int rc = mask ? bt_core_subscribe(mask, interval > 0 ? interval : 1000)
+                  : bt_core_unsubscribe();
+    pthread_mutex_unlock(&g_sub_lock);
+    return rc;
+}
+
+void btd_conn_unregister(BtdConn *c)
+{
+    int had_events = 0;
+    pthread_mutex_lock(&g_conn_lock);
+    if (c->registered) {
+        for (BtdConn **pp = &g_conns; *pp; pp = &(*pp)->next) {
+            if (*pp == c) {
+                *pp = c->next;
+                break;
+            }
+        }
+        c->registered = 0;
+        c->next = NULL;
+        had_events = c->event_mask != 0;
+        c->event_mask = 0;
+    }
+    pthread_mutex_unlock(&g_conn_lock);
+
+    if (had_events && bt_instance) update_subscription();
+}
+
+static cJSON *bt_event_to_json(const BtEvent *ev)
+{
+    cJSON *obj = cJSON_CreateObject();
+    cJSON_AddStringToObject(obj, "event", bt_event_names[ev->type]);
+    cJSON_AddStringToObject(obj, "infohash_hex", ev->infohash_hex);
+
+    switch (ev->type) {
+        case BT_EVENT_STATE_CHANGED:
+            cJSON_AddStringToObject(obj, "state", bt_state_to_string(ev->state));
+            cJSON_AddStringToObject(obj, "prev_state", bt_state_to_string(ev->prev_state));
+            cJSON_AddStringToObject(obj, "lt_state", ev->lt_state);
+            break;
+        case BT_EVENT_TORRENT_FINISHED:
+            cJSON_AddStringToObject(obj, "state", bt_state_to_string(ev->state));
+            break;
+        case BT_EVENT_ERROR:
+            cJSON_AddNumberToObject(obj, "error_code", ev->error_code);
+            cJSON_AddStringToObject(obj, "error_msg", ev->error_msg);
+            break;
+        case BT_EVENT_PROGRESS: {
+            cJSON *st = cJSON_AddObjectToObject(obj, "status");
+            bt_status_fill_json(st, &ev->status);
+            cJSON_AddStringToObject(obj, "lt_state", ev->lt_state);
+            break;
+        }
+        case BT_EVENT_HASH_JOB: {
+            cJSON *job = cJSON_AddObjectToObject(obj, "job");
+            bt_hash_job_fill_json(job, &ev->job);
+            break;
+        }
+        default:
+            break;
+    }
+    return obj;
+}
+
+static void bt_event_write_mp(BtMpBuf *b, const BtEvent *ev)
+{
+    // 进度事件量最大，直接从结构体编码
+    if (ev->type == BT_EVENT_PROGRESS) {
+        bt_mp_map(b, 4);
+        bt_mp_str(b, "event");         bt_mp_str(b, bt_event_names[ev->type]);
+        bt_mp_str(b, "infohash_hex");  bt_mp_str(b, ev->infohash_hex);
+        bt_mp_str(b, "status");        bt_status_write_mp(b, &ev->status, NULL);
+        bt_mp_str(b, "lt_state");      bt_mp_str(b, ev->lt_state);
+        return;
+    }
+
+    cJSON *obj = bt_event_to_json(ev);
+    bt_mp_from_cjson(b, obj);
+    cJSON_Delete(obj);
+}
+
+static void on_bt_event(const BtEvent *ev, void *user)
+{
+    (void)user;
+    if ((int)ev->type < 0 || ev->type >= BT_EVENT_TYPE_COUNT) return;
+
+    unsigned bit = BT_EVENT_MASK(ev->type);
+    char *json = NULL;
+    int have_mp = 0;
+    char stack[512];
+    BtMpBuf mp;
+    bt_mp_init(&mp, stack, sizeof(stack));
+
+    // 持锁发送：send 只是排队不会阻塞，且保证 unregister 之后不再有事件
+    pthread_mutex_lock(&g_conn_lock);
+    for (BtdConn *c = g_conns; c; c = c->next) {
+        if (!(c->event_mask & bit)) continue;
+        if (wire_msgpack(c)) {
+            if (!have_mp) {
+                bt_event_write_mp(&mp, ev);
+                have_mp = 1;
+            }
+            if (!mp.failed) send_frame(c, mp.data, mp.len);
+        } else {
+            if (!json) {
+                cJSON *obj = bt_event_to_json(ev);
+                json = cJSON_PrintUnformatted(obj);
+                cJSON_Delete(obj);
+            }
+            if (json) send_frame(c, json, strlen(json));
+        }
+    }
+    pthread_mutex_unlock(&g_conn_lock);
+
+    free(json);
+    bt_mp_free(&mp);
+}
+
+// params: {"events":["state_changed",...], "progress_interval_ms":1000}
+static void handle_subscribe(BtdConn *c, int id, const cJSON *params)
+{
+    unsigned mask = BT_EVENT_MASK_DEFAULT;
+    const cJSON *events = cJSON_GetObjectItem(params, "events");
+    if (cJSON_IsArray(events)) {
+        mask = 0;
+        const cJSON *it = NULL;
+        cJSON_ArrayForEach(it, events) {
+            int t = cJSON_IsString(it) ? bt_event_from_string(it->valuestring) : -1;
+            if (t < 0) {
+                send_error_response(c, id, 400, "unknown event");
+                return;
+            }
+            mask |= BT_EVENT_MASK(t);
+        }
+    }
+    int interval = param_int(params, "progress_interval_ms", 1000);
+
+    unsigned old_mask;
+    int old_interval;
+    pthread_mutex_lock(&g_conn_lock);
+    old_mask = c->event_mask;
+    old_interval = c->progress_interval_ms;
+    c->event_mask = mask;
+    c->progress_interval_ms = interval;
+    pthread_mutex_unlock(&g_conn_lock);
+
+    if (update_subscription() != 0) {
+        pthread_mutex_lock(&g_conn_lock);
+        c->event_mask = old_mask;
+        c->progress_interval_ms = old_interval;
+        pthread_mutex_unlock(&g_conn_lock);
+        send_error_response(c, id, 500, "subscribe failed");
+        return;
+    }
+
+    cJSON *res = cJSON_CreateObject();
+    cJSON *list = cJSON_AddArrayToObject(res, "events");
+    for (int i = 0; i < BT_EVENT_TYPE_COUNT; i++) {
+        if (mask & BT_EVENT_MASK(i))
+            cJSON_AddItemToArray(list, cJSON_CreateString(bt_event_names[i]));
+    }
+    send_result_response(c, id, res);
+}
+
+/*
+ * 请求流水线
+ *
+ * 读线程（stdio 模式下是 main，服务模式下是 libuv 循环）只负责拆帧和解析，
+ * 请求进入队列后由 worker 线程执行，结果按完成顺序回写到请求所属的连接，
+ * 客户端通过 id 匹配。stdio 模式下 init / shutdown 作为屏障：
+ * 读线程先等所有在途请求结束，再在本线程内执行。
+ */
+typedef struct BtdRequest {
+    BtdConn *conn;          // 持有一个引用
+    int    id;
+    const char *method;     // 指向 root 内部
+    cJSON *params;          // 指向 root 内部
+    cJSON *root;
+    uint64_t recv_ns;       // 收到整帧的时间，bt_perf_now_ns
+    struct BtdRequest *next;
+} BtdRequest;
+
+#define BTD_WORKERS_DEFAULT 8
+#define BTD_WORKERS_MAX     64
+
+static pthread_mutex_t g_req_lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_req_cv    = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  g_idle_cv   = PTHREAD_COND_INITIALIZER;
+static BtdRequest     *g_req_head  = NULL;
+static BtdRequest     *g_req_tail  = NULL;
+static int             g_inflight  = 0;   // 排队 + 执行中
+static int             g_queued    = 0;   // 只算排队的
+static int             g_stopping  = 0;
+
+static pthread_t g_workers[BTD_WORKERS_MAX];
+static int       g_num_workers = 0;
+
+// 返回 0 成功；-1 不是合法 JSON / MessagePack（丢弃）；-2 结构不对（回 400）
+static int parse_request(const char *buf, size_t len, BtdRequest *out)
+{
+    cJSON *root = bt_mp_is_map(buf, len) ? bt_mp_to_cjson(buf, len) : cJSON_ParseWithLength(buf, len);
     if (!root) return -1;
 
     cJSON *id = cJSON_GetObjectItem(root, "id");
@@ -162,254 +639,874 @@ static int parse_request(const char *json,
 
     if (!cJSON_IsNumber(id) || !cJSON_IsString(method) || !cJSON_IsObject(params)) {
         cJSON_Delete(root);
-        return -1;
+        return -2;
     }
 
-    *out_id = id->valueint;
-    *out_method = strdup(method->valuestring);
-    *out_params = params;
-
+    out->id = id->valueint;
+    out->method = method->valuestring;
+    out->params = params;
+    out->root = root;
+    out->next = NULL;
     return 0;
 }
 
-#include "bt_utils.h"
-int main(int argc, char **argv)
+static void free_request(BtdRequest *req)
 {
-    (void)argc; (void)argv;
+    if (!req) return;
+    if (req->conn) btd_conn_release(req->conn);
+    cJSON_Delete(req->root);
+    free(req);
+}
 
-    for(int i=1;i<argc;i++){
-        if(!strcmp(argv[i], "-d")) set_debug(1);
-        else set_debug(0);
+/*
+ * 边下边读
+ *
+ * read_range 把数据放在回复里：msgpack 连接用 bin，JSON 连接用 base64。
+ * 大段数据用 stream_range，见 bt_stream.h。
+ *
+ * 等数据时占着一个 worker，所以等待时间有上限，同时在等的请求最多占一半 worker，
+ * 慢 swarm 上的读不会把其它 RPC 都堵住。要等更久用 stream_range。
+ */
+#define BTD_READ_RANGE_MAX        (4 * 1024 * 1024)
+#define BTD_READ_RANGE_TIMEOUT_MS 10000
+
+static atomic_int g_range_waiting;
+
+static char *base64_encode(const char *data, size_t len)
+{
+    static const char tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const unsigned char *p = (const unsigned char *)data;
+    char *out = malloc((len + 2) / 3 * 4 + 1);
+    if (!out) return NULL;
+
+    char *o = out;
+    size_t i = 0;
+    for (; i + 2 < len; i += 3) {
+        uint32_t v = (uint32_t)p[i] << 16 | (uint32_t)p[i + 1] << 8 | p[i + 2];
+        *o++ = tbl[v >> 18];
+        *o++ = tbl[(v >> 12) & 63];
+        *o++ = tbl[(v >> 6) & 63];
+        *o++ = tbl[v & 63];
+    }
+    if (i < len) {
+        uint32_t v = (uint32_t)p[i] << 16 | (i + 1 < len ? (uint32_t)p[i + 1] << 8 : 0);
+        *o++ = tbl[v >> 18];
+        *o++ = tbl[(v >> 12) & 63];
+        *o++ = i + 1 < len ? tbl[(v >> 6) & 63] : '=';
+        *o++ = '=';
     }
+    *o = '\0';
+    return out;
+}
 
-    for (;;) {
-        char *req = NULL;
-        size_t len = 0;
+static void handle_read_range(BtdConn *c, int id, const cJSON *params)
+{
+    const char *ih = param_str(params, "infohash_hex");
+    int file_index = param_int(params, "file_index", -1);
+    long long offset = param_ll(params, "offset", -1);
+    long long length = param_ll(params, "length", -1);
+    int timeout_ms = param_int(params, "timeout_ms", BTD_READ_RANGE_TIMEOUT_MS);
+
+    if (!ih || file_index < 0 || offset < 0 || length < 0 || length > BTD_READ_RANGE_MAX) {
+        send_error_response(c, id, 400, "bad params");
+        return;
+    }
+    if (timeout_ms <= 0 || timeout_ms > BTD_READ_RANGE_TIMEOUT_MS) timeout_ms = BTD_READ_RANGE_TIMEOUT_MS;
 
-        int rc = recv_frame(&req, &len);
-        if (rc == 1) break;
-        if (rc != 0) continue;
+    int limit = g_num_workers / 2 > 0 ? g_num_workers / 2 : 1;
+    if (atomic_fetch_add(&g_range_waiting, 1) >= limit) {
+        atomic_fetch_sub(&g_range_waiting, 1);
+        send_error_response(c, id, 503, "too many pending reads");
+        return;
+    }
 
-        int id = 0;
-        char *method = NULL;
-        cJSON *params = NULL;
-        cJSON *root = cJSON_Parse(req);
+    char *buf = malloc(length > 0 ? (size_t)length : 1);
+    if (!buf) {
+        atomic_fetch_sub(&g_range_waiting, 1);
+        send_error_response(c, id, 500, "out of memory");
+        return;
+    }
+    size_t n = 0;
+    int rc = bt_core_read_range(ih, file_index, offset, (size_t)length, timeout_ms, buf, &n);
+    atomic_fetch_sub(&g_range_waiting, 1);
+    if (rc == BT_ERR_TIMEOUT) {
+        send_error_response(c, id, 504, "timeout");
+    } else if (rc != 0) {
+        send_error_response(c, id, 500, "read failed");
+    } else if (wire_msgpack(c)) {
+        char stack[256];
+        BtMpBuf b;
+        bt_mp_init(&b, stack, sizeof(stack));
+        mp_response_begin(&b, id, "ok");
+        bt_mp_map(&b, 3);
+        bt_mp_str(&b, "offset");  bt_mp_int(&b, offset);
+        bt_mp_str(&b, "length");  bt_mp_int(&b, (int64_t)n);
+        bt_mp_str(&b, "data");    bt_mp_bin(&b, buf, n);
+        mp_response_end(&b);
+        send_mp(c, &b);
+    } else {
+        char *b64 = base64_encode(buf, n);
+        if (!b64) {
+            send_error_response(c, id, 500, "out of memory");
+        } else {
+            cJSON *res = cJSON_CreateObject();
+            cJSON_AddNumberToObject(res, "offset", (double)offset);
+            cJSON_AddNumberToObject(res, "length", (double)n);
+            cJSON_AddStringToObject(res, "data", b64);
+            free(b64);
+            send_result_response(c, id, res);
+        }
+    }
+    free(buf);
+}
 
-        if (!root) {
-            free(req);
-            continue;
+// {"torrents":[{"infohash_hex":..., <status>}], "missing":[...]}
+static void handle_status_batch(BtdConn *c, int id, const cJSON *list)
+{
+    int n = cJSON_IsArray(list) ? cJSON_GetArraySize(list) : 0;
+    const char **hexes = NULL;
+
+    if (n > 0) {
+        hexes = calloc((size_t)n, sizeof(char *));
+        if (!hexes) {
+            send_error_response(c, id, 500, "internal error");
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            const cJSON *it = cJSON_GetArrayItem(list, i);
+            if (!cJSON_IsString(it)) {
+                free(hexes);
+                send_error_response(c, id, 400, "bad params");
+                return;
+            }
+            hexes[i] = it->valuestring;
         }
+    }
+
+    BtTorrentStatusEntry *entries = NULL;
+    size_t count = 0;
+    int rc = bt_core_get_status_batch(hexes, (size_t)n, &entries, &count);
+    free(hexes);
+    if (rc != 0) {
+        send_error_response(c, id, 500, "status failed");
+        return;
+    }
 
-        cJSON *id_i = cJSON_GetObjectItem(root, "id");
-        cJSON *method_i = cJSON_GetObjectItem(root, "method");
-        cJSON *params_i = cJSON_GetObjectItem(root, "params");
+    if (wire_msgpack(c)) {
+        size_t found = 0;
+        for (size_t i = 0; i < count; i++) found += entries[i].found ? 1 : 0;
+
+        BtMpBuf b;
+        bt_mp_init(&b, NULL, 0);
+        mp_response_begin(&b, id, "ok");
+        bt_mp_map(&b, 2);
+        bt_mp_str(&b, "torrents");
+        bt_mp_array(&b, (uint32_t)found);
+        for (size_t i = 0; i < count; i++) {
+            if (entries[i].found)
+                bt_status_write_mp(&b, &entries[i].status, entries[i].infohash_hex);
+        }
+        bt_mp_str(&b, "missing");
+        bt_mp_array(&b, (uint32_t)(count - found));
+        for (size_t i = 0; i < count; i++) {
+            if (!entries[i].found) bt_mp_str(&b, entries[i].infohash_hex);
+        }
+        mp_response_end(&b);
+        bt_free_status_list(entries);
+        send_mp(c, &b);
+        return;
+    }
 
-        if (!cJSON_IsNumber(id_i) || !cJSON_IsString(method_i) || !cJSON_IsObject(params_i)) {
-            send_error_response(0, 400, "bad request");
-            cJSON_Delete(root);
-            free(req);
+    cJSON *res = cJSON_CreateObject();
+    cJSON *torrents = cJSON_AddArrayToObject(res, "torrents");
+    cJSON *missing = cJSON_AddArrayToObject(res, "missing");
+    for (size_t i = 0; i < count; i++) {
+        if (!entries[i].found) {
+            cJSON_AddItemToArray(missing, cJSON_CreateString(entries[i].infohash_hex));
             continue;
         }
+        cJSON *obj = cJSON_CreateObject();
+        cJSON_AddStringToObject(obj, "infohash_hex", entries[i].infohash_hex);
+        bt_status_fill_json(obj, &entries[i].status);
+        cJSON_AddItemToArray(torrents, obj);
+    }
+    bt_free_status_list(entries);
 
-        id = id_i->valueint;
-        method = method_i->valuestring;
-        params = params_i;
+    send_result_response(c, id, res);
+}
 
-        if (strcmp(method, "init") == 0) {
-            cJSON *p = cJSON_GetObjectItem(params, "config_path");
-            const char *config_path = cJSON_IsString(p) ? p->valuestring : "";
+static void handle_init(const BtdRequest *req);
 
-            if (bt_core_init(config_path) != 0) {
-                send_error_response(id, 500, "init failed");
-            } else {
-                cJSON *resp = cJSON_CreateObject();
-                cJSON_AddNumberToObject(resp, "id", id);
-                cJSON_AddStringToObject(resp, "status", "ok");
+// get_perf_stats：{"rpc":{"<method>":{"queue":{...},"exec":{...},"total":{...}}},"cmd":{...}}，时间单位微秒
+static void perf_to_json(void *user, BtPerfScope scope, const char *name,
+                         const BtPerfSummary summary[BT_PERF_KIND_COUNT])
+{
+    cJSON *group = cJSON_GetObjectItem((cJSON *)user, bt_perf_scope_name(scope));
+    cJSON *m = cJSON_AddObjectToObject(group, name);
+    for (int k = 0; k < BT_PERF_KIND_COUNT; k++) {
+        const BtPerfSummary *s = &summary[k];
+        cJSON *h = cJSON_AddObjectToObject(m, bt_perf_kind_name((BtPerfKind)k));
+        cJSON_AddNumberToObject(h, "count", (double)s->count);
+        cJSON_AddNumberToObject(h, "mean_us", s->mean_us);
+        cJSON_AddNumberToObject(h, "p50_us", s->p50_us);
+        cJSON_AddNumberToObject(h, "p90_us", s->p90_us);
+        cJSON_AddNumberToObject(h, "p99_us", s->p99_us);
+        cJSON_AddNumberToObject(h, "p999_us", s->p999_us);
+        cJSON_AddNumberToObject(h, "max_us", s->max_us);
+    }
+}
 
-                cJSON *res = cJSON_CreateObject();
-                cJSON_AddStringToObject(res, "version", RSUNX_VERSION);
-                cJSON_AddItemToObject(resp, "result", res);
-                cJSON_AddNullToObject(resp, "error");
+static void handle_request(const BtdRequest *req)
+{
+    BtdConn *c = req->conn;
+    int id = req->id;
+    const char *method = req->method;
+    const cJSON *params = req->params;
+
+    if (strcmp(method, "add_magnet") == 0) {
+        const char *magnet = param_str(params, "magnet_uri");
+        const char *save   = param_str(params, "save_dir");
+        int in_memory      = param_int(params, "in_memory", 0);   // 为真时不需要 save_dir
+        if (!magnet || (!save && !in_memory)) {
+            send_error_response(c, id, 400, "bad params");
+            return;
+        }
 
-                char *out = cJSON_PrintUnformatted(resp);
-                send_frame(out, strlen(out));
+        char infohash[BT_INFOHASH_HEX_LEN] = {0};
+        if (bt_core_add_magnet(magnet, save, in_memory, infohash, sizeof(infohash)) != 0) {
+            send_error_response(c, id, 500, "add_magnet failed");
+        } else {
+            cJSON *res = cJSON_CreateObject();
+            cJSON_AddStringToObject(res, "infohash_hex", infohash);
+            send_result_response(c, id, res);
+        }
+    }
 
-                free(out);
-                cJSON_Delete(resp);
-            }
+    else if (strcmp(method, "add_torrent_file") == 0) {
+        const char *path = param_str(params, "torrent_path");
+        const char *save = param_str(params, "save_dir");
+        if (!path || !save) {
+            send_error_response(c, id, 400, "bad params");
+            return;
         }
 
-        else if (strcmp(method, "add_magnet") == 0) {
-            const char *magnet = cJSON_GetObjectItem(params, "magnet_uri")->valuestring;
-            const char *save   = cJSON_GetObjectItem(params, "save_dir")->valuestring;
+        char infohash[BT_INFOHASH_HEX_LEN] = {0};
+        if (bt_core_add_torrent_file(path, save, infohash, sizeof(infohash)) != 0) {
+            send_error_response(c, id, 500, "add_torrent_file failed");
+        } else {
+            cJSON *res = cJSON_CreateObject();
+            cJSON_AddStringToObject(res, "infohash_hex", infohash);
+            send_result_response(c, id, res);
+        }
+    }
 
-            char infohash[64] = {0};
-            if (bt_core_add_magnet(magnet, save, infohash, sizeof(infohash)) != 0) {
-                send_error_response(id, 500, "add_magnet failed");
-            } else {
-                cJSON *resp = cJSON_CreateObject();
-                cJSON_AddNumberToObject(resp, "id", id);
-                cJSON_AddStringToObject(resp, "status", "ok");
+    else if (strcmp(method, "seed_folder") == 0) {
+        const char *folder      = param_str(params, "folder");
+        const char *out_torrent = param_str(params, "torrent_out_path");
+        const char *format      = param_str(params, "format");     // hybrid（默认）/ v1 / v2
+        if (!folder || !out_torrent) {
+            send_error_response(c, id, 400, "bad params");
+            return;
+        }
 
+        BtSeedOptions opts;
+        memset(&opts, 0, sizeof(opts));
+        if (!format || strcmp(format, "hybrid") == 0) {
+            opts.format = BT_TORRENT_HYBRID;
+        } else if (strcmp(format, "v1") == 0) {
+            opts.format = BT_TORRENT_V1;
+        } else if (strcmp(format, "v2") == 0) {
+            opts.format = BT_TORRENT_V2;
+        } else {
+            send_error_response(c, id, 400, "bad format");
+            return;
+        }
+        opts.piece_size_kb = param_int(params, "piece_size_kb", 0);
+        opts.hash_threads  = param_int(params, "hash_threads", 0);
+
+        // async: 立即返回 job_id，进度通过 get_hash_job / hash_job 事件获取
+        if (param_int(params, "async", 0)) {
+            unsigned long long job_id = 0;
+            if (bt_core_seed_folder_async(folder, out_torrent, &opts, &job_id) != 0) {
+                send_error_response(c, id, 500, "seed_folder failed");
+            } else {
                 cJSON *res = cJSON_CreateObject();
-                cJSON_AddStringToObject(res, "infohash_hex", infohash);
-                cJSON_AddItemToObject(resp, "result", res);
-                cJSON_AddNullToObject(resp, "error");
-
-                char *out = cJSON_PrintUnformatted(resp);
-                send_frame(out, strlen(out));
-                free(out);
-                cJSON_Delete(resp);
+                cJSON_AddNumberToObject(res, "job_id", (double)job_id);
+                send_result_response(c, id, res);
             }
+            return;
         }
 
-        else if (strcmp(method, "add_torrent_file") == 0) {
-            const char *path = cJSON_GetObjectItem(params, "torrent_path")->valuestring;
-            const char *save = cJSON_GetObjectItem(params, "save_dir")->valuestring;
+        char infohash[BT_INFOHASH_HEX_LEN] = {0};
+        if (bt_core_seed_folder(folder, out_torrent, &opts, infohash, sizeof(infohash)) != 0) {
+            send_error_response(c, id, 500, "seed_folder failed");
+        } else {
+            cJSON *res = cJSON_CreateObject();
+            cJSON_AddStringToObject(res, "infohash_hex", infohash);
+            send_result_response(c, id, res);
+        }
+    }
 
-            char infohash[64];
-            if (bt_core_add_torrent_file(path, save, infohash, sizeof(infohash)) != 0) {
-                send_error_response(id, 500, "add_torrent_file failed");
-            } else {
-                cJSON *resp = cJSON_CreateObject();
-                cJSON_AddNumberToObject(resp, "id", id);
-                cJSON_AddStringToObject(resp, "status", "ok");
+    else if (strcmp(method, "get_hash_job") == 0) {
+        const cJSON *jid = cJSON_GetObjectItem(params, "job_id");
+        BtHashJobInfo info;
+        if (!cJSON_IsNumber(jid)) {
+            send_error_response(c, id, 400, "bad params");
+        } else if (bt_core_get_hash_job((unsigned long long)jid->valuedouble, &info) != 0) {
+            send_error_response(c, id, 404, "job not found");
+        } else {
+            cJSON *res = cJSON_CreateObject();
+            bt_hash_job_fill_json(res, &info);
+            send_result_response(c, id, res);
+        }
+    }
 
-                cJSON *res = cJSON_CreateObject();
-                cJSON_AddStringToObject(res, "infohash_hex", infohash);
-                cJSON_AddItemToObject(resp, "result", res);
-                cJSON_AddNullToObject(resp, "error");
-                char *out = cJSON_PrintUnformatted(resp);
-                send_frame(out, strlen(out));
-
-                free(out);
-                cJSON_Delete(resp);
-            }
+    else if (strcmp(method, "cancel_hash_job") == 0) {
+        const cJSON *jid = cJSON_GetObjectItem(params, "job_id");
+        if (!cJSON_IsNumber(jid)) {
+            send_error_response(c, id, 400, "bad params");
+        } else if (bt_core_cancel_hash_job((unsigned long long)jid->valuedouble) != 0) {
+            send_error_response(c, id, 500, "cancel failed");
+        } else {
+            send_empty_ok(c, id);
+        }
+    }
+
+    else if (strcmp(method, "pause_torrent") == 0) {
+        const char *ih = param_str(params, "infohash_hex");
+        if (!ih) {
+            send_error_response(c, id, 400, "bad params");
+        } else if (bt_core_pause(ih) != 0) {
+            send_error_response(c, id, 500, "pause failed");
+        } else {
+            send_empty_ok(c, id);
         }
+    }
 
-        else if (strcmp(method, "seed_folder") == 0) {
-            const char *folder = cJSON_GetObjectItem(params, "folder")->valuestring;
-            const char *out_torrent = cJSON_GetObjectItem(params, "torrent_out_path")->valuestring;
+    else if (strcmp(method, "resume_torrent") == 0) {
+        const char *ih = param_str(params, "infohash_hex");
+        if (!ih) {
+            send_error_response(c, id, 400, "bad params");
+        } else if (bt_core_resume(ih) != 0) {
+            send_error_response(c, id, 500, "resume failed");
+        } else {
+            send_empty_ok(c, id);
+        }
+    }
 
-            char infohash[64];
-            if (bt_core_seed_folder(folder, out_torrent, infohash, sizeof(infohash)) != 0) {
-                send_error_response(id, 500, "seed_folder failed");
-            } else {
-                cJSON *resp = cJSON_CreateObject();
-                cJSON_AddNumberToObject(resp, "id", id);
-                cJSON_AddStringToObject(resp, "status", "ok");
+    else if (strcmp(method, "remove_torrent") == 0) {
+        const char *ih = param_str(params, "infohash_hex");
+        int rm = param_int(params, "remove_files", 0);
 
-                cJSON *res = cJSON_CreateObject();
-                cJSON_AddStringToObject(res, "infohash_hex", infohash);
-                cJSON_AddItemToObject(resp, "result", res);
-                cJSON_AddNullToObject(resp, "error");
-                char *out = cJSON_PrintUnformatted(resp);
-                send_frame(out, strlen(out));
-
-                free(out);
-                cJSON_Delete(resp);
-            }
+        if (!ih) {
+            send_error_response(c, id, 400, "bad params");
+        } else if (bt_core_remove(ih, rm) != 0) {
+            send_error_response(c, id, 500, "remove failed");
+        } else {
+            send_empty_ok(c, id);
         }
+    }
 
-        else if (strcmp(method, "pause_torrent") == 0) {
-            const char *ih = cJSON_GetObjectItem(params, "infohash_hex")->valuestring;
-            if (bt_core_pause(ih) != 0) {
-                send_error_response(id, 500, "pause failed");
-            } else {
-                const char *out = "{\"id\":%d,\"status\":\"ok\",\"result\":{},\"error\":null}";
-                char buf[256];
-                snprintf(buf, sizeof(buf), out, id);
-                send_frame(buf, strlen(buf));
-            }
+    else if (strcmp(method, "read_range") == 0) {
+        handle_read_range(c, id, params);
+    }
+
+    else if (strcmp(method, "stream_range") == 0) {
+        const char *ih = param_str(params, "infohash_hex");
+        const char *sock = param_str(params, "socket_path");
+        int file_index = param_int(params, "file_index", -1);
+        long long offset = param_ll(params, "offset", -1);
+        long long length = param_ll(params, "length", 0);
+        int timeout_ms = param_int(params, "timeout_ms", 60000);
+        unsigned long long sid = 0;
+
+        if (!ih || !sock || file_index < 0 || offset < 0 || length < 0) {
+            send_error_response(c, id, 400, "bad params");
+        } else if (bt_core_stream_range(ih, file_index, offset, length, sock, timeout_ms, &sid) != 0) {
+            send_error_response(c, id, 500, "stream failed");
+        } else {
+            cJSON *res = cJSON_CreateObject();
+            cJSON_AddNumberToObject(res, "stream_id", (double)sid);
+            send_result_response(c, id, res);
         }
+    }
 
-        else if (strcmp(method, "resume_torrent") == 0) {
-            const char *ih = cJSON_GetObjectItem(params, "infohash_hex")->valuestring;
-            if (bt_core_resume(ih) != 0) {
-                send_error_response(id, 500, "resume failed");
-            } else {
-                const char *out = "{\"id\":%d,\"status\":\"ok\",\"result\":{},\"error\":null}";
-                char buf[256];
-                snprintf(buf, sizeof(buf), out, id);
-                send_frame(buf, strlen(buf));
-            }
+    else if (strcmp(method, "connect_peer") == 0) {
+        const char *ih = param_str(params, "infohash_hex");
+        const char *ip = param_str(params, "ip");
+        int port = param_int(params, "port", 0);
+
+        if (!ih || !ip || port <= 0) {
+            send_error_response(c, id, 400, "bad params");
+        } else if (bt_core_connect_peer(ih, ip, port) != 0) {
+            send_error_response(c, id, 500, "connect failed");
+        } else {
+            send_empty_ok(c, id);
         }
+    }
 
-        else if (strcmp(method, "remove_torrent") == 0) {
-            const char *ih = cJSON_GetObjectItem(params, "infohash_hex")->valuestring;
-            int rm = cJSON_GetObjectItem(params, "remove_files")->valueint;
+    else if (strcmp(method, "get_torrent_status") == 0) {
+        const cJSON *ih_arr = cJSON_GetObjectItem(params, "infohash_hex");
+        if (cJSON_IsArray(ih_arr)) {
+            handle_status_batch(c, id, ih_arr);
+            return;
+        }
 
-            if (bt_core_remove(ih, rm) != 0) {
-                send_error_response(id, 500, "remove failed");
+        const char *ih = param_str(params, "infohash_hex");
+        if (!ih) {
+            send_error_response(c, id, 400, "bad params");
+            return;
+        }
+
+        BtTorrentStatus st;
+        if (bt_core_get_status(ih, &st) != 0) {
+            send_error_response(c, id, 500, "status failed");
+        } else if (wire_msgpack(c)) {
+            char stack[512];
+            BtMpBuf b;
+            bt_mp_init(&b, stack, sizeof(stack));
+            mp_response_begin(&b, id, "ok");
+            bt_status_write_mp(&b, &st, NULL);
+            mp_response_end(&b);
+            send_mp(c, &b);
+        } else {
+            char *res_json = bt_status_to_result_json(&st);
+            if (!res_json) {
+                send_error_response(c, id, 500, "internal error");
             } else {
-                const char *out = "{\"id\":%d,\"status\":\"ok\",\"result\":{},\"error\":null}";
-                char buf[256];
-                snprintf(buf, sizeof(buf), out, id);
-                send_frame(buf, strlen(buf));
+                char *resp = NULL;
+                asprintf(&resp,
+                    "{\"id\":%d,\"status\":\"ok\",\"result\":%s,\"error\":null}",
+                    id, res_json);
+                if (resp) {
+                    send_frame(c, resp, strlen(resp));
+                    free(resp);
+                }
+                free(res_json);
             }
         }
+    }
+
+    else if (strcmp(method, "subscribe") == 0) {
+        handle_subscribe(c, id, params);
+    }
+
+    else if (strcmp(method, "unsubscribe") == 0) {
+        pthread_mutex_lock(&g_conn_lock);
+        c->event_mask = 0;
+        pthread_mutex_unlock(&g_conn_lock);
+
+        if (update_subscription() != 0) {
+            send_error_response(c, id, 500, "unsubscribe failed");
+        } else {
+            send_empty_ok(c, id);
+        }
+    }
+
+    // params: {"prefix":"disk."}（可选，按名字前缀过滤）
+    // 返回 {"timestamp_ms":..., "metrics":{"net.sent_payload_bytes":123,...}, "gauges":["disk.queued_disk_jobs",...]}
+    else if (strcmp(method, "get_metrics") == 0) {
+        const char *prefix = param_str(params, "prefix");
+        size_t plen = prefix ? strlen(prefix) : 0;
+        BtMetric *list = NULL;
+        size_t n = 0;
+        unsigned long long ts = 0;
+        if (bt_core_get_metrics(&list, &n, &ts) != 0) {
+            send_error_response(c, id, 500, "get_metrics failed");
+            return;
+        }
+
+        cJSON *res = cJSON_CreateObject();
+        cJSON_AddNumberToObject(res, "timestamp_ms", (double)ts);
+        cJSON *metrics = cJSON_AddObjectToObject(res, "metrics");
+        cJSON *gauges = cJSON_AddArrayToObject(res, "gauges");
+        for (size_t i = 0; i < n; i++) {
+            if (plen && strncmp(list[i].name, prefix, plen) != 0) continue;
+            cJSON_AddNumberToObject(metrics, list[i].name, (double)list[i].value);
+            if (list[i].type == BT_METRIC_GAUGE)
+                cJSON_AddItemToArray(gauges, cJSON_CreateString(list[i].name));
+        }
+        bt_free_metrics(list);
+        send_result_response(c, id, res);
+    }
+
+    // params: {"reset":true}（可选，取完后清零）
+    else if (strcmp(method, "get_perf_stats") == 0) {
+        cJSON *res = cJSON_CreateObject();
+        for (int i = 0; i < BT_PERF_SCOPE_COUNT; i++)
+            cJSON_AddObjectToObject(res, bt_perf_scope_name((BtPerfScope)i));
+        bt_perf_foreach(perf_to_json, res);
+
+        cJSON *depth = cJSON_AddObjectToObject(res, "queue_depth");
+        for (int i = 0; i < BT_PERF_SCOPE_COUNT; i++) {
+            long cur = 0, max = 0;
+            bt_perf_get_queue_depth((BtPerfScope)i, &cur, &max);
+            cJSON *d = cJSON_AddObjectToObject(depth, bt_perf_scope_name((BtPerfScope)i));
+            cJSON_AddNumberToObject(d, "current", cur);
+            cJSON_AddNumberToObject(d, "max", max);
+        }
+
+        const cJSON *reset = cJSON_GetObjectItem(params, "reset");
+        if (cJSON_IsTrue(reset)) bt_perf_reset();
+        send_result_response(c, id, res);
+    }
+
+    // params: {"level":0~4}（BT_LOG_TRACE），超出范围或不是整数返回 400；返回之前的级别
+    else if (strcmp(method, "set_log_level") == 0) {
+        const cJSON *level = cJSON_GetObjectItem(params, "level");
+        if (!cJSON_IsNumber(level) || level->valuedouble < 0 || level->valuedouble > BT_LOG_TRACE ||
+            level->valuedouble != (double)level->valueint) {
+            send_error_response(c, id, 400, "bad params");
+            return;
+        }
+        int prev = get_debug();
+        set_debug(level->valueint);
+
+        cJSON *res = cJSON_CreateObject();
+        cJSON_AddNumberToObject(res, "previous", prev);
+        send_result_response(c, id, res);
+    }
+
+    // 服务模式下 init / shutdown 也走 worker，不阻塞事件循环
+    else if (strcmp(method, "init") == 0) {
+        handle_init(req);
+    }
+
+    else if (strcmp(method, "shutdown") == 0) {
+        send_empty_ok(c, id);
+        btd_server_stop();
+    }
+
+    else if (strcmp(method, "get_all_status") == 0) {
+        // 不带 infohashes 返回全部
+        handle_status_batch(c, id, cJSON_GetObjectItem(params, "infohashes"));
+    }
+
+    else if (strcmp(method, "resume_all_torrents") == 0) {
+        const char *dir_t = param_str(params, "torrents_dir");
+        const char *dir_d = param_str(params, "data_dir");
+        if (!dir_t || !dir_d) {
+            send_error_response(c, id, 400, "bad params");
+            return;
+        }
 
-        else if (strcmp(method, "get_torrent_status") == 0) {
-            const char *ih = cJSON_GetObjectItem(params, "infohash_hex")->valuestring;
+        BtResumeEntry *entries = NULL;
+        size_t n = 0;
+        int count = bt_core_resume_all(dir_t, dir_d, &entries, &n);
+        if (count < 0) {
+            send_error_response(c, id, 500, "resume_all_torrents failed");
+            return;
+        }
 
-            BtTorrentStatus st;
-            if (bt_core_get_status(ih, &st) != 0) {
-                send_error_response(id, 500, "status failed");
+        cJSON *res = cJSON_CreateObject();
+        cJSON_AddNumberToObject(res, "resumed_count", count);
+        cJSON_AddNumberToObject(res, "failed_count", (double)n - count);
+        cJSON *files = cJSON_AddArrayToObject(res, "files");
+        for (size_t i = 0; i < n; i++) {
+            cJSON *f = cJSON_CreateObject();
+            cJSON_AddStringToObject(f, "path", entries[i].path ? entries[i].path : "");
+            cJSON_AddBoolToObject(f, "ok", entries[i].ok);
+            if (entries[i].ok) {
+                cJSON_AddStringToObject(f, "infohash_hex", entries[i].infohash_hex);
             } else {
-                char *res_json = bt_status_to_result_json(&st);
-                if (!res_json) {
-                    send_error_response(id, 500, "internal error");
-                } else {
-                    char *resp = NULL;
-                    asprintf(&resp,
-                        "{\"id\":%d,\"status\":\"ok\",\"result\":%s,\"error\":null}",
-                        id, res_json);
-                    if (resp) {
-                        send_frame(resp, strlen(resp));
-                        free(resp);
-                    }
-                    free(res_json);
-                }
+                cJSON_AddStringToObject(f, "error", entries[i].error_msg);
             }
+            cJSON_AddItemToArray(files, f);
         }
+        bt_free_resume_report(entries, n);
 
-        else if (strcmp(method, "resume_all_torrents") == 0) {
-            const char *dir_t = cJSON_GetObjectItem(params, "torrents_dir")->valuestring;
-            const char *dir_d = cJSON_GetObjectItem(params, "data_dir")->valuestring;
+        send_result_response(c, id, res);
+    }
 
-            int count = bt_core_resume_all(dir_t, dir_d);
+    else {
+        send_error_response(c, id, 400, "unknown method");
+    }
+}
 
-            char *resp;
-            asprintf(&resp,
-                "{\"id\":%d,\"status\":\"ok\",\"result\":{\"resumed_count\":%d},\"error\":null}",
-                id, count);
-            if (resp) {
-                send_frame(resp, strlen(resp));
-                free(resp);
-            }
+static void *worker_main(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&g_req_lock);
+        while (!g_req_head && !g_stopping)
+            pthread_cond_wait(&g_req_cv, &g_req_lock);
+        if (!g_req_head) {          // stopping 且队列已空
+            pthread_mutex_unlock(&g_req_lock);
+            break;
         }
+        BtdRequest *req = g_req_head;
+        g_req_head = req->next;
+        if (!g_req_head) g_req_tail = NULL;
+        bt_perf_queue_depth(BT_PERF_RPC, --g_queued);
+        pthread_mutex_unlock(&g_req_lock);
+
+        BtPerfMethod *perf = bt_perf_method(BT_PERF_RPC, req->method);
+        uint64_t start = bt_perf_now_ns();
+        handle_request(req);
+        uint64_t end = bt_perf_now_ns();
+        bt_perf_record(perf, BT_PERF_QUEUE, start - req->recv_ns);
+        bt_perf_record(perf, BT_PERF_EXEC, end - start);
+        bt_perf_record(perf, BT_PERF_TOTAL, end - req->recv_ns);
+        BtdConn *c = req->conn;
+        if (c && atomic_fetch_sub(&c->requests, 1) == 1 && c->ops->idle) c->ops->idle(c);
+        free_request(req);
+
+        pthread_mutex_lock(&g_req_lock);
+        if (--g_inflight == 0)
+            pthread_cond_broadcast(&g_idle_cv);
+        pthread_mutex_unlock(&g_req_lock);
+    }
+    return NULL;
+}
 
-        else if (strcmp(method, "shutdown") == 0) {
-            char *resp;
-            asprintf(&resp,
-                "{\"id\":%d,\"status\":\"ok\",\"result\":{},\"error\":null}",
-                id);
-            if (resp) {
-                send_frame(resp, strlen(resp));
-                free(resp);
-            }
+static void enqueue_request(BtdRequest *req)
+{
+    pthread_mutex_lock(&g_req_lock);
+    if (g_req_tail) g_req_tail->next = req;
+    else            g_req_head = req;
+    g_req_tail = req;
+    g_inflight++;
+    if (req->conn) atomic_fetch_add(&req->conn->requests, 1);
+    bt_perf_queue_depth(BT_PERF_RPC, ++g_queued);
+    pthread_cond_signal(&g_req_cv);
+    pthread_mutex_unlock(&g_req_lock);
+}
 
-            bt_core_shutdown();
+static void wait_idle(void)
+{
+    pthread_mutex_lock(&g_req_lock);
+    while (g_inflight > 0)
+        pthread_cond_wait(&g_idle_cv, &g_req_lock);
+    pthread_mutex_unlock(&g_req_lock);
+}
+
+static int start_workers(int n)
+{
+    if (n < 1) n = 1;
+    if (n > BTD_WORKERS_MAX) n = BTD_WORKERS_MAX;
+    for (int i = 0; i < n; i++) {
+        if (pthread_create(&g_workers[i], NULL, worker_main, NULL) != 0) {
+            iloge("[btd] pthread_create worker %d failed", i);
             break;
         }
+        g_num_workers++;
+    }
+    return g_num_workers > 0 ? 0 : -1;
+}
 
-        else {
-            send_error_response(id, 400, "unknown method");
+static void stop_workers(void)
+{
+    pthread_mutex_lock(&g_req_lock);
+    g_stopping = 1;
+    pthread_cond_broadcast(&g_req_cv);
+    pthread_mutex_unlock(&g_req_lock);
+
+    for (int i = 0; i < g_num_workers; i++)
+        pthread_join(g_workers[i], NULL);
+    g_num_workers = 0;
+}
+
+static void handle_init(const BtdRequest *req)
+{
+    BtdConn *c = req->conn;
+    const char *config_path = param_str(req->params, "config_path");
+    if (!config_path) config_path = "";
+
+    int wire = atomic_load(&c->wire);
+    const char *encoding = param_str(req->params, "encoding");
+    if (encoding) {
+        if (strcmp(encoding, "json") == 0) {
+            wire = BTD_WIRE_JSON;
+        } else if (strcmp(encoding, "msgpack") == 0) {
+            wire = BTD_WIRE_MSGPACK;
+        } else {
+            send_error_response(c, req->id, 400, "unknown encoding");
+            return;
         }
+    }
 
-        cJSON_Delete(root);
+    if (bt_core_init(config_path) != 0) {
+        send_error_response(c, req->id, 500, "init failed");
+    } else {
+        cJSON *res = cJSON_CreateObject();
+        cJSON_AddStringToObject(res, "version", RSUNX_VERSION);
+        cJSON_AddStringToObject(res, "encoding", wire == BTD_WIRE_MSGPACK ? "msgpack" : "json");
+        send_result_response(c, req->id, res);
+        atomic_store(&c->wire, wire);
+    }
+}
+
+void btd_conn_on_frame(BtdConn *c, const char *buf, size_t len)
+{
+    BtdRequest *req = calloc(1, sizeof(BtdRequest));
+    if (!req) return;
+    req->recv_ns = bt_perf_now_ns();
+
+    int rc = parse_request(buf, len, req);
+    if (rc == -1) {
+        free(req);
+        return;
+    }
+    if (rc == -2) {
+        send_error_response(c, 0, 400, "bad request");
         free(req);
+        return;
+    }
+
+    btd_conn_retain(c);
+    req->conn = c;
+    enqueue_request(req);
+}
+
+/*
+ * stdin/stdout 连接：发送交给 frame writer 线程，连接本身是静态的
+ */
+static BtFrameReader  g_reader;
+static BtFrameWriter *g_writer = NULL;
+static atomic_int     g_stdio_dead;
+
+// 写端作废后回复都发不出去，父进程会一直等。把 stdout 换成 /dev/null，
+// 正在阻塞的 write 返回后管道写端就关了，父进程读到 EOF；
+// 用 dup2 而不是 close，fd 1 不会被别的 open 复用
+static void stdio_close_output(void)
+{
+    if (atomic_exchange(&g_stdio_dead, 1)) return;
+    iloge("[btd] fatal: stdout writer failed, ending stdio session");
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    } else {
+        close(STDOUT_FILENO);
+    }
+}
+
+static int stdio_send(BtdConn *c, const char *buf, size_t len)
+{
+    (void)c;
+    if (bt_frame_send(g_writer, buf, len) == 0) return 0;
+    if (bt_frame_writer_failed(g_writer)) stdio_close_output();
+    return -1;
+}
+
+static void stdio_destroy(BtdConn *c)
+{
+    (void)c;
+}
+
+static const BtdConnOps g_stdio_ops = { stdio_send, stdio_destroy, NULL };
+static BtdConn g_stdio_conn;
+
+static int run_stdio(void)
+{
+    BtdConn *c = &g_stdio_conn;
+
+    bt_frame_reader_init(&g_reader, STDIN_FILENO);
+    g_writer = bt_frame_writer_start(STDOUT_FILENO);
+    if (!g_writer) {
+        bt_frame_reader_free(&g_reader);
+        return -1;
+    }
+    btd_conn_init(c, &g_stdio_ops);
+    btd_conn_register(c);
+
+    for (;;) {
+        const char *buf = NULL;
+        size_t len = 0;
+
+        // 帧读错误后流已经错位，无法再同步，直接退出
+        int rc = bt_frame_read(&g_reader, &buf, &len);
+        if (rc == 1) break;
+        if (rc != 0) {
+            iloge("[btd] frame read failed, exit");
+            break;
+        }
+        // 回复已经发不出去，不再执行新请求，走正常的 shutdown
+        if (bt_frame_writer_failed(g_writer)) {
+            stdio_close_output();
+            break;
+        }
+
+        BtdRequest *req = calloc(1, sizeof(BtdRequest));
+        if (!req) {
+            continue;
+        }
+        req->recv_ns = bt_perf_now_ns();
+
+        rc = parse_request(buf, len, req);
+        if (rc == -1) {
+            free(req);
+            continue;
+        }
+        if (rc == -2) {
+            send_error_response(c, 0, 400, "bad request");
+            free(req);
+            continue;
+        }
+        btd_conn_retain(c);
+        req->conn = c;
+
+        if (strcmp(req->method, "init") == 0) {
+            wait_idle();
+            handle_init(req);
+            free_request(req);
+        }
+
+        else if (strcmp(req->method, "shutdown") == 0) {
+            wait_idle();
+            send_empty_ok(c, req->id);
+            free_request(req);
+            break;
+        }
+
+        else {
+            enqueue_request(req);
+        }
     }
 
+    wait_idle();
+
+    // 收到 shutdown 或者 stdin EOF / 读错误都走这里：停 BT 线程，resume data 在这里写完
+    bt_core_shutdown();
+
+    // BT 线程停止前可能还在推事件，writer 只停不释放
+    btd_conn_unregister(c);
+    bt_frame_writer_stop(g_writer);
+    bt_frame_reader_free(&g_reader);
     return 0;
 }
+
+int main(int argc, char **argv)
+{
+    int workers = BTD_WORKERS_DEFAULT;
+    const char *listen_path = NULL;
+
+    set_debug(0);
+    for (int i = 1; i < argc; i++) {
+        // -d 只打错误，-d2 ~ -d4 依次加上 info / debug / trace
+        if (!strncmp(argv[i], "-d", 2)) set_debug(argv[i][2] ? atoi(argv[i] + 2) : 1);
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc) workers = atoi(argv[++i]);
+        else if ((!strcmp(argv[i], "-l") || !strcmp(argv[i], "--listen")) && i + 1 < argc)
+            listen_path = argv[++i];
+    }
+
+    // 客户端断开后的写错误按返回值处理
+    signal(SIGPIPE, SIG_IGN);
+
+    if (start_workers(workers) != 0) {
+        return 1;
+    }
+
+    int rc = 0;
+    if (listen_path) {
+        // 客户端发 shutdown 时事件循环退出；各连接在 worker 里的请求先跑完
+        if (btd_server_run(listen_path) != 0) rc = 1;
+        wait_idle();
+        bt_core_shutdown();
+    } else {
+        if (run_stdio() != 0) rc = 1;
+    }
+
+    stop_workers();
+    return rc;
+}
@@ -0,0 +1,43 @@
+// src/bt_disk_io.cpp
+#include "bt_disk_io.hpp"
+
+#include <libtorrent/settings_pack.hpp>
+#include <libtorrent/mmap_disk_io.hpp>
+#include <libtorrent/posix_disk_io.hpp>
+namespace lt = libtorrent;
+
+namespace {
+
+const int kSmallFilesCutoffBlocks = 256;   // 4 MiB 以下的文件不 mmap
+const int kSmallFilesPoolSize     = 1000;
+
+void set_int_default(lt::settings_pack& pack, int name, int value)
+{
+    if (name >= 0 && !pack.has_val(name)) pack.set_int(name, value);
+}
+
+} // namespace
+
+bool bt_disk_io_known(const std::string& name)
+{
+    return name == "default" || name == "mmap" || name == "posix" || name == "small_files";
+}
+
+bool bt_disk_io_setup(const std::string& name, lt::session_params& params)
+{
+    if (name == "default") {
+        params.disk_io_constructor = lt::default_disk_io_constructor;
+    } else if (name == "mmap") {
+        params.disk_io_constructor = lt::mmap_disk_io_constructor;
+    } else if (name == "posix") {
+        params.disk_io_constructor = lt::posix_disk_io_constructor;
+    } else if (name == "small_files") {
+        params.disk_io_constructor = lt::mmap_disk_io_constructor;
+        // 老版本 libtorrent 没有这个设置，按名字查，查不到就只调文件池
+        set_int_default(params.settings, lt::setting_by_name("mmap_file_size_cutoff"), kSmallFilesCutoffBlocks);
+        set_int_default(params.settings, lt::settings_pack::file_pool_size, kSmallFilesPoolSize);
+    } else {
+        return false;
+    }
+    return true;
+}
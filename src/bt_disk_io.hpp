@@ -0,0 +1,21 @@
+// src/bt_disk_io.hpp
+#ifndef VS_BT_DISK_IO_HPP
+#define VS_BT_DISK_IO_HPP
+
+#include <string>
+
+#include "../third_party/libtorrent/include/libtorrent/session_params.hpp"
+
+// 磁盘后端，配置项 disk_io：
+//   default      libtorrent 默认（Linux 上即 mmap）
+//   mmap         mmap_disk_io，多线程，适合大文件和本地 NVMe
+//   posix        posix_disk_io，pread/pwrite，不占地址空间，适合 NFS 等 mmap 表现差的文件系统
+//   small_files  mmap_disk_io，但小文件走 pread（mmap_file_size_cutoff），文件池也更大，
+//                适合大量小文件
+bool bt_disk_io_known(const std::string& name);
+
+// 按名字设置 params.disk_io_constructor，并补上该后端的默认参数；
+// params.settings 里已经设置过的项不覆盖。未知名字返回 false，params 不变
+bool bt_disk_io_setup(const std::string& name, libtorrent::session_params& params);
+
+#endif // VS_BT_DISK_IO_HPP
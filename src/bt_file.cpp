@@ -0,0 +1,26 @@
+// src/bt_file.cpp
+#include "bt_file.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+bool bt_read_file(const std::string& path, std::vector<char>& buf)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool bt_write_file_atomic(const std::string& path, const std::vector<char>& buf)
+{
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(buf.data(), buf.size());
+        if (!out) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
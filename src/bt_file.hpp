@@ -0,0 +1,14 @@
+// src/bt_file.hpp
+#ifndef VS_BT_FILE_HPP
+#define VS_BT_FILE_HPP
+
+#include <string>
+#include <vector>
+
+// 整个文件读进 buf，打不开返回 false
+bool bt_read_file(const std::string& path, std::vector<char>& buf);
+
+// 先写 path.tmp 再 rename，崩溃时不会留下半截文件
+bool bt_write_file_atomic(const std::string& path, const std::vector<char>& buf);
+
+#endif // VS_BT_FILE_HPP
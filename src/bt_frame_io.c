@@ -0,0 +1,274 @@
+// src/bt_frame_io.c
+#include "bt_frame_io.h"
+#include "bt_utils.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#define BT_FRAME_READ_INIT  (64 * 1024)
+#define BT_FRAME_WRITE_MAX  (64u * 1024 * 1024)   // 待发数据超过这个量时写端作废，发送方从不等待
+
+/* ---------- 读 ---------- */
+
+void bt_frame_reader_init(BtFrameReader *r, int fd)
+{
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+}
+
+void bt_frame_reader_free(BtFrameReader *r)
+{
+    free(r->buf);
+    memset(r, 0, sizeof(*r));
+}
+
+// 保证 start 之后至少能放下 need 字节
+static int reader_reserve(BtFrameReader *r, size_t need)
+{
+    size_t used = r->end - r->start;
+
+    // 前面已经消费掉的空间先挪出来
+    if (r->start > 0 && r->start + need > r->cap) {
+        memmove(r->buf, r->buf + r->start, used);
+        r->start = 0;
+        r->end = used;
+    }
+    if (need <= r->cap) return 0;
+
+    size_t cap = r->cap ? r->cap : BT_FRAME_READ_INIT;
+    while (cap < need) cap *= 2;
+    char *p = realloc(r->buf, cap);
+    if (!p) return -1;
+    r->buf = p;
+    r->cap = cap;
+    return 0;
+}
+
+int bt_frame_reader_next(BtFrameReader *r, const char **data, size_t *len)
+{
+    size_t avail = r->end - r->start;
+    if (avail < 4) {
+        r->need = 4;
+        return 1;
+    }
+
+    uint32_t len_net;
+    memcpy(&len_net, r->buf + r->start, 4);
+    uint32_t n = ntohl(len_net);
+    if (n > BT_FRAME_MAX_LEN) {
+        iloge("[btd] frame too large: %u", n);
+        return -1;
+    }
+    if (avail < 4 + (size_t)n) {
+        r->need = 4 + (size_t)n;
+        return 1;
+    }
+
+    *data = r->buf + r->start + 4;
+    *len = n;
+    r->start += 4 + (size_t)n;
+    if (r->start == r->end) r->start = r->end = 0;
+    r->need = 4;
+    return 0;
+}
+
+int bt_frame_reader_prepare(BtFrameReader *r, char **buf, size_t *avail)
+{
+    // 至少放得下当前这一帧；空间允许时一次多读，后面几帧就不用再进内核
+    size_t need = r->need > 4 ? r->need : 4;
+    size_t used = r->end - r->start;
+    if (need < used + BT_FRAME_READ_INIT / 4) need = used + BT_FRAME_READ_INIT / 4;
+    if (reader_reserve(r, need) != 0) return -1;
+
+    *buf = r->buf + r->end;
+    *avail = r->cap - r->end;
+    return 0;
+}
+
+void bt_frame_reader_commit(BtFrameReader *r, size_t n)
+{
+    r->end += n;
+}
+
+int bt_frame_read(BtFrameReader *r, const char **data, size_t *len)
+{
+    for (;;) {
+        int rc = bt_frame_reader_next(r, data, len);
+        if (rc != 1) return rc;
+
+        char *buf;
+        size_t avail;
+        if (bt_frame_reader_prepare(r, &buf, &avail) != 0) return -1;
+
+        ssize_t got = read(r->fd, buf, avail);
+        if (got < 0 && errno == EINTR) continue;
+        if (got == 0) return r->end == r->start ? 1 : -1;   // 帧中间断开算错误
+        if (got < 0) return -1;
+        bt_frame_reader_commit(r, (size_t)got);
+    }
+}
+
+/* ---------- 写 ---------- */
+
+struct BtFrameWriter {
+    int fd;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cv;         // 有数据待发 / 要停止
+
+    char   *pending;            // 发送方追加到这里
+    size_t  pending_len;
+    size_t  pending_cap;
+
+    char   *flushing;           // 写线程正在刷的那一块
+    size_t  flushing_cap;
+
+    int stopping;
+    int failed;
+};
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t w = write(fd, buf + done, len - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        done += (size_t)w;
+    }
+    return 0;
+}
+
+static void *writer_main(void *arg)
+{
+    BtFrameWriter *w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->pending_len == 0 && !w->stopping)
+            pthread_cond_wait(&w->cv, &w->lock);
+        if (w->pending_len == 0) break;     // stopping 且已刷完
+
+        // 交换两块缓冲区，锁外写，发送方可以继续往新的 pending 追加
+        char *buf = w->pending;
+        size_t len = w->pending_len;
+        size_t cap = w->pending_cap;
+        w->pending = w->flushing;
+        w->pending_cap = w->flushing_cap;
+        w->pending_len = 0;
+        w->flushing = buf;
+        w->flushing_cap = cap;
+        pthread_mutex_unlock(&w->lock);
+
+        int rc = w->failed ? -1 : write_all(w->fd, buf, len);
+
+        pthread_mutex_lock(&w->lock);
+        if (rc != 0 && !w->failed) {
+            // 写端已坏，之后排队的数据直接丢弃
+            iloge("[btd] frame write failed: %s", strerror(errno));
+            w->failed = 1;
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+BtFrameWriter *bt_frame_writer_start(int fd)
+{
+    BtFrameWriter *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    w->fd = fd;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cv, NULL);
+
+    if (pthread_create(&w->thread, NULL, writer_main, w) != 0) {
+        pthread_cond_destroy(&w->cv);
+        pthread_mutex_destroy(&w->lock);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int bt_frame_send(BtFrameWriter *w, const char *buf, size_t len)
+{
+    if (!w || len > BT_FRAME_MAX_LEN) return -1;
+    size_t need = 4 + len;
+    uint32_t len_net = htonl((uint32_t)len);
+
+    pthread_mutex_lock(&w->lock);
+    if (w->failed || w->stopping) {
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+    if (w->pending_len > 0 && w->pending_len + need > BT_FRAME_WRITE_MAX) {
+        // 对端不读。BT 线程持 g_conn_lock 发事件，不能在这里等，
+        // 和 socket 客户端超过上限就断开一样，写端作废，已排队的也不再发
+        iloge("[btd] frame writer: peer not reading, %zu bytes pending, giving up", w->pending_len);
+        w->failed = 1;
+        w->pending_len = 0;
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+
+    if (w->pending_len + need > w->pending_cap) {
+        size_t cap = w->pending_cap ? w->pending_cap : 4096;
+        while (cap < w->pending_len + need) cap *= 2;
+        char *p = realloc(w->pending, cap);
+        if (!p) {
+            pthread_mutex_unlock(&w->lock);
+            return -1;
+        }
+        w->pending = p;
+        w->pending_cap = cap;
+    }
+
+    // header 和 body 连续放进同一块缓冲区，多个帧合并成一次 write
+    memcpy(w->pending + w->pending_len, &len_net, 4);
+    memcpy(w->pending + w->pending_len + 4, buf, len);
+    int wake = w->pending_len == 0;
+    w->pending_len += need;
+    if (wake) pthread_cond_signal(&w->cv);
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+int bt_frame_writer_failed(BtFrameWriter *w)
+{
+    if (!w) return 1;
+    pthread_mutex_lock(&w->lock);
+    int failed = w->failed;
+    pthread_mutex_unlock(&w->lock);
+    return failed;
+}
+
+void bt_frame_writer_stop(BtFrameWriter *w)
+{
+    if (!w) return;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->stopping) {
+        pthread_mutex_unlock(&w->lock);
+        return;
+    }
+    w->stopping = 1;
+    pthread_cond_broadcast(&w->cv);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+}
+
+void bt_frame_writer_free(BtFrameWriter *w)
+{
+    if (!w) return;
+    bt_frame_writer_stop(w);
+
+    pthread_cond_destroy(&w->cv);
+    pthread_mutex_destroy(&w->lock);
+    free(w->pending);
+    free(w->flushing);
+    free(w);
+}
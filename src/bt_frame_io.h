@@ -0,0 +1,66 @@
+// src/bt_frame_io.h
+#ifndef VS_BT_FRAME_IO_H
+#define VS_BT_FRAME_IO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * 4 字节大端长度 + body 的帧读写
+ *
+ * 读：一个可增长的缓冲区，一次 read 尽量多读，缓冲区里攒够整帧就直接返回，
+ *     不再每帧 malloc；短读（包括 4 字节头被拆开）都能正确拼回。
+ * 写：任意线程把帧追加到待发缓冲区后立即返回，由写线程一次性刷出，
+ *     短写会续写；两块缓冲区交替使用，稳定后不再分配内存。
+ *     发送方从不等待：对端不读、待发超过 64 MiB 时写端作废，之后都返回 -1。
+ */
+
+#define BT_FRAME_MAX_LEN (64u * 1024 * 1024)
+
+typedef struct BtFrameReader {
+    int     fd;
+    char   *buf;
+    size_t  cap;
+    size_t  start;      // 下一帧头的位置
+    size_t  end;        // 已读入数据的末尾
+    size_t  need;       // 凑齐下一帧需要从 start 起的字节数
+} BtFrameReader;
+
+// fd 为 -1 时只能用 prepare / commit / next，由外部事件循环读数据
+void bt_frame_reader_init(BtFrameReader *r, int fd);
+void bt_frame_reader_free(BtFrameReader *r);
+
+// 阻塞读 r->fd。
+// 0: 得到一帧，*data 指向内部缓冲区，下次调用前有效（不以 '\0' 结尾）
+// 1: EOF；-1: 读错误或帧长超过 BT_FRAME_MAX_LEN
+int bt_frame_read(BtFrameReader *r, const char **data, size_t *len);
+
+// 给事件循环用：prepare 取可写入的空间，读到 n 字节后 commit，
+// 再反复 next 直到返回 1。next 返回的帧在下一次 prepare 前有效。
+int  bt_frame_reader_prepare(BtFrameReader *r, char **buf, size_t *avail);
+void bt_frame_reader_commit(BtFrameReader *r, size_t n);
+// 0: 得到一帧；1: 数据不够；-1: 帧长超过 BT_FRAME_MAX_LEN
+int  bt_frame_reader_next(BtFrameReader *r, const char **data, size_t *len);
+
+typedef struct BtFrameWriter BtFrameWriter;
+
+BtFrameWriter *bt_frame_writer_start(int fd);
+// 任意线程调用，不阻塞；写端已出错、已关闭或因积压作废时返回 -1
+int  bt_frame_send(BtFrameWriter *w, const char *buf, size_t len);
+// 写端是否因写错误或积压作废；作废后不会恢复，调用方应结束会话
+int  bt_frame_writer_failed(BtFrameWriter *w);
+// 刷完已排队的帧后停止写线程，之后 bt_frame_send 返回 -1；不释放内存，
+// 其它线程（比如还没停的 BT 线程）此后调用 bt_frame_send 仍然安全
+void bt_frame_writer_stop(BtFrameWriter *w);
+// 确认没有其它线程再调用 bt_frame_send 后释放
+void bt_frame_writer_free(BtFrameWriter *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VS_BT_FRAME_IO_H
@@ -0,0 +1,175 @@
+// src/bt_hash_cache.cpp
+#include "bt_hash_cache.hpp"
+#include "bt_file.hpp"
+
+#include <cstring>
+
+#include <libtorrent/sha1_hash.hpp>
+namespace lt = libtorrent;
+
+// 本机自用的缓存，按本机字节序直接存：
+//   "VSHC" u32 版本 u32 条数，每条 u32 路径长 路径 i64 大小 i64 mtime u64 inode
+//   i32 piece 长 i32 尾 piece 长 u32 v2 个数 u32 v1 个数 v2... v1...
+static const char kMagic[4] = {'V', 'S', 'H', 'C'};
+static const uint32_t kVersion = 1;
+
+namespace {
+
+struct Writer {
+    std::vector<char>& buf;
+
+    template <typename T>
+    void pod(T v)
+    {
+        const char* p = reinterpret_cast<const char*>(&v);
+        buf.insert(buf.end(), p, p + sizeof(v));
+    }
+
+    void raw(const char* p, size_t n) { buf.insert(buf.end(), p, p + n); }
+};
+
+// 越界时 ok 变 false，之后的读都返回零值。长度字段先 need 再分配，坏文件不会导致大块分配
+struct Reader {
+    const std::vector<char>& buf;
+    size_t pos = 0;
+    bool ok = true;
+
+    bool need(size_t n)
+    {
+        if (!ok || buf.size() - pos < n) ok = false;
+        return ok;
+    }
+
+    template <typename T>
+    T pod()
+    {
+        T v{};
+        if (need(sizeof(v))) {
+            std::memcpy(&v, buf.data() + pos, sizeof(v));
+            pos += sizeof(v);
+        }
+        return v;
+    }
+
+    void raw(char* p, size_t n)
+    {
+        if (!need(n)) return;
+        std::memcpy(p, buf.data() + pos, n);
+        pos += n;
+    }
+};
+
+} // namespace
+
+bool BtHashCache::open(const std::string& path)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_path = path;
+    m_files.clear();
+    m_dirty = false;
+
+    std::vector<char> buf;
+    if (!bt_read_file(path, buf)) return true;
+
+    Reader r{buf};
+    char magic[4] = {};
+    r.raw(magic, sizeof(magic));
+    uint32_t version = r.pod<uint32_t>();
+    uint32_t count = r.pod<uint32_t>();
+    if (!r.ok || std::memcmp(magic, kMagic, sizeof(magic)) != 0 || version != kVersion) return false;
+
+    for (uint32_t i = 0; i < count && r.ok; ++i) {
+        uint32_t len = r.pod<uint32_t>();
+        if (!r.need(len)) break;
+        std::string file(r.buf.data() + r.pos, len);
+        r.pos += len;
+
+        BtFileHashes h;
+        h.size = r.pod<int64_t>();
+        h.mtime_ns = r.pod<int64_t>();
+        h.ino = r.pod<uint64_t>();
+        h.piece_len = r.pod<int32_t>();
+        h.tail_len = r.pod<int32_t>();
+        uint32_t n2 = r.pod<uint32_t>();
+        uint32_t n1 = r.pod<uint32_t>();
+        if (!r.need(size_t(n2) * lt::sha256_hash::size() + size_t(n1) * lt::sha1_hash::size())) break;
+        h.v2.resize(n2);
+        h.v1.resize(n1);
+        for (auto& x : h.v2) r.raw(x.data(), x.size());
+        for (auto& x : h.v1) r.raw(x.data(), x.size());
+        m_files[file] = std::move(h);
+    }
+    if (!r.ok) {
+        m_files.clear();
+        return false;
+    }
+    return true;
+}
+
+bool BtHashCache::save()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (!m_dirty || m_path.empty()) return true;
+
+    std::vector<char> buf;
+    Writer w{buf};
+    w.raw(kMagic, sizeof(kMagic));
+    w.pod<uint32_t>(kVersion);
+    w.pod<uint32_t>(uint32_t(m_files.size()));
+    for (auto& kv : m_files) {
+        const BtFileHashes& h = kv.second;
+        w.pod<uint32_t>(uint32_t(kv.first.size()));
+        w.raw(kv.first.data(), kv.first.size());
+        w.pod<int64_t>(h.size);
+        w.pod<int64_t>(h.mtime_ns);
+        w.pod<uint64_t>(h.ino);
+        w.pod<int32_t>(h.piece_len);
+        w.pod<int32_t>(h.tail_len);
+        w.pod<uint32_t>(uint32_t(h.v2.size()));
+        w.pod<uint32_t>(uint32_t(h.v1.size()));
+        for (auto& x : h.v2) w.raw(x.data(), x.size());
+        for (auto& x : h.v1) w.raw(x.data(), x.size());
+    }
+
+    if (!bt_write_file_atomic(m_path, buf)) return false;
+    m_dirty = false;
+    return true;
+}
+
+bool BtHashCache::lookup(const std::string& file, BtFileHashes& out) const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto it = m_files.find(file);
+    if (it == m_files.end()) return false;
+    out = it->second;
+    return true;
+}
+
+void BtHashCache::store(const std::string& file, BtFileHashes h)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_files[file] = std::move(h);
+    m_dirty = true;
+}
+
+void BtHashCache::retain(const std::string& root, const std::unordered_set<std::string>& keep)
+{
+    std::string dir = root + "/";
+    std::lock_guard<std::mutex> guard(m_mutex);
+    for (auto it = m_files.begin(); it != m_files.end();) {
+        const std::string& f = it->first;
+        bool under = f == root || f.compare(0, dir.size(), dir) == 0;
+        if (under && !keep.count(f)) {
+            it = m_files.erase(it);
+            m_dirty = true;
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t BtHashCache::size() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_files.size();
+}
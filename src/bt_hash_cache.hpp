@@ -0,0 +1,49 @@
+// src/bt_hash_cache.hpp
+#ifndef VS_BT_HASH_CACHE_HPP
+#define VS_BT_HASH_CACHE_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../third_party/libtorrent/include/libtorrent/sha1_hash.hpp"
+
+// 一个文件在某个 piece 大小下算出的哈希。v2 / hybrid 布局里每个文件从 piece 边界开始，
+// 这些哈希只取决于文件内容，和同一 torrent 里的其他文件无关，所以可以跨 seed_folder 复用
+struct BtFileHashes {
+    int64_t  size = 0;
+    int64_t  mtime_ns = 0;
+    uint64_t ino = 0;
+    int      piece_len = 0;
+    int      tail_len = 0;      // 最后一个 v1 piece 的长度：后面有 pad 时是整 piece，torrent 末尾的文件不补齐
+    std::vector<libtorrent::sha256_hash> v2;   // 每个 piece 一项，即 set_hash2 的值
+    std::vector<libtorrent::sha1_hash>   v1;   // hybrid 才有，v2 only 时为空
+};
+
+// 按路径存的文件哈希缓存，整个读进内存，save 时先写临时文件再 rename。
+// 是否还有效由调用方比较 (大小, mtime, inode)，见 bt_hash_pieces。线程安全
+class BtHashCache {
+public:
+    // 文件不存在算空缓存；格式不对时丢弃，返回 false
+    bool open(const std::string& path);
+    bool save();
+
+    bool lookup(const std::string& file, BtFileHashes& out) const;
+    void store(const std::string& file, BtFileHashes h);
+
+    // 删掉 root（文件本身或目录下）里不在 keep 中的项，重新发布时清理已删除的文件
+    void retain(const std::string& root, const std::unordered_set<std::string>& keep);
+
+    size_t size() const;
+
+private:
+    mutable std::mutex m_mutex;
+    std::string m_path;
+    std::unordered_map<std::string, BtFileHashes> m_files;   // guarded by m_mutex
+    bool m_dirty = false;                                     // guarded by m_mutex
+};
+
+#endif // VS_BT_HASH_CACHE_HPP
@@ -0,0 +1,498 @@
+// src/bt_hasher.cpp
+#include "bt_hasher.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#ifdef VS1984_USE_OPENSSL
+#include <openssl/evp.h>
+#endif
+
+#include <libtorrent/hasher.hpp>
+#include <libtorrent/sha1_hash.hpp>
+#include <libtorrent/file_storage.hpp>
+namespace lt = libtorrent;
+
+static const int kBlockSize = 16 * 1024;  // BEP 52 叶子块大小
+static const int kMinPieceSize = 16 * 1024;
+static const int kMaxPieceSize = 16 * 1024 * 1024;
+static const int kTargetPieces = 2048;
+static const int kChunkBytes = 4 * 1024 * 1024;   // 线程每次领这么多字节的连续 piece，保持顺序读
+static const int64_t kRacyNs = 2000000000;        // mtime 离本次开始不到这么久的文件不进缓存
+
+// 顺序读 piece 时同一个文件会连续命中，缓存一个 fd 避免反复 open
+struct FileReader {
+    const lt::file_storage& fs;
+    std::string base;
+    lt::file_index_t cur{-1};
+    int fd = -1;
+
+    FileReader(const lt::file_storage& f, const std::string& b) : fs(f), base(b) {}
+    ~FileReader() { if (fd >= 0) ::close(fd); }
+
+    bool read(lt::file_index_t fi, std::int64_t off, char* buf, int len, std::string& err)
+    {
+        if (fi != cur) {
+            if (fd >= 0) ::close(fd);
+            cur = fi;
+            std::string path = fs.file_path(fi, base);
+            fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                err = "open " + path + ": " + std::strerror(errno);
+                return false;
+            }
+        }
+
+        int done = 0;
+        while (done < len) {
+            ssize_t r = ::pread(fd, buf + done, len - done, off + done);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) {
+                err = "read " + fs.file_path(fi, base) + ": " +
+                      (r == 0 ? std::string("unexpected end of file") : std::strerror(errno));
+                return false;
+            }
+            done += int(r);
+        }
+        return true;
+    }
+};
+
+// 每个线程一个。有 OpenSSL 时走 EVP，OpenSSL 运行时按 CPU 选 SHA-NI / AVX2 实现；
+// 没有时用 libtorrent 自带的 hasher
+class Digest {
+public:
+#ifdef VS1984_USE_OPENSSL
+    Digest() : m_ctx(EVP_MD_CTX_new()) {}
+    ~Digest() { EVP_MD_CTX_free(m_ctx); }
+    bool ok() const { return m_ctx != nullptr; }
+
+    lt::sha1_hash sha1(const char* p, int n)
+    {
+        lt::sha1_hash h;
+        run(EVP_sha1(), p, n, h.data());
+        return h;
+    }
+
+    lt::sha256_hash sha256(const char* p, int n)
+    {
+        lt::sha256_hash h;
+        run(EVP_sha256(), p, n, h.data());
+        return h;
+    }
+#else
+    Digest() = default;
+    bool ok() const { return true; }
+    lt::sha1_hash sha1(const char* p, int n) { return lt::hasher(p, n).final(); }
+    lt::sha256_hash sha256(const char* p, int n) { return lt::hasher256(p, n).final(); }
+#endif
+
+    Digest(const Digest&) = delete;
+    Digest& operator=(const Digest&) = delete;
+
+private:
+#ifdef VS1984_USE_OPENSSL
+    void run(const EVP_MD* md, const char* p, int n, char* out)
+    {
+        EVP_DigestInit_ex(m_ctx, md, nullptr);
+        EVP_DigestUpdate(m_ctx, p, size_t(n));
+        EVP_DigestFinal_ex(m_ctx, reinterpret_cast<unsigned char*>(out), nullptr);
+    }
+
+    EVP_MD_CTX* m_ctx;
+#endif
+};
+
+static int next_pow2(int n)
+{
+    int r = 1;
+    while (r < n) r <<= 1;
+    return r;
+}
+
+// leafs 为 2 的幂，不足部分按 BEP 52 用全零哈希补齐
+static lt::sha256_hash merkle_root(Digest& d, std::vector<lt::sha256_hash>& nodes, int leafs)
+{
+    char pair[64];
+    nodes.resize(leafs);
+    while (nodes.size() > 1) {
+        for (size_t i = 0; i < nodes.size() / 2; ++i) {
+            std::memcpy(pair, nodes[2 * i].data(), 32);
+            std::memcpy(pair + 32, nodes[2 * i + 1].data(), 32);
+            nodes[i] = d.sha256(pair, int(sizeof(pair)));
+        }
+        nodes.resize(nodes.size() / 2);
+    }
+    return nodes[0];
+}
+
+namespace {
+
+struct PieceHash {
+    lt::sha1_hash   v1;
+    lt::sha256_hash v2;                     // piece layer 里的这一项
+    lt::file_index_t file{-1};              // v2 所属文件，-1 表示没有（pad / 空文件）
+    lt::piece_index_t::diff_type local{};   // 文件内的 piece 序号
+};
+
+// 所有线程共享，结果按 piece 下标各写各的
+struct HashRun {
+    const lt::file_storage& fs;
+    std::string base;
+    bool v1 = false;
+    bool v2 = false;
+    int pieceLen = 0;
+    int numPieces = 0;
+    int chunk = 1;
+    std::vector<int> sizes;                 // ct.piece_size 不保证线程安全，先取出来
+    std::vector<int> todo;                  // 要算的 piece，升序；缓存命中的不在里面
+    const std::atomic<bool>* cancel = nullptr;
+    std::vector<PieceHash> results;
+
+    std::atomic<int>  next{0};
+    std::atomic<int>  done{0};
+    std::atomic<bool> failed{false};
+    std::mutex  errMutex;
+    std::string err;                        // guarded by errMutex，只留第一个错误
+
+    HashRun(const lt::file_storage& f, const std::string& b) : fs(f), base(b) {}
+
+    bool stopped() const
+    {
+        return failed.load(std::memory_order_relaxed) ||
+               (cancel && cancel->load(std::memory_order_relaxed));
+    }
+
+    void fail(const std::string& e)
+    {
+        std::lock_guard<std::mutex> guard(errMutex);
+        if (!failed.exchange(true)) err = e;
+    }
+};
+
+bool hash_piece(HashRun& hr, int i, FileReader& reader, Digest& d, std::vector<char>& buf,
+                std::vector<lt::sha256_hash>& blocks, std::string& err)
+{
+    const lt::file_storage& fs = hr.fs;
+    lt::piece_index_t const p(i);
+    int const size = hr.sizes[size_t(i)];
+    std::vector<lt::file_slice> slices = fs.map_block(p, 0, size);
+
+    int pos = 0;
+    for (auto const& s : slices) {
+        if (fs.pad_file_at(s.file_index)) {
+            std::memset(buf.data() + pos, 0, size_t(s.size));
+        } else if (!reader.read(s.file_index, s.offset, buf.data() + pos, int(s.size), err)) {
+            return false;
+        }
+        pos += int(s.size);
+    }
+
+    PieceHash& out = hr.results[size_t(i)];
+    if (hr.v1) out.v1 = d.sha1(buf.data(), size);
+
+    // v2 / hybrid 下文件按 piece 对齐，一个 piece 只属于一个文件（后面可能跟 pad）
+    if (hr.v2 && !slices.empty()) {
+        lt::file_index_t const fi = slices.front().file_index;
+        if (!fs.pad_file_at(fi) && fs.file_size(fi) > 0) {
+            int const data_len = int(slices.front().size);
+            blocks.clear();
+            for (int off = 0; off < data_len; off += kBlockSize) {
+                blocks.push_back(d.sha256(buf.data() + off, std::min(kBlockSize, data_len - off)));
+            }
+
+            // 小于一个 piece 的文件按自身块数补齐，否则补到整 piece
+            std::int64_t const fsize = fs.file_size(fi);
+            int const leafs = fsize < hr.pieceLen
+                ? next_pow2(int((fsize + kBlockSize - 1) / kBlockSize))
+                : hr.pieceLen / kBlockSize;
+            lt::piece_index_t const first(int(fs.file_offset(fi) / hr.pieceLen));
+            out.v2 = merkle_root(d, blocks, leafs);
+            out.file = fi;
+            out.local = p - first;
+        }
+    }
+    return true;
+}
+
+// 领一段连续的 piece 算完再领下一段；report 只有调用线程传
+void hash_worker(HashRun& hr, const std::function<void()>& report)
+{
+    FileReader reader(hr.fs, hr.base);
+    Digest d;
+    std::vector<char> buf(size_t(hr.pieceLen));
+    std::vector<lt::sha256_hash> blocks;
+    std::string err;
+
+    if (!d.ok()) {
+        hr.fail("digest init failed");
+        return;
+    }
+
+    int const total = int(hr.todo.size());
+    for (;;) {
+        int first = hr.next.fetch_add(hr.chunk, std::memory_order_relaxed);
+        if (first >= total) return;
+        int last = std::min(first + hr.chunk, total);
+        for (int j = first; j < last; ++j) {
+            if (hr.stopped()) return;
+            if (!hash_piece(hr, hr.todo[size_t(j)], reader, d, buf, blocks, err)) {
+                hr.fail(err);
+                return;
+            }
+            hr.done.fetch_add(1, std::memory_order_relaxed);
+            if (report) report();
+        }
+    }
+}
+
+// 缓存有效性按 (大小, mtime, inode) 判断，路径是缓存的 key
+struct FileStamp {
+    int64_t  size = -1;
+    int64_t  mtime_ns = 0;
+    uint64_t ino = 0;
+
+    bool operator==(const FileStamp& o) const
+    {
+        return size == o.size && mtime_ns == o.mtime_ns && ino == o.ino;
+    }
+};
+
+bool stamp_file(const std::string& path, FileStamp& out)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return false;
+    out.size = st.st_size;
+    out.mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    out.ino = uint64_t(st.st_ino);
+    return true;
+}
+
+// 没命中缓存、要读盘的文件，算完写回
+struct CacheMiss {
+    lt::file_index_t file{-1};
+    std::string path;
+    FileStamp stamp;
+    int first = 0;      // aligned 布局里文件占的 piece 段
+    int count = 0;
+};
+
+// 和 file_storage::file_path 拼法一致
+std::string join_path(const std::string& base, const std::string& name)
+{
+    if (base.empty()) return name;
+    if (base.back() == '/') return base + name;
+    return base + "/" + name;
+}
+
+// 命中的文件直接填结果并从 covered 里划掉，返回复用的 piece 数；没命中的记进 misses。
+// keep 收集这个 torrent 的所有文件路径，用来清理缓存里已经删掉的文件
+int reuse_cached(HashRun& hr, const BtHashCache& cache, std::vector<char>& covered,
+                 std::vector<CacheMiss>& misses, std::unordered_set<std::string>& keep)
+{
+    const lt::file_storage& fs = hr.fs;
+    int reused = 0;
+    BtFileHashes h;
+    for (int i = 0; i < fs.num_files(); ++i) {
+        lt::file_index_t const fi(i);
+        if (fs.pad_file_at(fi) || fs.file_size(fi) == 0) continue;
+
+        CacheMiss m;
+        m.file = fi;
+        m.path = fs.file_path(fi, hr.base);
+        m.first = int(fs.file_offset(fi) / hr.pieceLen);
+        m.count = int((fs.file_size(fi) + hr.pieceLen - 1) / hr.pieceLen);
+        keep.insert(m.path);
+
+        // add_files 之后又变了大小的不管，读盘时自然会报错
+        if (!stamp_file(m.path, m.stamp) || m.stamp.size != fs.file_size(fi)) continue;
+
+        // v1 的尾 piece 后面有没有 pad 取决于文件是不是 torrent 里最后一个，要一起比
+        int const tail = hr.sizes[size_t(m.first + m.count - 1)];
+        bool hit = cache.lookup(m.path, h)
+            && FileStamp{h.size, h.mtime_ns, h.ino} == m.stamp
+            && h.piece_len == hr.pieceLen
+            && int(h.v2.size()) == m.count
+            && (!hr.v1 || (int(h.v1.size()) == m.count && h.tail_len == tail));
+        if (!hit) {
+            misses.push_back(std::move(m));
+            continue;
+        }
+
+        for (int k = 0; k < m.count; ++k) {
+            PieceHash& out = hr.results[size_t(m.first + k)];
+            if (hr.v1) out.v1 = h.v1[size_t(k)];
+            out.v2 = h.v2[size_t(k)];
+            out.file = fi;
+            out.local = lt::piece_index_t::diff_type(k);
+            covered[size_t(m.first + k)] = 1;
+        }
+        reused += m.count;
+    }
+    return reused;
+}
+
+// 算的过程中被改过的不写回。mtime 离开始太近的也不写：mtime 精度粗的文件系统上，
+// 同一个时间粒度里再改一次 mtime 不变，下次会误判为没变
+void store_misses(const HashRun& hr, BtHashCache& cache, const std::vector<CacheMiss>& misses,
+                  int64_t started_ns)
+{
+    for (auto const& m : misses) {
+        FileStamp now;
+        if (!stamp_file(m.path, now) || !(now == m.stamp)) continue;
+        if (now.mtime_ns > started_ns - kRacyNs) continue;
+
+        BtFileHashes h;
+        h.size = now.size;
+        h.mtime_ns = now.mtime_ns;
+        h.ino = now.ino;
+        h.piece_len = hr.pieceLen;
+        h.tail_len = hr.sizes[size_t(m.first + m.count - 1)];
+        h.v2.reserve(size_t(m.count));
+        if (hr.v1) h.v1.reserve(size_t(m.count));
+        for (int k = 0; k < m.count; ++k) {
+            const PieceHash& r = hr.results[size_t(m.first + k)];
+            h.v2.push_back(r.v2);
+            if (hr.v1) h.v1.push_back(r.v1);
+        }
+        cache.store(m.path, std::move(h));
+    }
+}
+
+} // namespace
+
+bool bt_hash_pieces(lt::create_torrent& ct,
+                    const std::string& base_path,
+                    int threads,
+                    BtHashCache* cache,
+                    int* reused,
+                    const std::atomic<bool>* cancel,
+                    const std::function<void(int)>& on_progress,
+                    std::string& err)
+{
+    HashRun hr(ct.files(), base_path);
+    hr.v1 = !ct.is_v2_only();
+    hr.v2 = !ct.is_v1_only();
+    hr.pieceLen = ct.piece_length();
+    hr.numPieces = ct.num_pieces();
+    hr.chunk = std::max(1, kChunkBytes / hr.pieceLen);
+    hr.cancel = cancel;
+    hr.results.resize(size_t(hr.numPieces));
+    hr.sizes.resize(size_t(hr.numPieces));
+    for (int i = 0; i < hr.numPieces; ++i) hr.sizes[size_t(i)] = ct.piece_size(lt::piece_index_t(i));
+
+    // 只有 aligned 布局的哈希是按文件独立的
+    bool const use_cache = cache && hr.v2;
+    int64_t const started_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::vector<char> covered(size_t(hr.numPieces), 0);
+    std::vector<CacheMiss> misses;
+    std::unordered_set<std::string> keep;
+    int cached = use_cache ? reuse_cached(hr, *cache, covered, misses, keep) : 0;
+    if (reused) *reused = cached;
+
+    hr.todo.reserve(size_t(hr.numPieces - cached));
+    for (int i = 0; i < hr.numPieces; ++i) {
+        if (!covered[size_t(i)]) hr.todo.push_back(i);
+    }
+    hr.done = cached;
+    if (on_progress && cached > 0) on_progress(cached);
+
+    if (threads <= 0) threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    threads = std::max(1, std::min(threads, int(hr.todo.size() + hr.chunk - 1) / hr.chunk));
+
+    // 调用线程自己也干活，顺便报进度
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; ++t) {
+        workers.emplace_back(hash_worker, std::ref(hr), std::function<void()>());
+    }
+    std::function<void()> report;
+    if (on_progress) report = [&] { on_progress(hr.done.load(std::memory_order_relaxed)); };
+    hash_worker(hr, report);
+    for (auto& w : workers) w.join();
+    if (on_progress) on_progress(hr.done.load());
+
+    if (cancel && cancel->load()) {
+        err = "cancelled";
+        return false;
+    }
+    if (hr.failed.load()) {
+        err = hr.err;
+        return false;
+    }
+
+    for (int i = 0; i < hr.numPieces; ++i) {
+        const PieceHash& r = hr.results[size_t(i)];
+        if (hr.v1) ct.set_hash(lt::piece_index_t(i), r.v1);
+        if (hr.v2 && r.file != lt::file_index_t(-1)) ct.set_hash2(r.file, r.local, r.v2);
+    }
+
+    if (use_cache) {
+        store_misses(hr, *cache, misses, started_ns);
+        cache->retain(join_path(base_path, hr.fs.name()), keep);
+    }
+    return true;
+}
+
+int bt_auto_piece_size(const lt::file_storage& fs, bool aligned)
+{
+    auto pieces_for = [&](int64_t piece) {
+        if (!aligned) return (fs.total_size() + piece - 1) / piece;
+        int64_t n = 0;
+        for (int i = 0; i < fs.num_files(); ++i) {
+            lt::file_index_t fi(i);
+            if (fs.pad_file_at(fi)) continue;
+            n += (fs.file_size(fi) + piece - 1) / piece;
+        }
+        return n;
+    };
+
+    int piece = kMinPieceSize;
+    int64_t n = pieces_for(piece);
+    while (piece < kMaxPieceSize && n > kTargetPieces) {
+        int64_t next = pieces_for(int64_t(piece) * 2);
+        if (next * 10 > n * 9) break;   // 少不到一成，都是小文件的下限了
+        piece *= 2;
+        n = next;
+    }
+    return piece;
+}
+
+const char* bt_hasher_backend()
+{
+    static const std::string name = [] {
+        std::string s;
+#ifdef VS1984_USE_OPENSSL
+        s = "openssl";
+#else
+        s = "libtorrent";
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned a = 0, b = 0, c = 0, d = 0;
+        bool sha = false, avx2 = false;
+        if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+            sha = (b >> 29) & 1;
+            avx2 = (b >> 5) & 1;
+        }
+        s += " (cpu:";
+        s += sha ? " sha_ni" : "";
+        s += avx2 ? " avx2" : "";
+        s += (sha || avx2) ? ")" : " none)";
+#endif
+        return s;
+    }();
+    return name.c_str();
+}
@@ -0,0 +1,40 @@
+// src/bt_hasher.hpp
+#ifndef VS_BT_HASHER_HPP
+#define VS_BT_HASHER_HPP
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include "../third_party/libtorrent/include/libtorrent/create_torrent.hpp"
+#include "../third_party/libtorrent/include/libtorrent/file_storage.hpp"
+
+#include "bt_hash_cache.hpp"
+
+// 计算 create_torrent 的分片哈希，替代 lt::set_piece_hashes。
+// 支持 v1 / v2 / hybrid，可以随时取消。base_path 是 ct.files() 里相对路径的父目录。
+// threads 个线程按连续的 piece 段分工读盘和哈希（<= 0 时用所有核），
+// 结果最后在调用线程里统一 set_hash / set_hash2。
+// on_progress(已完成 piece 数) 只在调用线程里回调。
+// cache 非空且是 v2 / hybrid 布局时增量计算：(路径, 大小, mtime, inode) 都没变的文件直接用缓存，
+// 只读新增或改过的文件，成功后写回 cache（不 save）。v1 only 的 piece 跨文件，不用缓存。
+// reused 非空时返回直接用缓存的 piece 数。
+// 成功返回 true；取消或出错返回 false，原因写入 err。
+bool bt_hash_pieces(libtorrent::create_torrent& ct,
+                    const std::string& base_path,
+                    int threads,
+                    BtHashCache* cache,
+                    int* reused,
+                    const std::atomic<bool>* cancel,
+                    const std::function<void(int)>& on_progress,
+                    std::string& err);
+
+// 自动选 piece 大小：16 KiB ~ 16 MiB 的 2 的幂，取 piece 数不超过 2048 的最小值，
+// 控制 .torrent 大小。aligned（v2 / hybrid）时每个文件从 piece 边界开始，
+// 小文件多时再加倍几乎减不了 piece 数，只会增加填充，这时提前停下
+int bt_auto_piece_size(const libtorrent::file_storage& fs, bool aligned);
+
+// 实际使用的哈希实现，如 "openssl (sha_ni avx2)"，启动时打日志用
+const char* bt_hasher_backend();
+
+#endif // VS_BT_HASHER_HPP
@@ -0,0 +1,71 @@
+// src/bt_infohash.cpp
+#include "bt_infohash.hpp"
+
+#include <libtorrent/sha1_hash.hpp>
+namespace lt = libtorrent;
+
+std::string BtInfoHash::toHex() const
+{
+    static const char* hex = "0123456789abcdef";
+
+    std::string out;
+    out.resize(size_t(len) * 2);
+    for (size_t i = 0; i < len; ++i) {
+        out[2 * i]     = hex[bytes[i] >> 4];
+        out[2 * i + 1] = hex[bytes[i] & 0x0F];
+    }
+    return out;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool BtInfoHash::fromHex(const std::string& hex, BtInfoHash& out)
+{
+    if (hex.size() != 40 && hex.size() != 64) return false;
+
+    BtInfoHash k;
+    k.len = uint8_t(hex.size() / 2);
+    for (size_t i = 0; i < k.len; ++i) {
+        int hi = hex_value(hex[2 * i]);
+        int lo = hex_value(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        k.bytes[i] = uint8_t((hi << 4) | lo);
+    }
+    out = k;
+    return true;
+}
+
+BtInfoHash BtInfoHash::fromV1(const lt::sha1_hash& h)
+{
+    BtInfoHash k;
+    k.len = 20;
+    std::memcpy(k.bytes, h.data(), 20);
+    return k;
+}
+
+BtInfoHash BtInfoHash::fromV2(const lt::sha256_hash& h)
+{
+    BtInfoHash k;
+    k.len = 32;
+    std::memcpy(k.bytes, h.data(), 32);
+    return k;
+}
+
+BtInfoHash bt_primary_key(const lt::info_hash_t& ih)
+{
+    if (ih.has_v1()) return BtInfoHash::fromV1(ih.v1);
+    if (ih.has_v2()) return BtInfoHash::fromV2(ih.v2);
+    return BtInfoHash();
+}
+
+BtInfoHash bt_alias_key(const lt::info_hash_t& ih)
+{
+    if (ih.has_v1() && ih.has_v2()) return BtInfoHash::fromV2(ih.v2);
+    return BtInfoHash();
+}
@@ -0,0 +1,164 @@
+// src/bt_infohash.hpp
+#ifndef VS_BT_INFOHASH_HPP
+#define VS_BT_INFOHASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../third_party/libtorrent/include/libtorrent/info_hash.hpp"
+
+// 二进制 infohash：v1 为 20 字节 SHA-1，v2 为 32 字节 SHA-256，len == 0 表示空。
+// 内部一律用它做 key，只在对外接口处和 hex 互转。
+struct BtInfoHash {
+    uint8_t len = 0;
+    uint8_t bytes[32] = {};
+
+    bool empty() const { return len == 0; }
+
+    bool operator==(const BtInfoHash& o) const
+    {
+        return len == o.len && std::memcmp(bytes, o.bytes, len) == 0;
+    }
+    bool operator!=(const BtInfoHash& o) const { return !(*this == o); }
+
+    // 本身就是密码学哈希，取前 8 字节即可
+    size_t hash() const
+    {
+        uint64_t h;
+        std::memcpy(&h, bytes, sizeof(h));
+        return size_t(h ^ len);
+    }
+
+    std::string toHex() const;
+    // 接受 40 位（v1）或 64 位（v2）hex，大小写均可
+    static bool fromHex(const std::string& hex, BtInfoHash& out);
+
+    static BtInfoHash fromV1(const libtorrent::sha1_hash& h);
+    static BtInfoHash fromV2(const libtorrent::sha256_hash& h);
+};
+
+// torrent 的主 key：有 v1 用 v1（兼容旧的 40 位 hex），v2-only 用 v2
+BtInfoHash bt_primary_key(const libtorrent::info_hash_t& ih);
+// hybrid torrent 的 v2 别名，其它情况为空
+BtInfoHash bt_alias_key(const libtorrent::info_hash_t& ih);
+
+inline std::string bt_infohash_hex(const libtorrent::info_hash_t& ih)
+{
+    return bt_primary_key(ih).toHex();
+}
+
+// 以 BtInfoHash 为 key 的开放寻址哈希表（线性探测，删除时回移，不留墓碑）。
+// 不是线程安全的，并发访问由调用方加锁。
+template <typename V>
+class BtInfoHashMap {
+public:
+    struct Entry {
+        BtInfoHash key;
+        V value;
+    };
+
+    BtInfoHashMap() = default;
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    V* find(const BtInfoHash& key)
+    {
+        if (m_size == 0 || key.empty()) return nullptr;
+        for (size_t i = key.hash() & m_mask;; i = (i + 1) & m_mask) {
+            Entry& e = m_cells[i];
+            if (e.key.empty()) return nullptr;
+            if (e.key == key) return &e.value;
+        }
+    }
+
+    const V* find(const BtInfoHash& key) const
+    {
+        return const_cast<BtInfoHashMap*>(this)->find(key);
+    }
+
+    bool contains(const BtInfoHash& key) const { return find(key) != nullptr; }
+
+    // 已存在时覆盖
+    V& insert(const BtInfoHash& key, V value)
+    {
+        if ((m_size + 1) * 4 > m_cells.size() * 3) grow();
+        for (size_t i = key.hash() & m_mask;; i = (i + 1) & m_mask) {
+            Entry& e = m_cells[i];
+            if (e.key.empty()) {
+                e.key = key;
+                e.value = std::move(value);
+                ++m_size;
+                return e.value;
+            }
+            if (e.key == key) {
+                e.value = std::move(value);
+                return e.value;
+            }
+        }
+    }
+
+    bool erase(const BtInfoHash& key)
+    {
+        if (m_size == 0 || key.empty()) return false;
+        size_t i = key.hash() & m_mask;
+        for (;; i = (i + 1) & m_mask) {
+            if (m_cells[i].key.empty()) return false;
+            if (m_cells[i].key == key) break;
+        }
+
+        // 把后面探测链上的条目往前挪，保持查找不断链
+        for (size_t j = (i + 1) & m_mask;; j = (j + 1) & m_mask) {
+            Entry& e = m_cells[j];
+            if (e.key.empty()) break;
+            size_t home = e.key.hash() & m_mask;
+            bool movable = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+            if (movable) {
+                m_cells[i] = std::move(e);
+                i = j;
+            }
+        }
+        m_cells[i] = Entry();
+        --m_size;
+        return true;
+    }
+
+    void clear()
+    {
+        m_cells.clear();
+        m_mask = 0;
+        m_size = 0;
+    }
+
+    template <typename F>
+    void forEach(F&& f)
+    {
+        for (auto& e : m_cells) {
+            if (!e.key.empty()) f(e.key, e.value);
+        }
+    }
+
+private:
+    void grow()
+    {
+        size_t cap = m_cells.empty() ? 16 : m_cells.size() * 2;
+        std::vector<Entry> old;
+        old.swap(m_cells);
+        m_cells.resize(cap);
+        m_mask = cap - 1;
+        m_size = 0;
+        for (auto& e : old) {
+            if (!e.key.empty()) insert(e.key, std::move(e.value));
+        }
+    }
+
+    std::vector<Entry> m_cells;
+    size_t m_mask = 0;
+    size_t m_size = 0;
+};
+
+#endif // VS_BT_INFOHASH_HPP
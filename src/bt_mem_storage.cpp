@@ -0,0 +1,336 @@
+// src/bt_mem_storage.cpp
+#include "bt_mem_storage.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <libtorrent/aux_/vector.hpp>
+#include <libtorrent/disk_buffer_holder.hpp>
+#include <libtorrent/disk_interface.hpp>
+#include <libtorrent/error_code.hpp>
+#include <libtorrent/file_storage.hpp>
+#include <libtorrent/hasher.hpp>
+#include <libtorrent/io_context.hpp>
+#include <libtorrent/storage_defs.hpp>
+namespace lt = libtorrent;
+
+// 不会真的去访问，只用来区分路由；绝对路径，libtorrent 不会再拼当前目录
+const char kBtMemSavePath[] = "/.vs1984-mem";
+
+namespace {
+
+lt::storage_error make_error(int err, lt::operation_t op)
+{
+    lt::storage_error se;
+    se.ec = lt::error_code(err, lt::generic_category());
+    se.operation = op;
+    return se;
+}
+
+// 一个 torrent 的数据，piece -> 整块缓冲；只在网络线程里访问
+struct MemTorrent {
+    explicit MemTorrent(const lt::file_storage& fs) : files(fs) {}
+
+    const lt::file_storage& files;      // 属于 torrent，比 storage 活得久
+    std::map<lt::piece_index_t, std::vector<char>> pieces;
+    int64_t bytes = 0;
+
+    const std::vector<char>* piece(lt::piece_index_t p) const
+    {
+        auto it = pieces.find(p);
+        return it == pieces.end() ? nullptr : &it->second;
+    }
+
+    // 第一次写到某个 piece 时整块分配，超过上限返回 false
+    bool write(const lt::peer_request& r, const char* buf, BtMemUsage& usage)
+    {
+        auto it = pieces.find(r.piece);
+        if (it == pieces.end()) {
+            int size = files.piece_size(r.piece);
+            if (usage.used.load(std::memory_order_relaxed) + size > usage.cap) return false;
+            usage.used.fetch_add(size, std::memory_order_relaxed);
+            bytes += size;
+            it = pieces.emplace(r.piece, std::vector<char>(size_t(size))).first;
+        }
+        if (r.start < 0 || r.start + r.length > int(it->second.size())) return false;
+        std::memcpy(it->second.data() + r.start, buf, size_t(r.length));
+        return true;
+    }
+
+    void clear(lt::piece_index_t p, BtMemUsage& usage)
+    {
+        auto it = pieces.find(p);
+        if (it == pieces.end()) return;
+        usage.used.fetch_sub(int64_t(it->second.size()), std::memory_order_relaxed);
+        bytes -= int64_t(it->second.size());
+        pieces.erase(it);
+    }
+
+    void clearAll(BtMemUsage& usage)
+    {
+        usage.used.fetch_sub(bytes, std::memory_order_relaxed);
+        bytes = 0;
+        pieces.clear();
+    }
+};
+
+// 按 storage 路由：内存 torrent 自己处理，其余原样转给后端。
+// libtorrent 只在网络线程里调用磁盘接口，内存部分不需要加锁，
+// 回调也 post 回网络线程，和后端的完成顺序无关
+class BtMemDiskIo final : public lt::disk_interface, public lt::buffer_allocator_interface {
+public:
+    BtMemDiskIo(lt::io_context& ioc, std::unique_ptr<lt::disk_interface> backend,
+                std::shared_ptr<BtMemUsage> usage)
+        : m_ioc(ioc), m_backend(std::move(backend)), m_usage(std::move(usage)) {}
+
+    lt::storage_holder new_torrent(lt::storage_params const& p, std::shared_ptr<void> const& torrent) override
+    {
+        Slot s;
+        if (p.path == kBtMemSavePath) s.mem = std::make_unique<MemTorrent>(p.files);
+        else s.backend = m_backend->new_torrent(p, torrent);
+
+        int idx;
+        if (m_free.empty()) {
+            idx = int(m_slots.size());
+            m_slots.push_back(std::move(s));
+        } else {
+            idx = m_free.back();
+            m_free.pop_back();
+            m_slots[size_t(idx)] = std::move(s);
+        }
+        return lt::storage_holder(lt::storage_index_t(idx), *this);
+    }
+
+    void remove_torrent(lt::storage_index_t st) override
+    {
+        Slot& s = slot(st);
+        if (s.mem) s.mem->clearAll(*m_usage);
+        s = Slot{};     // 后端的 storage_holder 析构时从后端移除
+        m_free.push_back(static_cast<int>(st));
+    }
+
+    // 拷贝一份交出去：torrent 随时可能被淘汰，不能把内部缓冲借给 libtorrent
+    void async_read(lt::storage_index_t st, lt::peer_request const& r,
+                    std::function<void(lt::disk_buffer_holder, lt::storage_error const&)> handler,
+                    lt::disk_job_flags_t flags) override
+    {
+        MemTorrent* t = mem(st);
+        if (!t) {
+            m_backend->async_read(backendIndex(st), r, std::move(handler), flags);
+            return;
+        }
+
+        lt::storage_error se;
+        char* buf = nullptr;
+        const std::vector<char>* data = t->piece(r.piece);
+        if (!data || r.start < 0 || r.start + r.length > int(data->size())) {
+            se = make_error(ENODATA, lt::operation_t::file_read);
+        } else if (!(buf = static_cast<char*>(std::malloc(size_t(r.length))))) {
+            se = make_error(ENOMEM, lt::operation_t::file_read);
+        } else {
+            std::memcpy(buf, data->data() + r.start, size_t(r.length));
+        }
+        int len = buf ? r.length : 0;
+        post(m_ioc, [this, handler, buf, len, se] { handler(lt::disk_buffer_holder(*this, buf, len), se); });
+    }
+
+    bool async_write(lt::storage_index_t st, lt::peer_request const& r, char const* buf,
+                     std::shared_ptr<lt::disk_observer> o,
+                     std::function<void(lt::storage_error const&)> handler,
+                     lt::disk_job_flags_t flags) override
+    {
+        MemTorrent* t = mem(st);
+        if (!t) return m_backend->async_write(backendIndex(st), r, buf, std::move(o), std::move(handler), flags);
+
+        lt::storage_error se;
+        if (!t->write(r, buf, *m_usage)) se = make_error(ENOSPC, lt::operation_t::file_write);
+        post(m_ioc, [handler, se] { handler(se); });
+        return false;
+    }
+
+    void async_hash(lt::storage_index_t st, lt::piece_index_t piece, lt::span<lt::sha256_hash> v2,
+                    lt::disk_job_flags_t flags,
+                    std::function<void(lt::piece_index_t, lt::sha1_hash const&, lt::storage_error const&)> handler) override
+    {
+        MemTorrent* t = mem(st);
+        if (!t) {
+            m_backend->async_hash(backendIndex(st), piece, v2, flags, std::move(handler));
+            return;
+        }
+
+        lt::storage_error se;
+        lt::sha1_hash h;
+        const std::vector<char>* data = t->piece(piece);
+        if (!data) {
+            se = make_error(ENODATA, lt::operation_t::file_read);
+        } else {
+            if (flags & lt::disk_interface::v1_hash) h = lt::hasher(data->data(), int(data->size())).final();
+            // v2 按 16 KiB 块哈希，piece_size2 不含 v1 的对齐填充
+            int size2 = t->files.piece_size2(piece);
+            for (int k = 0; k < int(v2.size()); ++k) {
+                int off = k * lt::default_block_size;
+                if (off >= size2) break;
+                v2[k] = lt::hasher256(data->data() + off, std::min(lt::default_block_size, size2 - off)).final();
+            }
+        }
+        post(m_ioc, [handler, piece, h, se] { handler(piece, h, se); });
+    }
+
+    void async_hash2(lt::storage_index_t st, lt::piece_index_t piece, int offset, lt::disk_job_flags_t flags,
+                     std::function<void(lt::piece_index_t, lt::sha256_hash const&, lt::storage_error const&)> handler) override
+    {
+        MemTorrent* t = mem(st);
+        if (!t) {
+            m_backend->async_hash2(backendIndex(st), piece, offset, flags, std::move(handler));
+            return;
+        }
+
+        lt::storage_error se;
+        lt::sha256_hash h;
+        const std::vector<char>* data = t->piece(piece);
+        int size2 = t->files.piece_size2(piece);
+        if (!data || offset < 0 || offset >= size2) {
+            se = make_error(ENODATA, lt::operation_t::file_read);
+        } else {
+            h = lt::hasher256(data->data() + offset, std::min(lt::default_block_size, size2 - offset)).final();
+        }
+        post(m_ioc, [handler, piece, h, se] { handler(piece, h, se); });
+    }
+
+    void async_move_storage(lt::storage_index_t st, std::string p, lt::move_flags_t flags,
+                            std::function<void(lt::status_t, std::string const&, lt::storage_error const&)> handler) override
+    {
+        if (!mem(st)) {
+            m_backend->async_move_storage(backendIndex(st), std::move(p), flags, std::move(handler));
+            return;
+        }
+        lt::storage_error se = make_error(ENOTSUP, lt::operation_t::file_write);
+        post(m_ioc, [handler, p, se] { handler(lt::status_t::fatal_disk_error, p, se); });
+    }
+
+    void async_release_files(lt::storage_index_t st, std::function<void()> handler) override
+    {
+        if (!mem(st)) {
+            m_backend->async_release_files(backendIndex(st), std::move(handler));
+            return;
+        }
+        if (handler) post(m_ioc, handler);
+    }
+
+    // 内存里没有旧数据可查，也不保存 resume data，直接当作空 torrent
+    void async_check_files(lt::storage_index_t st, lt::add_torrent_params const* resume_data,
+                           lt::aux::vector<std::string, lt::file_index_t> links,
+                           std::function<void(lt::status_t, lt::storage_error const&)> handler) override
+    {
+        if (!mem(st)) {
+            m_backend->async_check_files(backendIndex(st), resume_data, std::move(links), std::move(handler));
+            return;
+        }
+        post(m_ioc, [handler] { handler(lt::status_t::no_error, lt::storage_error()); });
+    }
+
+    void async_stop_torrent(lt::storage_index_t st, std::function<void()> handler) override
+    {
+        if (!mem(st)) {
+            m_backend->async_stop_torrent(backendIndex(st), std::move(handler));
+            return;
+        }
+        if (handler) post(m_ioc, handler);
+    }
+
+    void async_rename_file(lt::storage_index_t st, lt::file_index_t index, std::string name,
+                           std::function<void(std::string const&, lt::file_index_t, lt::storage_error const&)> handler) override
+    {
+        if (!mem(st)) {
+            m_backend->async_rename_file(backendIndex(st), index, std::move(name), std::move(handler));
+            return;
+        }
+        post(m_ioc, [handler, name, index] { handler(name, index, lt::storage_error()); });
+    }
+
+    // 释放在这里同步完成，torrent_deleted_alert 到达时用量已经降下来
+    void async_delete_files(lt::storage_index_t st, lt::remove_flags_t options,
+                            std::function<void(lt::storage_error const&)> handler) override
+    {
+        MemTorrent* t = mem(st);
+        if (!t) {
+            m_backend->async_delete_files(backendIndex(st), options, std::move(handler));
+            return;
+        }
+        t->clearAll(*m_usage);
+        post(m_ioc, [handler] { handler(lt::storage_error()); });
+    }
+
+    // 内存里按 piece 存，文件优先级不影响存放
+    void async_set_file_priority(lt::storage_index_t st, lt::aux::vector<lt::download_priority_t, lt::file_index_t> prio,
+                                 std::function<void(lt::storage_error const&,
+                                                    lt::aux::vector<lt::download_priority_t, lt::file_index_t>)> handler) override
+    {
+        if (!mem(st)) {
+            m_backend->async_set_file_priority(backendIndex(st), std::move(prio), std::move(handler));
+            return;
+        }
+        post(m_ioc, [handler, prio]() mutable { handler(lt::storage_error(), std::move(prio)); });
+    }
+
+    // 哈希失败的 piece 会走这里，释放后重新下载时再分配
+    void async_clear_piece(lt::storage_index_t st, lt::piece_index_t index,
+                           std::function<void(lt::piece_index_t)> handler) override
+    {
+        MemTorrent* t = mem(st);
+        if (!t) {
+            m_backend->async_clear_piece(backendIndex(st), index, std::move(handler));
+            return;
+        }
+        t->clear(index, *m_usage);
+        post(m_ioc, [handler, index] { handler(index); });
+    }
+
+    void update_stats_counters(lt::counters& c) const override { m_backend->update_stats_counters(c); }
+
+    std::vector<lt::open_file_state> get_status(lt::storage_index_t st) const override
+    {
+        const Slot& s = m_slots[size_t(static_cast<int>(st))];
+        if (s.mem) return {};
+        return m_backend->get_status(s.backend.index());
+    }
+
+    void abort(bool wait) override { m_backend->abort(wait); }
+    void submit_jobs() override { m_backend->submit_jobs(); }
+    void settings_updated() override { m_backend->settings_updated(); }
+
+    void free_disk_buffer(char* buf) override { std::free(buf); }
+
+private:
+    struct Slot {
+        std::unique_ptr<MemTorrent> mem;
+        lt::storage_holder backend;     // 非内存 torrent 在后端里的 storage
+    };
+
+    Slot& slot(lt::storage_index_t st) { return m_slots[size_t(static_cast<int>(st))]; }
+    MemTorrent* mem(lt::storage_index_t st) { return slot(st).mem.get(); }
+    lt::storage_index_t backendIndex(lt::storage_index_t st) { return slot(st).backend.index(); }
+
+    lt::io_context& m_ioc;
+    std::unique_ptr<lt::disk_interface> m_backend;
+    std::shared_ptr<BtMemUsage> m_usage;
+    std::vector<Slot> m_slots;          // 下标即对 libtorrent 的 storage_index_t
+    std::vector<int> m_free;
+};
+
+} // namespace
+
+void bt_mem_storage_setup(std::shared_ptr<BtMemUsage> usage, lt::session_params& params)
+{
+    lt::disk_io_constructor_type backend = params.disk_io_constructor
+        ? params.disk_io_constructor : lt::disk_io_constructor_type(lt::default_disk_io_constructor);
+    params.disk_io_constructor = [backend, usage](lt::io_context& ioc, lt::settings_interface const& sett,
+                                                  lt::counters& cnt) -> std::unique_ptr<lt::disk_interface> {
+        return std::make_unique<BtMemDiskIo>(ioc, backend(ioc, sett, cnt), usage);
+    };
+}
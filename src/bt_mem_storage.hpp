@@ -0,0 +1,28 @@
+// src/bt_mem_storage.hpp
+#ifndef VS_BT_MEM_STORAGE_HPP
+#define VS_BT_MEM_STORAGE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "../third_party/libtorrent/include/libtorrent/session_params.hpp"
+
+// 内存存储：save_path 为 kBtMemSavePath 的 torrent 数据只放在内存里，不落盘，
+// 其余 torrent 照常交给配置的磁盘后端。适合拿到就交给调用方、随后删除的小文件。
+// 数据按整 piece 分配，torrent 删除（或 delete_files）时释放；
+// 总量超过 cap 时写入失败（ENOSPC），腾地方由 BtCore 淘汰已完成的 torrent
+extern const char kBtMemSavePath[];
+
+// 网络线程记账，BT 线程只读
+struct BtMemUsage {
+    explicit BtMemUsage(int64_t cap_bytes) : cap(cap_bytes) {}
+    const int64_t cap;
+    std::atomic<int64_t> used{0};
+};
+
+// 在 params.disk_io_constructor（为空时用默认后端）外面包一层内存存储，
+// 要在 bt_disk_io_setup 之后调用
+void bt_mem_storage_setup(std::shared_ptr<BtMemUsage> usage, libtorrent::session_params& params);
+
+#endif // VS_BT_MEM_STORAGE_HPP
@@ -0,0 +1,339 @@
+// src/bt_msgpack.c
+#include "bt_msgpack.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BT_MP_MAX_DEPTH 32
+
+void bt_mp_init(BtMpBuf *b, char *stack_buf, size_t stack_cap)
+{
+    b->data = stack_buf;
+    b->len = 0;
+    b->cap = stack_buf ? stack_cap : 0;
+    b->heap = 0;
+    b->failed = 0;
+}
+
+void bt_mp_free(BtMpBuf *b)
+{
+    if (b->heap) free(b->data);
+    b->data = NULL;
+    b->len = b->cap = 0;
+    b->heap = 0;
+}
+
+static int mp_reserve(BtMpBuf *b, size_t n)
+{
+    if (b->failed) return -1;
+    if (b->len + n <= b->cap) return 0;
+
+    size_t cap = b->cap ? b->cap * 2 : 256;
+    while (cap < b->len + n) cap *= 2;
+
+    char *p;
+    if (b->heap) {
+        p = realloc(b->data, cap);
+    } else {
+        p = malloc(cap);
+        if (p && b->len) memcpy(p, b->data, b->len);
+    }
+    if (!p) {
+        b->failed = 1;
+        return -1;
+    }
+    b->data = p;
+    b->cap = cap;
+    b->heap = 1;
+    return 0;
+}
+
+static void mp_put(BtMpBuf *b, const void *p, size_t n)
+{
+    if (mp_reserve(b, n) != 0) return;
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void mp_u8(BtMpBuf *b, uint8_t v) { mp_put(b, &v, 1); }
+
+static void mp_be16(BtMpBuf *b, uint8_t tag, uint16_t v)
+{
+    uint8_t s[3] = { tag, (uint8_t)(v >> 8), (uint8_t)v };
+    mp_put(b, s, sizeof(s));
+}
+
+static void mp_be32(BtMpBuf *b, uint8_t tag, uint32_t v)
+{
+    uint8_t s[5] = { tag, (uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v };
+    mp_put(b, s, sizeof(s));
+}
+
+static void mp_be64(BtMpBuf *b, uint8_t tag, uint64_t v)
+{
+    uint8_t s[9];
+    s[0] = tag;
+    for (int i = 0; i < 8; i++) s[1 + i] = (uint8_t)(v >> (56 - 8 * i));
+    mp_put(b, s, sizeof(s));
+}
+
+void bt_mp_map(BtMpBuf *b, uint32_t n)
+{
+    if (n < 16)          mp_u8(b, (uint8_t)(0x80 | n));
+    else if (n < 65536)  mp_be16(b, 0xde, (uint16_t)n);
+    else                 mp_be32(b, 0xdf, n);
+}
+
+void bt_mp_array(BtMpBuf *b, uint32_t n)
+{
+    if (n < 16)          mp_u8(b, (uint8_t)(0x90 | n));
+    else if (n < 65536)  mp_be16(b, 0xdc, (uint16_t)n);
+    else                 mp_be32(b, 0xdd, n);
+}
+
+void bt_mp_strn(BtMpBuf *b, const char *s, size_t n)
+{
+    if (n < 32) {
+        mp_u8(b, (uint8_t)(0xa0 | n));
+    } else if (n < 256) {
+        uint8_t h[2] = { 0xd9, (uint8_t)n };
+        mp_put(b, h, 2);
+    } else if (n < 65536) {
+        mp_be16(b, 0xda, (uint16_t)n);
+    } else {
+        mp_be32(b, 0xdb, (uint32_t)n);
+    }
+    mp_put(b, s, n);
+}
+
+void bt_mp_bin(BtMpBuf *b, const void *data, size_t n)
+{
+    if (n < 256) {
+        uint8_t h[2] = { 0xc4, (uint8_t)n };
+        mp_put(b, h, 2);
+    } else if (n < 65536) {
+        mp_be16(b, 0xc5, (uint16_t)n);
+    } else {
+        mp_be32(b, 0xc6, (uint32_t)n);
+    }
+    mp_put(b, data, n);
+}
+
+void bt_mp_str(BtMpBuf *b, const char *s)
+{
+    if (!s) s = "";
+    bt_mp_strn(b, s, strlen(s));
+}
+
+void bt_mp_int(BtMpBuf *b, int64_t v)
+{
+    if (v >= 0) {
+        if (v < 128)                 mp_u8(b, (uint8_t)v);
+        else if (v < 256)            { uint8_t h[2] = { 0xcc, (uint8_t)v }; mp_put(b, h, 2); }
+        else if (v < 65536)          mp_be16(b, 0xcd, (uint16_t)v);
+        else if (v <= 0xffffffffLL)  mp_be32(b, 0xce, (uint32_t)v);
+        else                         mp_be64(b, 0xcf, (uint64_t)v);
+    } else {
+        if (v >= -32)                mp_u8(b, (uint8_t)(int8_t)v);
+        else if (v >= -128)          { uint8_t h[2] = { 0xd0, (uint8_t)(int8_t)v }; mp_put(b, h, 2); }
+        else if (v >= -32768)        mp_be16(b, 0xd1, (uint16_t)(int16_t)v);
+        else if (v >= INT32_MIN)     mp_be32(b, 0xd2, (uint32_t)(int32_t)v);
+        else                         mp_be64(b, 0xd3, (uint64_t)v);
+    }
+}
+
+void bt_mp_float(BtMpBuf *b, float v)
+{
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    mp_be32(b, 0xca, u);
+}
+
+void bt_mp_double(BtMpBuf *b, double v)
+{
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    mp_be64(b, 0xcb, u);
+}
+
+void bt_mp_bool(BtMpBuf *b, int v) { mp_u8(b, v ? 0xc3 : 0xc2); }
+void bt_mp_nil(BtMpBuf *b)         { mp_u8(b, 0xc0); }
+
+void bt_mp_from_cjson(BtMpBuf *b, const cJSON *item)
+{
+    if (!item || cJSON_IsNull(item)) {
+        bt_mp_nil(b);
+    } else if (cJSON_IsBool(item)) {
+        bt_mp_bool(b, cJSON_IsTrue(item));
+    } else if (cJSON_IsNumber(item)) {
+        double d = item->valuedouble;
+        if (d >= -9.2e18 && d <= 9.2e18 && (double)(int64_t)d == d) bt_mp_int(b, (int64_t)d);
+        else                                               bt_mp_double(b, d);
+    } else if (cJSON_IsString(item)) {
+        bt_mp_str(b, item->valuestring);
+    } else if (cJSON_IsArray(item) || cJSON_IsObject(item)) {
+        int obj = cJSON_IsObject(item);
+        uint32_t n = (uint32_t)cJSON_GetArraySize(item);
+        if (obj) bt_mp_map(b, n);
+        else     bt_mp_array(b, n);
+
+        const cJSON *it = NULL;
+        cJSON_ArrayForEach(it, item) {
+            if (obj) bt_mp_str(b, it->string);
+            bt_mp_from_cjson(b, it);
+        }
+    } else {
+        bt_mp_nil(b);
+    }
+}
+
+int bt_mp_is_map(const char *data, size_t len)
+{
+    if (len == 0) return 0;
+    uint8_t c = (uint8_t)data[0];
+    return (c & 0xf0) == 0x80 || c == 0xde || c == 0xdf;
+}
+
+/* ---------- 解码 ---------- */
+
+typedef struct MpReader {
+    const uint8_t *p;
+    const uint8_t *end;
+} MpReader;
+
+static int rd_bytes(MpReader *r, size_t n, const uint8_t **out)
+{
+    if ((size_t)(r->end - r->p) < n) return -1;
+    *out = r->p;
+    r->p += n;
+    return 0;
+}
+
+static int rd_uint(MpReader *r, int bytes, uint64_t *out)
+{
+    const uint8_t *s;
+    if (rd_bytes(r, (size_t)bytes, &s) != 0) return -1;
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) v = (v << 8) | s[i];
+    *out = v;
+    return 0;
+}
+
+static cJSON *rd_value(MpReader *r, int depth);
+
+static cJSON *rd_string(MpReader *r, size_t n)
+{
+    const uint8_t *s;
+    if (rd_bytes(r, n, &s) != 0) return NULL;
+
+    char *tmp = malloc(n + 1);
+    if (!tmp) return NULL;
+    memcpy(tmp, s, n);
+    tmp[n] = '\0';
+    cJSON *item = cJSON_CreateString(tmp);
+    free(tmp);
+    return item;
+}
+
+static cJSON *rd_container(MpReader *r, uint64_t n, int is_map, int depth)
+{
+    if (depth >= BT_MP_MAX_DEPTH) return NULL;
+    // 每个元素至少 1 字节，先挡住伪造的超大长度
+    if (n > (uint64_t)(r->end - r->p)) return NULL;
+
+    cJSON *obj = is_map ? cJSON_CreateObject() : cJSON_CreateArray();
+    if (!obj) return NULL;
+
+    for (uint64_t i = 0; i < n; i++) {
+        cJSON *key = NULL;
+        if (is_map) {
+            key = rd_value(r, depth + 1);
+            if (!key || !cJSON_IsString(key)) {
+                cJSON_Delete(key);
+                cJSON_Delete(obj);
+                return NULL;
+            }
+        }
+        cJSON *val = rd_value(r, depth + 1);
+        if (!val) {
+            cJSON_Delete(key);
+            cJSON_Delete(obj);
+            return NULL;
+        }
+        if (is_map) {
+            cJSON_AddItemToObject(obj, key->valuestring, val);
+            cJSON_Delete(key);
+        } else {
+            cJSON_AddItemToArray(obj, val);
+        }
+    }
+    return obj;
+}
+
+static cJSON *rd_value(MpReader *r, int depth)
+{
+    const uint8_t *s;
+    uint64_t u;
+    if (rd_bytes(r, 1, &s) != 0) return NULL;
+    uint8_t c = s[0];
+
+    if (c <= 0x7f) return cJSON_CreateNumber(c);
+    if (c >= 0xe0) return cJSON_CreateNumber((int8_t)c);
+    if ((c & 0xf0) == 0x80) return rd_container(r, c & 0x0f, 1, depth);
+    if ((c & 0xf0) == 0x90) return rd_container(r, c & 0x0f, 0, depth);
+    if ((c & 0xe0) == 0xa0) return rd_string(r, c & 0x1f);
+
+    switch (c) {
+        case 0xc0: return cJSON_CreateNull();
+        case 0xc2: return cJSON_CreateFalse();
+        case 0xc3: return cJSON_CreateTrue();
+
+        case 0xcc: case 0xcd: case 0xce: case 0xcf:
+            if (rd_uint(r, 1 << (c - 0xcc), &u) != 0) return NULL;
+            return cJSON_CreateNumber((double)u);
+
+        case 0xd0: if (rd_uint(r, 1, &u) != 0) return NULL; return cJSON_CreateNumber((int8_t)u);
+        case 0xd1: if (rd_uint(r, 2, &u) != 0) return NULL; return cJSON_CreateNumber((int16_t)u);
+        case 0xd2: if (rd_uint(r, 4, &u) != 0) return NULL; return cJSON_CreateNumber((int32_t)u);
+        case 0xd3: if (rd_uint(r, 8, &u) != 0) return NULL; return cJSON_CreateNumber((double)(int64_t)u);
+
+        case 0xca: {
+            if (rd_uint(r, 4, &u) != 0) return NULL;
+            uint32_t bits = (uint32_t)u;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            return cJSON_CreateNumber(f);
+        }
+        case 0xcb: {
+            if (rd_uint(r, 8, &u) != 0) return NULL;
+            double d;
+            memcpy(&d, &u, sizeof(d));
+            return cJSON_CreateNumber(d);
+        }
+
+        case 0xd9: case 0xda: case 0xdb:
+            if (rd_uint(r, 1 << (c - 0xd9), &u) != 0) return NULL;
+            return rd_string(r, (size_t)u);
+
+        case 0xdc: case 0xdd:
+            if (rd_uint(r, c == 0xdc ? 2 : 4, &u) != 0) return NULL;
+            return rd_container(r, u, 0, depth);
+        case 0xde: case 0xdf:
+            if (rd_uint(r, c == 0xde ? 2 : 4, &u) != 0) return NULL;
+            return rd_container(r, u, 1, depth);
+
+        default:
+            return NULL;    // bin / ext 只出现在回复里，请求用不到
+    }
+}
+
+cJSON *bt_mp_to_cjson(const char *data, size_t len)
+{
+    MpReader r = { (const uint8_t *)data, (const uint8_t *)data + len };
+    cJSON *root = rd_value(&r, 0);
+    if (root && r.p != r.end) {
+        cJSON_Delete(root);
+        return NULL;
+    }
+    return root;
+}
@@ -0,0 +1,55 @@
+// src/bt_msgpack.h
+#ifndef VS_BT_MSGPACK_H
+#define VS_BT_MSGPACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cjson/cJSON.h>
+
+/*
+ * MessagePack 编解码（只实现 daemon 协议用到的子集）
+ *
+ * 写：BtMpBuf 先用调用方给的栈缓冲区，放不下再换到堆上；
+ *     内存不足时 failed 置 1，后续写入全部忽略。
+ * 读：整帧转换成 cJSON 树，请求分发沿用 JSON 的处理代码。
+ */
+typedef struct BtMpBuf {
+    char   *data;
+    size_t  len;
+    size_t  cap;
+    int     heap;       // data 是否由 malloc 分配
+    int     failed;
+} BtMpBuf;
+
+void bt_mp_init(BtMpBuf *b, char *stack_buf, size_t stack_cap);
+void bt_mp_free(BtMpBuf *b);
+
+void bt_mp_map(BtMpBuf *b, uint32_t n);
+void bt_mp_array(BtMpBuf *b, uint32_t n);
+void bt_mp_str(BtMpBuf *b, const char *s);
+void bt_mp_strn(BtMpBuf *b, const char *s, size_t n);
+void bt_mp_bin(BtMpBuf *b, const void *data, size_t n);
+void bt_mp_int(BtMpBuf *b, int64_t v);
+void bt_mp_float(BtMpBuf *b, float v);
+void bt_mp_double(BtMpBuf *b, double v);
+void bt_mp_bool(BtMpBuf *b, int v);
+void bt_mp_nil(BtMpBuf *b);
+
+// 整数值的 number 编成 int，其它编成 float64
+void bt_mp_from_cjson(BtMpBuf *b, const cJSON *item);
+
+// 帧内容是否是 MessagePack map（JSON 请求以 '{' 开头，不会冲突）
+int bt_mp_is_map(const char *data, size_t len);
+
+// 失败返回 NULL：格式错误、有多余字节、map 的 key 不是字符串、嵌套过深
+cJSON *bt_mp_to_cjson(const char *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VS_BT_MSGPACK_H
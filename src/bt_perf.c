@@ -0,0 +1,225 @@
+// src/bt_perf.c
+#include "bt_perf.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#define PERF_SUB_BITS    4
+#define PERF_SUB_COUNT   (1 << PERF_SUB_BITS)
+#define PERF_MAX_BITS    40                         // 2^40 ns 约 18 分钟，更大的记到最后一格
+#define PERF_BUCKETS     ((PERF_MAX_BITS - PERF_SUB_BITS + 1) * PERF_SUB_COUNT)
+#define PERF_MAX_METHODS 64
+#define PERF_NAME_LEN    48
+
+// bucket_of 里 msb 最大取 PERF_MAX_BITS - 1，这时的最后一格必须落在数组里
+_Static_assert((PERF_MAX_BITS - PERF_SUB_BITS) * PERF_SUB_COUNT + PERF_SUB_COUNT - 1 == PERF_BUCKETS - 1,
+               "perf bucket layout");
+
+typedef struct PerfHist {
+    atomic_ullong count;
+    atomic_ullong sum_ns;
+    atomic_ullong max_ns;
+    atomic_ullong buckets[PERF_BUCKETS];
+} PerfHist;
+
+struct BtPerfMethod {
+    char     name[PERF_NAME_LEN];
+    PerfHist hist[BT_PERF_KIND_COUNT];
+};
+
+typedef struct PerfScope {
+    BtPerfMethod methods[PERF_MAX_METHODS];
+    atomic_int   count;                 // 已发布的条数，读者无锁遍历
+    atomic_long  depth;
+    atomic_long  depth_max;
+} PerfScope;
+
+static PerfScope       g_scopes[BT_PERF_SCOPE_COUNT];
+static pthread_mutex_t g_perf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t bt_perf_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* ---------- 分桶 ---------- */
+
+// [0, 16) 每个值一格；之后每个 [2^k, 2^(k+1)) 区间 16 格
+static int bucket_of(uint64_t v)
+{
+    if (v < PERF_SUB_COUNT) return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    if (msb >= PERF_MAX_BITS) return PERF_BUCKETS - 1;   // >= 2^40，含 UINT64_MAX
+    int shift = msb - PERF_SUB_BITS;
+    return (shift + 1) * PERF_SUB_COUNT + (int)((v >> shift) & (PERF_SUB_COUNT - 1));
+}
+
+// 桶的中点
+static double bucket_value(int idx)
+{
+    if (idx < PERF_SUB_COUNT) return idx;
+    int shift = idx / PERF_SUB_COUNT - 1;
+    int sub = idx % PERF_SUB_COUNT;
+    double lo = (double)((uint64_t)(PERF_SUB_COUNT + sub) << shift);
+    return lo + (double)((uint64_t)1 << shift) / 2;
+}
+
+/* ---------- 记录 ---------- */
+
+BtPerfMethod *bt_perf_method(BtPerfScope scope, const char *name)
+{
+    if ((unsigned)scope >= BT_PERF_SCOPE_COUNT || !name) return NULL;
+    PerfScope *s = &g_scopes[scope];
+
+    int n = atomic_load_explicit(&s->count, memory_order_acquire);
+    for (int i = 0; i < n; i++) {
+        if (strncmp(s->methods[i].name, name, PERF_NAME_LEN - 1) == 0) return &s->methods[i];
+    }
+
+    pthread_mutex_lock(&g_perf_lock);
+    n = atomic_load_explicit(&s->count, memory_order_relaxed);
+    BtPerfMethod *m = NULL;
+    for (int i = 0; i < n; i++) {
+        if (strncmp(s->methods[i].name, name, PERF_NAME_LEN - 1) == 0) {
+            m = &s->methods[i];
+            break;
+        }
+    }
+    if (!m) {
+        // 最后一格留给 "other"，方法名来自客户端，不能无限增长
+        if (n == PERF_MAX_METHODS - 1) name = "other";
+        if (n < PERF_MAX_METHODS) {
+            m = &s->methods[n];
+            strncpy(m->name, name, PERF_NAME_LEN - 1);
+            atomic_store_explicit(&s->count, n + 1, memory_order_release);
+        } else {
+            m = &s->methods[PERF_MAX_METHODS - 1];
+        }
+    }
+    pthread_mutex_unlock(&g_perf_lock);
+    return m;
+}
+
+void bt_perf_record(BtPerfMethod *m, BtPerfKind kind, uint64_t ns)
+{
+    if (!m || (unsigned)kind >= BT_PERF_KIND_COUNT) return;
+    PerfHist *h = &m->hist[kind];
+
+    atomic_fetch_add_explicit(&h->buckets[bucket_of(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+    unsigned long long cur = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+    while (ns > cur &&
+           !atomic_compare_exchange_weak_explicit(&h->max_ns, &cur, ns,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+}
+
+void bt_perf_queue_depth(BtPerfScope scope, long depth)
+{
+    if ((unsigned)scope >= BT_PERF_SCOPE_COUNT) return;
+    PerfScope *s = &g_scopes[scope];
+    atomic_store_explicit(&s->depth, depth, memory_order_relaxed);
+    long cur = atomic_load_explicit(&s->depth_max, memory_order_relaxed);
+    while (depth > cur &&
+           !atomic_compare_exchange_weak_explicit(&s->depth_max, &cur, depth,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void bt_perf_get_queue_depth(BtPerfScope scope, long *current, long *max)
+{
+    if ((unsigned)scope >= BT_PERF_SCOPE_COUNT) return;
+    if (current) *current = atomic_load_explicit(&g_scopes[scope].depth, memory_order_relaxed);
+    if (max) *max = atomic_load_explicit(&g_scopes[scope].depth_max, memory_order_relaxed);
+}
+
+/* ---------- 汇总 ---------- */
+
+static void summarize(const PerfHist *h, BtPerfSummary *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    // 桶是分别读的，总数以桶为准，和 count 可能差几条
+    uint64_t total = 0;
+    for (int i = 0; i < PERF_BUCKETS; i++)
+        total += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+    if (total == 0) return;
+
+    out->count = total;
+    out->mean_us = (double)atomic_load_explicit(&h->sum_ns, memory_order_relaxed) / (double)total / 1000.0;
+    out->max_us = (double)atomic_load_explicit(&h->max_ns, memory_order_relaxed) / 1000.0;
+
+    const double q[4] = { 0.50, 0.90, 0.99, 0.999 };
+    double *dst[4] = { &out->p50_us, &out->p90_us, &out->p99_us, &out->p999_us };
+    uint64_t seen = 0;
+    int qi = 0;
+    for (int i = 0; i < PERF_BUCKETS && qi < 4; i++) {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        while (qi < 4 && (double)seen >= q[qi] * (double)total) {
+            double v = bucket_value(i) / 1000.0;
+            *dst[qi++] = v < out->max_us ? v : out->max_us;
+        }
+    }
+}
+
+void bt_perf_foreach(BtPerfVisitor fn, void *user)
+{
+    BtPerfSummary sum[BT_PERF_KIND_COUNT];
+    for (int s = 0; s < BT_PERF_SCOPE_COUNT; s++) {
+        PerfScope *ps = &g_scopes[s];
+        int n = atomic_load_explicit(&ps->count, memory_order_acquire);
+        for (int i = 0; i < n; i++) {
+            int any = 0;
+            for (int k = 0; k < BT_PERF_KIND_COUNT; k++) {
+                summarize(&ps->methods[i].hist[k], &sum[k]);
+                any |= sum[k].count > 0;
+            }
+            if (any) fn(user, (BtPerfScope)s, ps->methods[i].name, sum);
+        }
+    }
+}
+
+void bt_perf_reset(void)
+{
+    for (int s = 0; s < BT_PERF_SCOPE_COUNT; s++) {
+        PerfScope *ps = &g_scopes[s];
+        int n = atomic_load_explicit(&ps->count, memory_order_acquire);
+        for (int i = 0; i < n; i++) {
+            for (int k = 0; k < BT_PERF_KIND_COUNT; k++) {
+                PerfHist *h = &ps->methods[i].hist[k];
+                atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+                atomic_store_explicit(&h->sum_ns, 0, memory_order_relaxed);
+                atomic_store_explicit(&h->max_ns, 0, memory_order_relaxed);
+                for (int b = 0; b < PERF_BUCKETS; b++)
+                    atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+            }
+        }
+        atomic_store_explicit(&ps->depth_max,
+                              atomic_load_explicit(&ps->depth, memory_order_relaxed),
+                              memory_order_relaxed);
+    }
+}
+
+const char *bt_perf_scope_name(BtPerfScope scope)
+{
+    switch (scope) {
+        case BT_PERF_RPC: return "rpc";
+        case BT_PERF_CMD: return "cmd";
+        default:          return "unknown";
+    }
+}
+
+const char *bt_perf_kind_name(BtPerfKind kind)
+{
+    switch (kind) {
+        case BT_PERF_QUEUE: return "queue";
+        case BT_PERF_EXEC:  return "exec";
+        case BT_PERF_TOTAL: return "total";
+        default:            return "unknown";
+    }
+}
@@ -0,0 +1,69 @@
+// src/bt_perf.h
+#ifndef VS_BT_PERF_H
+#define VS_BT_PERF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * 延迟统计
+ *
+ * 每个方法三个直方图：排队等待、执行、总耗时。直方图是 HDR 风格的对数-线性分桶
+ * （每个 2 的幂区间再分 16 格，相对误差 < 6.25%），记录只是几次原子加，任意线程可调用。
+ * RPC 请求（bt_daemon.c）和 BT 线程命令（BtCore::postCommand）分开统计。
+ */
+typedef enum BtPerfScope {
+    BT_PERF_RPC = 0,        // 请求在 worker 队列里等待 / handler 执行 / 收到帧到回复
+    BT_PERF_CMD,            // 命令在 m_cmdQueue 里等待 / BT 线程执行 / 投递到执行完
+    BT_PERF_SCOPE_COUNT
+} BtPerfScope;
+
+typedef enum BtPerfKind {
+    BT_PERF_QUEUE = 0,
+    BT_PERF_EXEC,
+    BT_PERF_TOTAL,
+    BT_PERF_KIND_COUNT
+} BtPerfKind;
+
+typedef struct BtPerfMethod BtPerfMethod;
+
+typedef struct BtPerfSummary {
+    uint64_t count;
+    double   mean_us;
+    double   p50_us;
+    double   p90_us;
+    double   p99_us;
+    double   p999_us;
+    double   max_us;
+} BtPerfSummary;
+
+uint64_t bt_perf_now_ns(void);
+
+// 按名字取统计项，名字会被复制；每个 scope 最多 64 个，超出的记到 "other"。
+// 返回值一直有效，调用方可以缓存
+BtPerfMethod *bt_perf_method(BtPerfScope scope, const char *name);
+void bt_perf_record(BtPerfMethod *m, BtPerfKind kind, uint64_t ns);
+
+// 队列深度：记录当前值并更新峰值
+void bt_perf_queue_depth(BtPerfScope scope, long depth);
+void bt_perf_get_queue_depth(BtPerfScope scope, long *current, long *max);
+
+// 遍历有数据的方法
+typedef void (*BtPerfVisitor)(void *user, BtPerfScope scope, const char *name,
+                              const BtPerfSummary summary[BT_PERF_KIND_COUNT]);
+void bt_perf_foreach(BtPerfVisitor fn, void *user);
+
+// 清空所有直方图和队列峰值（和并发的记录之间不保证原子）
+void bt_perf_reset(void);
+
+const char *bt_perf_scope_name(BtPerfScope scope);
+const char *bt_perf_kind_name(BtPerfKind kind);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VS_BT_PERF_H
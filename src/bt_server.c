@@ -0,0 +1,393 @@
+// src/bt_server.c
+#include "bt_server.h"
+#include "bt_conn.h"
+#include "bt_frame_io.h"
+#include "bt_utils.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <uv.h>
+
+#define BTD_LISTEN_BACKLOG   128
+#define BTD_CONN_PENDING_MAX (16u * 1024 * 1024)   // 单个客户端积压超过这个量就断开
+
+/*
+ * 每个客户端一个 BtdUvConn。读和写都在事件循环线程里；
+ * worker / BT 线程的 send 只把帧追加到 pending，再用 uv_async 通知循环线程。
+ * pending 和 writing 两块缓冲区交替使用，同一时刻最多一个 uv_write 在途。
+ */
+typedef struct BtdUvConn {
+    BtdConn        base;            // 必须在首位
+    uv_pipe_t      pipe;
+    uv_async_t     async;
+    BtFrameReader  reader;
+
+    pthread_mutex_t lock;
+    char   *pending;                // guarded by lock
+    size_t  pending_len;
+    size_t  pending_cap;
+    int     dead;                   // guarded by lock，置位后不再 uv_async_send
+    int     overflow;               // guarded by lock
+
+    // 以下只在循环线程访问
+    char   *writing;
+    size_t  writing_len;
+    size_t  writing_cap;
+    int     write_busy;
+    uv_write_t wreq;
+    int     closing;
+    int     draining;               // 停服中：worker 里的请求都回复完、排队的数据写完就关闭
+    int     closed_handles;
+    struct BtdUvConn *prev, *next;
+} BtdUvConn;
+
+static uv_loop_t   *g_loop = NULL;
+static uv_pipe_t    g_listener;
+static uv_async_t   g_stop_async;
+static BtdUvConn   *g_uv_conns = NULL;      // 只在循环线程访问
+
+// btd_server_stop 可能在循环启动前或退出后被调用
+static pthread_mutex_t g_server_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_server_running = 0;
+static int g_stop_requested = 0;
+
+static void conn_flush(BtdUvConn *u);
+static void conn_close(BtdUvConn *u);
+
+/* ---------- 发送（任意线程） ---------- */
+
+static int conn_send(BtdConn *c, const char *buf, size_t len)
+{
+    BtdUvConn *u = (BtdUvConn *)c;
+
+    pthread_mutex_lock(&u->lock);
+    if (u->dead || u->overflow) {
+        pthread_mutex_unlock(&u->lock);
+        return -1;
+    }
+
+    size_t need = u->pending_len + 4 + len;
+    if (need > BTD_CONN_PENDING_MAX || len > 0xffffffffu) {
+        // 客户端不读，不能让它拖住 worker 和 BT 线程
+        u->overflow = 1;
+        uv_async_send(&u->async);
+        pthread_mutex_unlock(&u->lock);
+        return -1;
+    }
+    if (need > u->pending_cap) {
+        size_t cap = u->pending_cap ? u->pending_cap : 4096;
+        while (cap < need) cap *= 2;
+        char *p = realloc(u->pending, cap);
+        if (!p) {
+            pthread_mutex_unlock(&u->lock);
+            return -1;
+        }
+        u->pending = p;
+        u->pending_cap = cap;
+    }
+
+    unsigned char *h = (unsigned char *)u->pending + u->pending_len;
+    h[0] = (unsigned char)(len >> 24);
+    h[1] = (unsigned char)(len >> 16);
+    h[2] = (unsigned char)(len >> 8);
+    h[3] = (unsigned char)len;
+    memcpy(u->pending + u->pending_len + 4, buf, len);
+    int kick = u->pending_len == 0;
+    u->pending_len = need;
+    if (kick) uv_async_send(&u->async);
+    pthread_mutex_unlock(&u->lock);
+    return 0;
+}
+
+static void conn_destroy(BtdConn *c)
+{
+    BtdUvConn *u = (BtdUvConn *)c;
+    bt_frame_reader_free(&u->reader);
+    pthread_mutex_destroy(&u->lock);
+    free(u->pending);
+    free(u->writing);
+    free(u);
+}
+
+// 停服时 draining 的连接要等 worker 里的请求都回复完才关，最后一个处理完时叫醒循环线程再看一次
+static void conn_idle(BtdConn *c)
+{
+    BtdUvConn *u = (BtdUvConn *)c;
+
+    pthread_mutex_lock(&u->lock);
+    if (!u->dead) uv_async_send(&u->async);
+    pthread_mutex_unlock(&u->lock);
+}
+
+static const BtdConnOps g_uv_conn_ops = { conn_send, conn_destroy, conn_idle };
+
+/* ---------- 循环线程 ---------- */
+
+static void on_conn_closed(uv_handle_t *h)
+{
+    BtdUvConn *u = h->data;
+    if (++u->closed_handles < 2) return;
+
+    if (u->prev) u->prev->next = u->next;
+    else         g_uv_conns = u->next;
+    if (u->next) u->next->prev = u->prev;
+
+    btd_conn_unregister(&u->base);
+    btd_conn_release(&u->base);     // 创建时的引用，worker 里还有请求时由它们释放
+}
+
+static void conn_close(BtdUvConn *u)
+{
+    if (u->closing) return;
+    u->closing = 1;
+
+    pthread_mutex_lock(&u->lock);
+    u->dead = 1;
+    pthread_mutex_unlock(&u->lock);
+
+    uv_read_stop((uv_stream_t *)&u->pipe);
+    uv_close((uv_handle_t *)&u->pipe, on_conn_closed);
+    uv_close((uv_handle_t *)&u->async, on_conn_closed);
+}
+
+static void on_write(uv_write_t *req, int status)
+{
+    BtdUvConn *u = req->data;
+    u->write_busy = 0;
+    u->writing_len = 0;
+    if (u->closing) return;
+    if (status < 0) {
+        ilogi("[btd] client write failed: %s", uv_strerror(status));
+        conn_close(u);
+        return;
+    }
+    conn_flush(u);
+}
+
+static void conn_flush(BtdUvConn *u)
+{
+    if (u->closing || u->write_busy) return;
+
+    pthread_mutex_lock(&u->lock);
+    int overflow = u->overflow;
+    if (!overflow) {
+        char *p = u->writing;
+        size_t cap = u->writing_cap;
+        u->writing = u->pending;
+        u->writing_cap = u->pending_cap;
+        u->writing_len = u->pending_len;
+        u->pending = p;
+        u->pending_cap = cap;
+        u->pending_len = 0;
+    }
+    pthread_mutex_unlock(&u->lock);
+
+    if (overflow) {
+        iloge("[btd] client not reading, pending > %u bytes, disconnect", BTD_CONN_PENDING_MAX);
+        conn_close(u);
+        return;
+    }
+    if (u->writing_len == 0) {
+        if (u->draining && atomic_load(&u->base.requests) == 0) conn_close(u);
+        return;
+    }
+
+    uv_buf_t b = uv_buf_init(u->writing, (unsigned int)u->writing_len);
+    u->wreq.data = u;
+    int rc = uv_write(&u->wreq, (uv_stream_t *)&u->pipe, &b, 1, on_write);
+    if (rc != 0) {
+        ilogi("[btd] uv_write failed: %s", uv_strerror(rc));
+        conn_close(u);
+        return;
+    }
+    u->write_busy = 1;
+}
+
+static void on_conn_async(uv_async_t *h)
+{
+    conn_flush(h->data);
+}
+
+static void on_alloc(uv_handle_t *h, size_t suggested, uv_buf_t *buf)
+{
+    (void)suggested;
+    BtdUvConn *u = h->data;
+    char *p = NULL;
+    size_t avail = 0;
+
+    if (bt_frame_reader_prepare(&u->reader, &p, &avail) != 0) {
+        *buf = uv_buf_init(NULL, 0);    // read 回调收到 UV_ENOBUFS
+        return;
+    }
+    if (avail > 0x7fffffff) avail = 0x7fffffff;
+    *buf = uv_buf_init(p, (unsigned int)avail);
+}
+
+static void on_read(uv_stream_t *s, ssize_t nread, const uv_buf_t *buf)
+{
+    (void)buf;
+    BtdUvConn *u = s->data;
+
+    if (nread < 0) {
+        if (nread != UV_EOF) ilogi("[btd] client read failed: %s", uv_strerror((int)nread));
+        conn_close(u);
+        return;
+    }
+    if (nread == 0) return;
+
+    bt_frame_reader_commit(&u->reader, (size_t)nread);
+    for (;;) {
+        const char *data = NULL;
+        size_t len = 0;
+        int rc = bt_frame_reader_next(&u->reader, &data, &len);
+        if (rc == 1) break;
+        if (rc != 0) {
+            // 流已经错位，只能断开这个客户端
+            iloge("[btd] client frame too large, disconnect");
+            conn_close(u);
+            return;
+        }
+        btd_conn_on_frame(&u->base, data, len);
+    }
+}
+
+static void on_connection(uv_stream_t *server, int status)
+{
+    if (status < 0) {
+        iloge("[btd] accept failed: %s", uv_strerror(status));
+        return;
+    }
+
+    BtdUvConn *u = calloc(1, sizeof(BtdUvConn));
+    if (!u) return;
+    btd_conn_init(&u->base, &g_uv_conn_ops);
+    bt_frame_reader_init(&u->reader, -1);
+    pthread_mutex_init(&u->lock, NULL);
+
+    uv_pipe_init(g_loop, &u->pipe, 0);
+    u->pipe.data = u;
+    if (uv_accept(server, (uv_stream_t *)&u->pipe) != 0) {
+        // 只初始化了 pipe，关闭回调里直接释放
+        u->closed_handles = 1;
+        u->closing = 1;
+        u->dead = 1;
+        u->next = g_uv_conns;
+        if (g_uv_conns) g_uv_conns->prev = u;
+        g_uv_conns = u;
+        uv_close((uv_handle_t *)&u->pipe, on_conn_closed);
+        return;
+    }
+    uv_async_init(g_loop, &u->async, on_conn_async);
+    u->async.data = u;
+
+    u->next = g_uv_conns;
+    if (g_uv_conns) g_uv_conns->prev = u;
+    g_uv_conns = u;
+
+    btd_conn_register(&u->base);
+    uv_read_start((uv_stream_t *)&u->pipe, on_alloc, on_read);
+    ilogi("[btd] client connected");
+}
+
+static void on_stop(uv_async_t *h)
+{
+    pthread_mutex_lock(&g_server_lock);
+    g_server_running = 0;
+    uv_close((uv_handle_t *)h, NULL);
+    pthread_mutex_unlock(&g_server_lock);
+
+    if (!uv_is_closing((uv_handle_t *)&g_listener))
+        uv_close((uv_handle_t *)&g_listener, NULL);
+
+    // 不再收新请求；worker 里还在处理的请求回复完、排队的数据写完再关
+    for (BtdUvConn *u = g_uv_conns, *next; u; u = next) {
+        next = u->next;
+        if (u->closing) continue;
+        u->draining = 1;
+        uv_read_stop((uv_stream_t *)&u->pipe);
+        conn_flush(u);
+    }
+}
+
+// 上次异常退出留下的 socket 文件会让 bind 失败，要先删掉。
+// 但只删没人监听的 socket：别的文件不动，还有 daemon 在监听就报错，不能悄悄抢过来
+static int remove_stale_socket(const char *path)
+{
+    struct stat st;
+    if (lstat(path, &st) != 0) return errno == ENOENT ? 0 : -1;
+    if (!S_ISSOCK(st.st_mode)) {
+        iloge("[btd] %s exists and is not a socket", path);
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int live = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    close(fd);
+    if (live) {
+        iloge("[btd] another daemon is listening on %s", path);
+        return -1;
+    }
+
+    ilogi("[btd] removing stale socket %s", path);
+    return unlink(path) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+int btd_server_run(const char *path)
+{
+    uv_loop_t loop;
+    int rc = uv_loop_init(&loop);
+    if (rc != 0) {
+        iloge("[btd] uv_loop_init failed: %s", uv_strerror(rc));
+        return -1;
+    }
+    g_loop = &loop;
+
+    uv_pipe_init(&loop, &g_listener, 0);
+    uv_async_init(&loop, &g_stop_async, on_stop);
+
+    rc = remove_stale_socket(path) == 0 ? uv_pipe_bind(&g_listener, path) : UV_EADDRINUSE;
+    if (rc == 0) rc = uv_listen((uv_stream_t *)&g_listener, BTD_LISTEN_BACKLOG, on_connection);
+    if (rc != 0) {
+        iloge("[btd] listen on %s failed: %s", path, uv_strerror(rc));
+        uv_close((uv_handle_t *)&g_listener, NULL);
+        uv_close((uv_handle_t *)&g_stop_async, NULL);
+        uv_run(&loop, UV_RUN_DEFAULT);
+        uv_loop_close(&loop);
+        g_loop = NULL;
+        return -1;
+    }
+    ilogi("[btd] listening on %s", path);
+
+    pthread_mutex_lock(&g_server_lock);
+    g_server_running = 1;
+    if (g_stop_requested) uv_async_send(&g_stop_async);
+    pthread_mutex_unlock(&g_server_lock);
+
+    uv_run(&loop, UV_RUN_DEFAULT);
+
+    uv_loop_close(&loop);
+    g_loop = NULL;
+    unlink(path);
+    return 0;
+}
+
+void btd_server_stop(void)
+{
+    pthread_mutex_lock(&g_server_lock);
+    g_stop_requested = 1;
+    if (g_server_running) uv_async_send(&g_stop_async);
+    pthread_mutex_unlock(&g_server_lock);
+}
@@ -0,0 +1,13 @@
+// src/bt_server.h
+#ifndef VS_BT_SERVER_H
+#define VS_BT_SERVER_H
+
+// Unix socket 服务模式：在 path 上监听，多个客户端共用一个 daemon，
+// 帧格式和 stdin/stdout 模式相同。
+// 在调用线程运行 libuv 事件循环，btd_server_stop 之后返回；监听失败返回 -1。
+int  btd_server_run(const char *path);
+
+// 任意线程调用：停止监听，把各连接已排队的数据写完后关闭，事件循环随后退出
+void btd_server_stop(void);
+
+#endif // VS_BT_SERVER_H
@@ -0,0 +1,134 @@
+// src/bt_shm.h
+#ifndef VS_BT_SHM_H
+#define VS_BT_SHM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bt_api.h"
+
+/*
+ * 共享内存状态表（配置 shm_status_path 时启用）
+ *
+ * daemon 把每个 torrent 的 BtTorrentStatus 发布到一块 mmap 的文件里（一般在 /dev/shm），
+ * 父进程只读映射后直接读，不需要 RPC、不需要解析。布局：
+ *
+ *   [BtShmHeader][index: uint32_t x index_cap][BtShmRecord x max_slots]
+ *
+ * - 每个槽位一个 seq：奇数表示 daemon 正在写，读者前后两次读到同一个偶数才算一致。
+ * - index 是 infohash -> 槽位号+1 的开放寻址表（线性探测，0 空，0xffffffff 已删除），
+ *   hybrid torrent 的 v1 和 v2 各占一项。index 满了会原地重建，期间 index_seq 为奇数。
+ * - 槽位里带着 infohash，读到后核对 key，槽位删除后复用也不会读错。
+ *
+ * 只保证同一台机器、同一 ABI 的进程之间可读（BtTorrentStatus 含 long）。
+ * 读者应先检查 magic / version / record_size；pid 为 0 表示 daemon 已退出。
+ */
+#define BT_SHM_MAGIC     0x4d485342u    // "BSHM"
+#define BT_SHM_VERSION   1u
+#define BT_SHM_EMPTY     0u
+#define BT_SHM_TOMBSTONE 0xffffffffu
+
+typedef struct BtShmHeader {
+    uint32_t magic;             // 最后写入，读到 BT_SHM_MAGIC 说明头部已就绪
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;       // sizeof(BtShmRecord)
+    uint32_t max_slots;
+    uint32_t index_cap;         // 2 的幂
+    uint64_t index_offset;      // 相对区域起点的字节偏移
+    uint64_t records_offset;
+    uint32_t pid;               // daemon 进程号，退出时清零
+    uint32_t index_seq;         // 重建 index 时为奇数
+    uint32_t num_live;          // 当前 torrent 数
+    uint32_t reserved;
+    uint64_t update_count;      // 每轮状态刷新后加一
+    uint64_t update_time_ms;    // 最近一次刷新的时间，CLOCK_REALTIME 毫秒
+} BtShmHeader;
+
+typedef struct BtShmRecord {
+    uint32_t seq;
+    uint32_t live;
+    uint8_t  id_len;            // 主 key：20 为 v1，32 为 v2-only
+    uint8_t  alias_len;         // hybrid 的 v2 key，否则为 0
+    uint8_t  reserved[6];
+    uint8_t  id[32];
+    uint8_t  alias[32];
+    BtTorrentStatus status;
+} BtShmRecord;
+
+static inline const uint32_t *bt_shm_index(const BtShmHeader *h)
+{
+    return (const uint32_t *)((const char *)h + h->index_offset);
+}
+
+static inline const BtShmRecord *bt_shm_record(const BtShmHeader *h, uint32_t slot)
+{
+    return (const BtShmRecord *)((const char *)h + h->records_offset) + slot;
+}
+
+// infohash 本身就是密码学哈希，取前 8 字节
+static inline uint64_t bt_shm_key_hash(const uint8_t *key, size_t len)
+{
+    uint64_t v = 0;
+    memcpy(&v, key, len < 8 ? len : 8);
+    return v ^ len;
+}
+
+// 读一个槽位的一致快照。1: 成功（out->live 可能为 0，表示空槽位）；0: 写者一直在写
+static inline int bt_shm_read_record(const BtShmHeader *h, uint32_t slot, BtShmRecord *out)
+{
+    const BtShmRecord *r = bt_shm_record(h, slot);
+    for (int tries = 0; tries < 1000; tries++) {
+        uint32_t s1 = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) continue;
+        memcpy(out, r, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == s1) return 1;
+    }
+    return 0;
+}
+
+// 按 infohash（20 或 32 字节二进制）查状态。1: 找到；0: 不存在或一直在变
+static inline int bt_shm_lookup(const BtShmHeader *h, const uint8_t *key, size_t len,
+                                BtTorrentStatus *out)
+{
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != BT_SHM_MAGIC) return 0;
+    if (len == 0 || len > 32) return 0;
+
+    const uint32_t *index = bt_shm_index(h);
+    uint32_t mask = h->index_cap - 1;
+    BtShmRecord rec;
+
+    for (int tries = 0; tries < 100; tries++) {
+        uint32_t s1 = __atomic_load_n(&h->index_seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) continue;
+
+        int found = 0;
+        for (uint32_t i = (uint32_t)bt_shm_key_hash(key, len) & mask, n = 0; n <= mask; i = (i + 1) & mask, n++) {
+            uint32_t c = __atomic_load_n(&index[i], __ATOMIC_ACQUIRE);
+            if (c == BT_SHM_EMPTY) break;
+            if (c == BT_SHM_TOMBSTONE || c - 1 >= h->max_slots) continue;
+            if (!bt_shm_read_record(h, c - 1, &rec) || !rec.live) continue;
+            if ((rec.id_len == len && memcmp(rec.id, key, len) == 0) ||
+                (rec.alias_len == len && memcmp(rec.alias, key, len) == 0)) {
+                *out = rec.status;
+                found = 1;
+                break;
+            }
+        }
+        // 查找期间 index 被重建过，结果不可信，重查
+        if (__atomic_load_n(&h->index_seq, __ATOMIC_ACQUIRE) == s1) return found;
+    }
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VS_BT_SHM_H
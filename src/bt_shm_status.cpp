@@ -0,0 +1,232 @@
+// src/bt_shm_status.cpp
+#include "bt_shm_status.hpp"
+#include "bt_utils.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+size_t align_up(size_t n, size_t a)
+{
+    return (n + a - 1) / a * a;
+}
+
+} // namespace
+
+BtShmStatus::~BtShmStatus()
+{
+    close();
+}
+
+bool BtShmStatus::open(const std::string& path, uint32_t max_slots)
+{
+    close();
+    if (max_slots == 0) return false;
+
+    // 每个 torrent 最多两个 key，装载率不超过 1/2
+    uint32_t cap = 64;
+    while (cap < max_slots * 4u) cap <<= 1;
+
+    size_t index_off = align_up(sizeof(BtShmHeader), 64);
+    size_t records_off = align_up(index_off + cap * sizeof(uint32_t), 64);
+    size_t size = records_off + size_t(max_slots) * sizeof(BtShmRecord);
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        iloge("[btd] shm open %s failed: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    if (::ftruncate(fd, off_t(size)) != 0) {
+        iloge("[btd] shm ftruncate %s failed: %s", path.c_str(), std::strerror(errno));
+        ::close(fd);
+        ::unlink(path.c_str());
+        return false;
+    }
+    void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        iloge("[btd] shm mmap %s failed: %s", path.c_str(), std::strerror(errno));
+        ::unlink(path.c_str());
+        return false;
+    }
+
+    // ftruncate 出来的文件全是 0：索引全空，槽位全是 live == 0
+    m_hdr = static_cast<BtShmHeader*>(p);
+    m_size = size;
+    m_path = path;
+    m_hdr->version = BT_SHM_VERSION;
+    m_hdr->header_size = sizeof(BtShmHeader);
+    m_hdr->record_size = sizeof(BtShmRecord);
+    m_hdr->max_slots = max_slots;
+    m_hdr->index_cap = cap;
+    m_hdr->index_offset = index_off;
+    m_hdr->records_offset = records_off;
+    m_hdr->pid = uint32_t(::getpid());
+    __atomic_store_n(&m_hdr->magic, BT_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    m_slotOf.clear();
+    m_freeSlots.clear();
+    m_nextSlot = 0;
+    m_indexUsed = 0;
+    return true;
+}
+
+void BtShmStatus::close()
+{
+    if (!m_hdr) return;
+    __atomic_store_n(&m_hdr->pid, 0u, __ATOMIC_RELEASE);
+    ::munmap(m_hdr, m_size);
+    ::unlink(m_path.c_str());
+    m_hdr = nullptr;
+    m_size = 0;
+}
+
+BtShmRecord* BtShmStatus::record(uint32_t slot)
+{
+    return reinterpret_cast<BtShmRecord*>(reinterpret_cast<char*>(m_hdr) + m_hdr->records_offset) + slot;
+}
+
+uint32_t* BtShmStatus::index()
+{
+    return reinterpret_cast<uint32_t*>(reinterpret_cast<char*>(m_hdr) + m_hdr->index_offset);
+}
+
+// st 为空表示清空槽位
+void BtShmStatus::writeRecord(uint32_t slot, const BtInfoHash& id, const BtInfoHash& alias,
+                              const BtTorrentStatus* st)
+{
+    BtShmRecord* r = record(slot);
+    uint32_t s = r->seq;
+    __atomic_store_n(&r->seq, s + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    r->live = st ? 1 : 0;
+    r->id_len = id.len;
+    r->alias_len = alias.len;
+    std::memcpy(r->id, id.bytes, sizeof(r->id));
+    std::memcpy(r->alias, alias.bytes, sizeof(r->alias));
+    if (st) r->status = *st;
+    else    std::memset(&r->status, 0, sizeof(r->status));
+
+    __atomic_store_n(&r->seq, s + 2, __ATOMIC_RELEASE);
+}
+
+void BtShmStatus::indexInsert(const BtInfoHash& key, uint32_t slot)
+{
+    uint32_t* idx = index();
+    uint32_t mask = m_hdr->index_cap - 1;
+    for (uint32_t i = uint32_t(bt_shm_key_hash(key.bytes, key.len)) & mask;; i = (i + 1) & mask) {
+        uint32_t c = idx[i];
+        if (c == BT_SHM_EMPTY || c == BT_SHM_TOMBSTONE) {
+            if (c == BT_SHM_EMPTY) ++m_indexUsed;
+            __atomic_store_n(&idx[i], slot + 1, __ATOMIC_RELEASE);
+            return;
+        }
+    }
+}
+
+void BtShmStatus::indexErase(const BtInfoHash& key, uint32_t slot)
+{
+    uint32_t* idx = index();
+    uint32_t mask = m_hdr->index_cap - 1;
+    for (uint32_t i = uint32_t(bt_shm_key_hash(key.bytes, key.len)) & mask;; i = (i + 1) & mask) {
+        uint32_t c = idx[i];
+        if (c == slot + 1) {
+            __atomic_store_n(&idx[i], BT_SHM_TOMBSTONE, __ATOMIC_RELEASE);
+            return;
+        }
+        if (c == BT_SHM_EMPTY) return;
+    }
+}
+
+// 墓碑太多时原地重建；index_seq 为奇数期间读者会重查
+void BtShmStatus::rebuildIndex()
+{
+    uint32_t s = m_hdr->index_seq;
+    __atomic_store_n(&m_hdr->index_seq, s + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    uint32_t* idx = index();
+    for (uint32_t i = 0; i < m_hdr->index_cap; ++i) {
+        __atomic_store_n(&idx[i], BT_SHM_EMPTY, __ATOMIC_RELAXED);
+    }
+    m_indexUsed = 0;
+    m_slotOf.forEach([&](const BtInfoHash& key, SlotRef& ref) {
+        indexInsert(key, ref.slot);
+        if (!ref.alias.empty()) indexInsert(ref.alias, ref.slot);
+    });
+
+    __atomic_store_n(&m_hdr->index_seq, s + 2, __ATOMIC_RELEASE);
+}
+
+void BtShmStatus::put(const BtInfoHash& id, const BtInfoHash& alias, const BtTorrentStatus& st)
+{
+    if (!m_hdr || update(id, alias, st)) return;
+
+    uint32_t slot;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else if (m_nextSlot < m_hdr->max_slots) {
+        slot = m_nextSlot++;
+    } else {
+        return;   // 超过 shm_max_torrents，只能走 RPC 查
+    }
+
+    writeRecord(slot, id, alias, &st);
+    m_slotOf.insert(id, SlotRef{slot, alias});
+    if ((m_indexUsed + 2) * 2 > m_hdr->index_cap) {
+        rebuildIndex();   // 已包含这一条
+    } else {
+        indexInsert(id, slot);
+        if (!alias.empty()) indexInsert(alias, slot);
+    }
+    __atomic_store_n(&m_hdr->num_live, uint32_t(m_slotOf.size()), __ATOMIC_RELAXED);
+}
+
+bool BtShmStatus::update(const BtInfoHash& id, const BtInfoHash& alias, const BtTorrentStatus& st)
+{
+    if (!m_hdr) return false;
+    SlotRef* ref = m_slotOf.find(id);
+    if (!ref) return false;
+
+    if (!alias.empty() && ref->alias != alias) {
+        if (!ref->alias.empty()) indexErase(ref->alias, ref->slot);
+        ref->alias = alias;
+        if ((m_indexUsed + 1) * 2 > m_hdr->index_cap) rebuildIndex();
+        else indexInsert(alias, ref->slot);
+    }
+    writeRecord(ref->slot, id, ref->alias, &st);
+    return true;
+}
+
+bool BtShmStatus::erase(const BtInfoHash& id)
+{
+    if (!m_hdr) return false;
+    SlotRef* ref = m_slotOf.find(id);
+    if (!ref) return false;
+    SlotRef r = *ref;
+    m_slotOf.erase(id);
+
+    indexErase(id, r.slot);
+    if (!r.alias.empty()) indexErase(r.alias, r.slot);
+    writeRecord(r.slot, BtInfoHash(), BtInfoHash(), nullptr);
+    m_freeSlots.push_back(r.slot);
+    __atomic_store_n(&m_hdr->num_live, uint32_t(m_slotOf.size()), __ATOMIC_RELAXED);
+    return true;
+}
+
+void BtShmStatus::publish()
+{
+    if (!m_hdr) return;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ms = uint64_t(ts.tv_sec) * 1000 + uint64_t(ts.tv_nsec) / 1000000;
+    __atomic_store_n(&m_hdr->update_time_ms, ms, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m_hdr->update_count, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,60 @@
+// src/bt_shm_status.hpp
+#ifndef VS_BT_SHM_STATUS_HPP
+#define VS_BT_SHM_STATUS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bt_shm.h"
+#include "bt_infohash.hpp"
+
+// 共享内存状态表的写端，布局见 bt_shm.h。
+// 和 BtStatusTable 一样只在 BT 线程里写，put / update / erase 的语义也相同，
+// 由 BtCore 在更新快照表的同时调用。槽位用完后新 torrent 不再发布。
+class BtShmStatus {
+public:
+    BtShmStatus() = default;
+    ~BtShmStatus();
+
+    BtShmStatus(const BtShmStatus&) = delete;
+    BtShmStatus& operator=(const BtShmStatus&) = delete;
+
+    // 创建（覆盖）path 并映射，失败返回 false
+    bool open(const std::string& path, uint32_t max_slots);
+    // 清掉 pid 并解除映射，文件删除，已映射的读者不受影响
+    void close();
+    bool isOpen() const { return m_hdr != nullptr; }
+
+    void put(const BtInfoHash& id, const BtInfoHash& alias, const BtTorrentStatus& st);
+    bool update(const BtInfoHash& id, const BtInfoHash& alias, const BtTorrentStatus& st);
+    bool erase(const BtInfoHash& id);
+    // 一轮状态刷新结束，更新 update_count / update_time_ms
+    void publish();
+
+private:
+    struct SlotRef {
+        uint32_t   slot;
+        BtInfoHash alias;
+    };
+
+    BtShmRecord* record(uint32_t slot);
+    uint32_t* index();
+    void writeRecord(uint32_t slot, const BtInfoHash& id, const BtInfoHash& alias,
+                     const BtTorrentStatus* st);
+    void indexInsert(const BtInfoHash& key, uint32_t slot);
+    void indexErase(const BtInfoHash& key, uint32_t slot);
+    void rebuildIndex();
+
+    std::string  m_path;
+    BtShmHeader* m_hdr = nullptr;
+    size_t       m_size = 0;
+
+    BtInfoHashMap<SlotRef> m_slotOf;
+    std::vector<uint32_t>  m_freeSlots;
+    uint32_t m_nextSlot = 0;
+    uint32_t m_indexUsed = 0;   // 含墓碑
+};
+
+#endif // VS_BT_SHM_STATUS_HPP
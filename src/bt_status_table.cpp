@@ -0,0 +1,245 @@
+// src/bt_status_table.cpp
+#include "bt_status_table.hpp"
+
+#include <cstring>
+
+void BtStatusTable::Slot::write(const Payload& p)
+{
+    uint64_t buf[kWords] = {};
+    std::memcpy(buf, &p, sizeof(p));
+
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; ++i) {
+        words[i].store(buf[i], std::memory_order_relaxed);
+    }
+    seq.store(s + 2, std::memory_order_release);
+}
+
+bool BtStatusTable::Slot::read(Payload& p) const
+{
+    uint64_t buf[kWords];
+    for (int tries = 0; tries < 1000; ++tries) {
+        uint32_t s1 = seq.load(std::memory_order_acquire);
+        if (s1 & 1) continue;   // 写者正在写
+        for (size_t i = 0; i < kWords; ++i) {
+            buf[i] = words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) == s1) {
+            std::memcpy(&p, buf, sizeof(p));
+            return true;
+        }
+    }
+    return false;   // 写者一直在写同一个槽位，放弃这次读
+}
+
+BtStatusTable::Index::Index(size_t cap)
+    : mask(cap - 1), cells(new std::atomic<uint32_t>[cap])
+{
+    for (size_t i = 0; i < cap; ++i) {
+        cells[i].store(kEmpty, std::memory_order_relaxed);
+    }
+}
+
+BtStatusTable::BtStatusTable()
+{
+    for (auto& c : m_chunks) c.store(nullptr, std::memory_order_relaxed);
+    m_indexes.emplace_back(new Index(64));
+    m_index.store(m_indexes.back().get(), std::memory_order_release);
+}
+
+BtStatusTable::~BtStatusTable()
+{
+    for (auto& c : m_chunks) delete[] c.load(std::memory_order_relaxed);
+}
+
+BtStatusTable::Slot* BtStatusTable::slotAt(uint32_t id) const
+{
+    Slot* chunk = m_chunks[id / kChunkSlots].load(std::memory_order_acquire);
+    return chunk ? &chunk[id % kChunkSlots] : nullptr;
+}
+
+uint32_t BtStatusTable::allocSlot()
+{
+    if (!m_freeSlots.empty()) {
+        uint32_t id = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        return id;
+    }
+    uint32_t id = m_slotCount.load(std::memory_order_relaxed);
+    if (id / kChunkSlots >= kMaxChunks) return kTombstone;
+    if (id % kChunkSlots == 0) {
+        m_chunks[id / kChunkSlots].store(new Slot[kChunkSlots], std::memory_order_release);
+    }
+    m_slotCount.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+void BtStatusTable::indexInsert(Index& idx, const BtInfoHash& key, uint32_t id)
+{
+    for (size_t i = key.hash() & idx.mask;; i = (i + 1) & idx.mask) {
+        uint32_t c = idx.cells[i].load(std::memory_order_relaxed);
+        if (c == kEmpty || c == kTombstone) {
+            if (c == kEmpty) ++m_indexUsed;
+            idx.cells[i].store(id + 1, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+// 墓碑加上实际条目超过一半时调用：容量够就原地清掉墓碑，不够才换新表
+void BtStatusTable::rebuildIndex()
+{
+    Index* cur = m_index.load(std::memory_order_relaxed);
+    size_t cap = 64;
+    while (cap < (m_slotOf.size() + 1) * 8) cap <<= 1;
+
+    auto fill = [&](Index& idx) {
+        m_indexUsed = 0;
+        m_slotOf.forEach([&](const BtInfoHash& key, SlotRef& ref) {
+            indexInsert(idx, key, ref.id);
+            if (!ref.alias.empty()) indexInsert(idx, ref.alias, ref.id);
+        });
+    };
+
+    if (cap <= cur->mask + 1) {
+        uint32_t s = m_indexSeq.load(std::memory_order_relaxed);
+        m_indexSeq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i <= cur->mask; ++i) {
+            cur->cells[i].store(kEmpty, std::memory_order_relaxed);
+        }
+        fill(*cur);
+        m_indexSeq.store(s + 2, std::memory_order_release);
+        return;
+    }
+
+    std::unique_ptr<Index> idx(new Index(cap));
+    fill(*idx);
+    m_index.store(idx.get(), std::memory_order_release);
+    m_indexes.push_back(std::move(idx));
+}
+
+void BtStatusTable::indexErase(Index& idx, const BtInfoHash& key, uint32_t id)
+{
+    for (size_t i = key.hash() & idx.mask;; i = (i + 1) & idx.mask) {
+        uint32_t c = idx.cells[i].load(std::memory_order_relaxed);
+        if (c == id + 1) {
+            idx.cells[i].store(kTombstone, std::memory_order_release);
+            return;
+        }
+        if (c == kEmpty) return;
+    }
+}
+
+void BtStatusTable::put(const BtInfoHash& id, const BtInfoHash& alias, const BtTorrentStatus& st)
+{
+    if (update(id, alias, st)) return;
+
+    uint32_t slot = allocSlot();
+    if (slot == kTombstone) return;   // 超出上限，只是查不到状态
+
+    Payload p;
+    std::memset(&p, 0, sizeof(p));
+    p.live = 1;
+    p.id = id;
+    p.alias = alias;
+    p.st = st;
+    slotAt(slot)->write(p);
+
+    m_slotOf.insert(id, SlotRef{slot, alias});
+    Index* idx = m_index.load(std::memory_order_relaxed);
+    if ((m_indexUsed + 2) * 2 > idx->mask + 1) {
+        rebuildIndex();   // 重建后已经包含这一条
+    } else {
+        indexInsert(*idx, id, slot);
+        if (!alias.empty()) indexInsert(*idx, alias, slot);
+    }
+    m_live.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool BtStatusTable::update(const BtInfoHash& id, const BtInfoHash& alias, const BtTorrentStatus& st)
+{
+    SlotRef* ref = m_slotOf.find(id);
+    if (!ref) return false;
+
+    // 别名在登记后才知道（磁力链接拿到 metadata 之后）时补进索引
+    if (!alias.empty() && ref->alias != alias) {
+        Index* idx = m_index.load(std::memory_order_relaxed);
+        if (!ref->alias.empty()) indexErase(*idx, ref->alias, ref->id);
+        ref->alias = alias;
+        if ((m_indexUsed + 1) * 2 > idx->mask + 1) rebuildIndex();
+        else indexInsert(*idx, alias, ref->id);
+    }
+
+    Payload p;
+    std::memset(&p, 0, sizeof(p));
+    p.live = 1;
+    p.id = id;
+    p.alias = ref->alias;
+    p.st = st;
+    slotAt(ref->id)->write(p);
+    return true;
+}
+
+bool BtStatusTable::erase(const BtInfoHash& id)
+{
+    SlotRef* ref = m_slotOf.find(id);
+    if (!ref) return false;
+    SlotRef r = *ref;
+    m_slotOf.erase(id);
+
+    Index* idx = m_index.load(std::memory_order_relaxed);
+    indexErase(*idx, id, r.id);
+    if (!r.alias.empty()) indexErase(*idx, r.alias, r.id);
+
+    Payload p;
+    std::memset(&p, 0, sizeof(p));
+    slotAt(r.id)->write(p);
+    m_freeSlots.push_back(r.id);
+    m_live.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool BtStatusTable::get(const BtInfoHash& key, BtTorrentStatus& out) const
+{
+    if (key.empty()) return false;
+    Payload p;
+    for (int tries = 0; tries < 100; ++tries) {
+        uint32_t s1 = m_indexSeq.load(std::memory_order_acquire);
+        if (s1 & 1) continue;   // 正在原地重建
+
+        // 命中时槽位里核对过 key，结果总是对的；没命中可能是重建时清掉了，要核对 seq
+        const Index* idx = m_index.load(std::memory_order_acquire);
+        for (size_t i = key.hash() & idx->mask, n = 0; n <= idx->mask; i = (i + 1) & idx->mask, ++n) {
+            uint32_t c = idx->cells[i].load(std::memory_order_acquire);
+            if (c == kEmpty) break;
+            if (c == kTombstone) continue;
+
+            const Slot* slot = slotAt(c - 1);
+            if (!slot || !slot->read(p)) continue;
+            if (p.live && (p.id == key || p.alias == key)) {
+                out = p.st;
+                return true;
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_indexSeq.load(std::memory_order_relaxed) == s1) return false;
+    }
+    return false;
+}
+
+void BtStatusTable::getAll(std::vector<std::pair<BtInfoHash, BtTorrentStatus>>& out) const
+{
+    uint32_t n = m_slotCount.load(std::memory_order_acquire);
+    out.reserve(out.size() + size());
+    Payload p;
+    for (uint32_t id = 0; id < n; ++id) {
+        const Slot* slot = slotAt(id);
+        if (slot && slot->read(p) && p.live) {
+            out.emplace_back(p.id, p.st);
+        }
+    }
+}
@@ -0,0 +1,99 @@
+// src/bt_status_table.hpp
+#ifndef VS_BT_STATUS_TABLE_HPP
+#define VS_BT_STATUS_TABLE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "bt_api.h"
+#include "bt_infohash.hpp"
+
+// torrent 状态快照表。
+//
+// 只有 BT 线程写（put / update / erase），任意线程无锁读（get / getAll）。
+// 每个槽位用 seqlock 保护：写者先把 seq 变成奇数、写数据、再变回偶数，
+// 读者前后两次读到相同的偶数 seq 才算读到一致的快照，否则重读。
+// 槽位里带着 infohash，读者最后核对 key，槽位被删除后复用也不会读错。
+// hybrid torrent 的 v1 和 v2 两个 key 指向同一个槽位。
+//
+// infohash -> 槽位的索引是开放寻址表。墓碑太多而容量不用变时原地重建，
+// 期间 m_indexSeq 为奇数，读者查完核对 seq，变过就重查（同 bt_shm.h 的 index_seq）。
+// 容量不够时整张换新并原子发布；旧表可能还有读者在用，留到析构时再释放。
+// 容量只增不减、每次至少翻倍，退役的旧表加起来不超过当前表。
+class BtStatusTable {
+public:
+    BtStatusTable();
+    ~BtStatusTable();
+
+    BtStatusTable(const BtStatusTable&) = delete;
+    BtStatusTable& operator=(const BtStatusTable&) = delete;
+
+    // BT 线程：插入或覆盖，alias 可以为空
+    void put(const BtInfoHash& id, const BtInfoHash& alias, const BtTorrentStatus& st);
+    // BT 线程：只更新已存在的条目，不存在返回 false
+    bool update(const BtInfoHash& id, const BtInfoHash& alias, const BtTorrentStatus& st);
+    // BT 线程
+    bool erase(const BtInfoHash& id);
+
+    // 任意线程，key 可以是主 key 或别名
+    bool get(const BtInfoHash& key, BtTorrentStatus& out) const;
+    // 任意线程，每个 torrent 一条，key 为主 key
+    void getAll(std::vector<std::pair<BtInfoHash, BtTorrentStatus>>& out) const;
+    size_t size() const { return m_live.load(std::memory_order_relaxed); }
+
+private:
+    struct Payload {
+        uint32_t        live;
+        BtInfoHash      id;
+        BtInfoHash      alias;
+        BtTorrentStatus st;
+    };
+    static constexpr size_t kWords = (sizeof(Payload) + 7) / 8;
+
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<uint64_t> words[kWords];
+        void write(const Payload& p);
+        bool read(Payload& p) const;
+    };
+
+    static constexpr size_t   kChunkSlots = 256;
+    static constexpr size_t   kMaxChunks  = 4096;
+    static constexpr uint32_t kEmpty      = 0;
+    static constexpr uint32_t kTombstone  = 0xffffffffu;
+
+    struct Index {
+        size_t mask;
+        std::unique_ptr<std::atomic<uint32_t>[]> cells;   // 槽位号 + 1
+        explicit Index(size_t cap);
+    };
+
+    Slot* slotAt(uint32_t id) const;
+    uint32_t allocSlot();
+    void indexInsert(Index& idx, const BtInfoHash& key, uint32_t id);
+    void indexErase(Index& idx, const BtInfoHash& key, uint32_t id);
+    void rebuildIndex();
+
+    std::atomic<Slot*> m_chunks[kMaxChunks];
+    std::atomic<uint32_t> m_slotCount{0};   // 已分配过的槽位上界，getAll 扫到这里
+    std::atomic<size_t> m_live{0};
+
+    std::atomic<Index*> m_index{nullptr};
+    std::atomic<uint32_t> m_indexSeq{0};            // 原地重建期间为奇数
+    std::vector<std::unique_ptr<Index>> m_indexes;  // 当前的和已退役的
+
+    // 以下只在 BT 线程访问
+    struct SlotRef {
+        uint32_t   id;
+        BtInfoHash alias;
+    };
+    BtInfoHashMap<SlotRef> m_slotOf;
+    std::vector<uint32_t> m_freeSlots;
+    size_t m_indexUsed = 0;   // 含墓碑
+};
+
+#endif // VS_BT_STATUS_TABLE_HPP
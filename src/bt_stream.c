@@ -0,0 +1,217 @@
+// src/bt_stream.c
+#include "bt_stream.h"
+#include "bt_utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define BTD_STREAM_MAX     16
+#define BTD_STREAM_CHUNK   (4LL * 1024 * 1024)  // 每次等这么多数据就开始发，不超过 read_range 上限
+#define BTD_STREAM_WAIT_MS 1000                 // 单次 bt_wait_range 的时长，之间检查停止标志
+
+typedef struct BtdStream {
+    unsigned long long id;
+    BtHandle  *h;
+    char       infohash_hex[BT_INFOHASH_HEX_LEN];
+    int        file_index;
+    long long  offset;
+    long long  remaining;       // LLONG_MAX 表示到文件尾
+    int        timeout_ms;
+    int        sock;
+    int        slot;
+} BtdStream;
+
+static pthread_mutex_t g_stream_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_stream_cv   = PTHREAD_COND_INITIALIZER;
+static BtdStream *g_streams[BTD_STREAM_MAX];       // guarded by g_stream_lock
+static int        g_stream_count;                  // guarded by g_stream_lock
+static unsigned long long g_stream_next_id = 1;    // guarded by g_stream_lock
+static atomic_int g_stream_stop;
+
+static int send_all(int sock, const char *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = send(sock, p, n, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+// 数据已经在磁盘上，直接 sendfile；文件打不开（或在内存存储里）时退回 bt_read_range 拷贝一次
+static int send_range(BtdStream *s, int *fd, const BtFileRange *fr)
+{
+    if (*fd < 0 && fr->path[0]) *fd = open(fr->path, O_RDONLY | O_CLOEXEC);
+    if (*fd >= 0) {
+        off_t off = (off_t)fr->offset;
+        long long left = fr->length;
+        while (left > 0) {
+            ssize_t w = sendfile(s->sock, *fd, &off, (size_t)left);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return -1;
+            left -= w;
+        }
+        return 0;
+    }
+
+    char *buf = malloc((size_t)fr->length);
+    if (!buf) return -1;
+    size_t n = 0;
+    int rc = bt_read_range(s->h, s->infohash_hex, s->file_index, fr->offset, (size_t)fr->length,
+                           s->timeout_ms, buf, &n);
+    if (rc == 0) rc = send_all(s->sock, buf, n);
+    free(buf);
+    return rc;
+}
+
+static void *stream_main(void *arg)
+{
+    BtdStream *s = arg;
+    int fd = -1;
+    long long sent = 0;
+    const char *err = NULL;
+
+    while (s->remaining > 0 && !atomic_load(&g_stream_stop)) {
+        long long chunk = s->remaining < BTD_STREAM_CHUNK ? s->remaining : BTD_STREAM_CHUNK;
+        BtFileRange fr;
+        int rc, waited = 0;
+        for (;;) {
+            rc = bt_wait_range(s->h, s->infohash_hex, s->file_index, s->offset, chunk,
+                               BTD_STREAM_WAIT_MS, &fr);
+            if (rc != BT_ERR_TIMEOUT) break;
+            waited += BTD_STREAM_WAIT_MS;
+            if (waited >= s->timeout_ms || atomic_load(&g_stream_stop)) break;
+        }
+        if (rc != 0) {
+            err = rc == BT_ERR_TIMEOUT ? "timeout" : "wait failed";
+            break;
+        }
+        if (fr.length == 0) break;      // 文件尾
+        if (send_range(s, &fd, &fr) != 0) {
+            err = "send failed";
+            break;
+        }
+        s->offset += fr.length;
+        s->remaining -= fr.length;
+        sent += fr.length;
+    }
+
+    if (err) iloge("[btd] stream %llu: %s after %lld bytes", s->id, err, sent);
+    else     ilogi("[btd] stream %llu done, %lld bytes", s->id, sent);
+
+    // 先摘掉再关 socket，btd_stream_stop_all 只会 shutdown 还登记着的
+    pthread_mutex_lock(&g_stream_lock);
+    g_streams[s->slot] = NULL;
+    g_stream_count--;
+    pthread_cond_broadcast(&g_stream_cv);
+    pthread_mutex_unlock(&g_stream_lock);
+
+    if (fd >= 0) close(fd);
+    close(s->sock);
+    free(s);
+    return NULL;
+}
+
+int btd_stream_start(BtHandle *h,
+                     const char *infohash_hex,
+                     int file_index,
+                     long long offset,
+                     long long length,
+                     const char *socket_path,
+                     int timeout_ms,
+                     unsigned long long *out_id)
+{
+    struct sockaddr_un addr;
+    if (!h || !infohash_hex || !socket_path || !out_id) return -1;
+    if (file_index < 0 || offset < 0 || length < 0) return -1;
+    if (strlen(infohash_hex) >= BT_INFOHASH_HEX_LEN || strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) return -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        iloge("[btd] stream connect %s failed: %s", socket_path, strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    BtdStream *s = calloc(1, sizeof(*s));
+    if (!s) {
+        close(sock);
+        return -1;
+    }
+    s->h = h;
+    strcpy(s->infohash_hex, infohash_hex);
+    s->file_index = file_index;
+    s->offset = offset;
+    s->remaining = length > 0 ? length : LLONG_MAX;
+    s->timeout_ms = timeout_ms > 0 ? timeout_ms : 60000;
+    s->sock = sock;
+
+    pthread_mutex_lock(&g_stream_lock);
+    s->slot = -1;
+    if (!atomic_load(&g_stream_stop)) {
+        for (int i = 0; i < BTD_STREAM_MAX; i++) {
+            if (!g_streams[i]) {
+                s->slot = i;
+                break;
+            }
+        }
+    }
+    if (s->slot < 0) {
+        pthread_mutex_unlock(&g_stream_lock);
+        iloge("[btd] stream rejected: too many streams");
+        close(sock);
+        free(s);
+        return -1;
+    }
+    s->id = g_stream_next_id++;
+    g_streams[s->slot] = s;
+    g_stream_count++;
+
+    pthread_t t;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&t, &attr, stream_main, s);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        g_streams[s->slot] = NULL;
+        g_stream_count--;
+        pthread_mutex_unlock(&g_stream_lock);
+        close(sock);
+        free(s);
+        return -1;
+    }
+    *out_id = s->id;
+    pthread_mutex_unlock(&g_stream_lock);
+    return 0;
+}
+
+void btd_stream_stop_all(void)
+{
+    pthread_mutex_lock(&g_stream_lock);
+    atomic_store(&g_stream_stop, 1);
+    // 打断阻塞中的 sendfile；等数据的线程最多 BTD_STREAM_WAIT_MS 后看到停止标志
+    for (int i = 0; i < BTD_STREAM_MAX; i++) {
+        if (g_streams[i]) shutdown(g_streams[i]->sock, SHUT_RDWR);
+    }
+    while (g_stream_count > 0) pthread_cond_wait(&g_stream_cv, &g_stream_lock);
+    pthread_mutex_unlock(&g_stream_lock);
+}
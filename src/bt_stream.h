@@ -0,0 +1,25 @@
+// src/bt_stream.h
+#ifndef VS_BT_STREAM_H
+#define VS_BT_STREAM_H
+
+#include "bt_api.h"
+
+// stream_range：把 torrent 里一个文件的一段写到客户端的 Unix socket 上。
+// 连接在调用线程里建立（失败直接返回 -1），之后由独立线程按块 bt_wait_range，
+// 数据到齐一块就从磁盘 sendfile 一块，不经过 JSON。写完或出错时关闭连接，
+// 客户端按 EOF 判断结束，收到的字节数不足 length 表示中途失败。
+// length 为 0 表示到文件尾；timeout_ms 是单块等待数据的超时，<= 0 时用 60000。
+// sendfile 没有 MSG_NOSIGNAL，进程要忽略 SIGPIPE（main 里已处理）
+int  btd_stream_start(BtHandle *h,
+                      const char *infohash_hex,
+                      int file_index,
+                      long long offset,
+                      long long length,
+                      const char *socket_path,
+                      int timeout_ms,
+                      unsigned long long *out_id);
+
+// 中断所有流并等线程退出，必须在 bt_shutdown 之前调用
+void btd_stream_stop_all(void);
+
+#endif // VS_BT_STREAM_H
@@ -4,18 +4,21 @@
 
 #include "bt_utils.h"
 #include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
 #include <threads.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "../ver/version.h"
 #include "../ver/build_version.h"
-int d = 0;
-static int debug(){
-    return d;
-}
+
+static atomic_int g_log_level = 0;
 
 const char *rsx_version(){
     return RSUNX_VERSION;
@@ -26,39 +29,337 @@ const char *build_version(){
 }
 
 void set_debug(int dbg){
-    d = dbg;
+    if (dbg < 0) dbg = 0;
+    atomic_store_explicit(&g_log_level, dbg, memory_order_relaxed);
 }
 
-#define LOG_BUFFER_SIZE 512000
-static const char *timestr() {
-    time_t t;
-    time(&t);
-    struct tm *timeinfo = localtime(&t);
+int get_debug(void){
+    return atomic_load_explicit(&g_log_level, memory_order_relaxed);
+}
+
+int log_enabled(int level){
+    return level <= atomic_load_explicit(&g_log_level, memory_order_relaxed);
+}
+
+/*
+ * 异步日志
+ *
+ * 每个打日志的线程有自己的单生产者环形缓冲区，格式化好的消息连同毫秒时间戳写进去就返回，
+ * 不加锁、不进内核；后台线程定期把所有环里的消息取出，统一加时间前缀后批量 write 到 stderr。
+ * 环满时丢弃并计数，不阻塞调用方（BT 线程处理 alert 时也在打日志）。
+ * 同一调用点（按 format 指针区分）每秒最多 LOG_RATE_BURST 条，多出的只计数。
+ * 后台线程没起来或已经停止时退回同步写。
+ */
+#define LOG_MSG_MAX        1024                // 单条消息上限，超出截断
+#define LOG_RING_SIZE      (64 * 1024)         // 2 的幂
+#define LOG_OUT_SIZE       (64 * 1024)
+#define LOG_DRAIN_MS       50
+#define LOG_RATE_WINDOW_MS 1000
+#define LOG_RATE_BURST     20
+#define LOG_RATE_SLOTS     64
+
+typedef struct LogRecHdr {
+    uint32_t len;           // 消息长度，不含 '\0'
+    uint32_t level;
+    uint64_t ts_ms;
+} LogRecHdr;
+
+typedef struct LogRing {
+    _Alignas(64) atomic_size_t head;       // 后台线程
+    _Alignas(64) atomic_size_t tail;       // 所属线程
+    atomic_ulong dropped;
+    atomic_int   orphan;                   // 所属线程已退出，取空后释放
+    struct LogRing *next;                  // guarded by g_rings_lock
+    char data[LOG_RING_SIZE];
+} LogRing;
+
+typedef struct LogRate {
+    const char *fmt;
+    uint64_t    window_ms;
+    unsigned    count;
+    unsigned    suppressed;
+} LogRate;
 
-    thread_local static char str[20];
-    strftime(str, sizeof(str), "%Y-%m-%d %H:%M:%S", timeinfo);
+static pthread_once_t  g_log_once   = PTHREAD_ONCE_INIT;
+static pthread_key_t   g_ring_key;
+static pthread_t       g_drain_thread;
+static atomic_int      g_log_running = 0;
+static atomic_int      g_log_stop = 0;
+static pthread_mutex_t g_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_drain_cv   = PTHREAD_COND_INITIALIZER;
+static LogRing        *g_rings = NULL;
 
+static thread_local LogRing *t_ring = NULL;
+static thread_local LogRate  t_rate[LOG_RATE_SLOTS];
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// 只在后台线程（或停止后的同步路径）调用；秒不变时复用上次的结果
+static const char *timestr(uint64_t ms) {
+    static thread_local time_t cached_sec = (time_t)-1;
+    static thread_local char str[20];
+
+    time_t sec = (time_t)(ms / 1000);
+    if (sec != cached_sec) {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        strftime(str, sizeof(str), "%Y-%m-%d %H:%M:%S", &tm);
+        cached_sec = sec;
+    }
     return str;
 }
 
-void iloge(const char *format, ...) {
-    if (debug()<1) {
-        return;
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDERR_FILENO, buf, len);
+        if (n <= 0) return;
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+static void write_sync(uint64_t ts, const char *msg) {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&lock);
+    fprintf(stderr, "<%s> %s\n", timestr(ts), msg);
+    pthread_mutex_unlock(&lock);
+}
+
+static void ring_orphan(void *p) {
+    atomic_store_explicit(&((LogRing *)p)->orphan, 1, memory_order_release);
+}
+
+static void log_stop(void) {
+    if (!atomic_exchange(&g_log_running, 0)) return;
+    pthread_mutex_lock(&g_drain_lock);
+    atomic_store(&g_log_stop, 1);
+    pthread_cond_signal(&g_drain_cv);
+    pthread_mutex_unlock(&g_drain_lock);
+    pthread_join(g_drain_thread, NULL);
+}
+
+/* ---------- 后台线程 ---------- */
+
+typedef struct LogOut {
+    char   buf[LOG_OUT_SIZE];
+    size_t len;
+} LogOut;
+
+static void out_line(LogOut *o, uint64_t ts, const char *msg, size_t len) {
+    // "<YYYY-mm-dd HH:MM:SS> " + msg + "\n"
+    if (o->len + len + 24 > sizeof(o->buf)) {
+        write_all(o->buf, o->len);
+        o->len = 0;
+    }
+    o->buf[o->len++] = '<';
+    memcpy(o->buf + o->len, timestr(ts), 19);
+    o->len += 19;
+    o->buf[o->len++] = '>';
+    o->buf[o->len++] = ' ';
+    memcpy(o->buf + o->len, msg, len);
+    o->len += len;
+    o->buf[o->len++] = '\n';
+}
+
+static void ring_read(const LogRing *r, size_t pos, void *dst, size_t n) {
+    size_t off = pos & (LOG_RING_SIZE - 1);
+    size_t first = n < LOG_RING_SIZE - off ? n : LOG_RING_SIZE - off;
+    memcpy(dst, r->data + off, first);
+    memcpy((char *)dst + first, r->data, n - first);
+}
+
+// 返回取出的条数
+static size_t drain_ring(LogRing *r, LogOut *o) {
+    static char msg[LOG_MSG_MAX];
+    size_t count = 0;
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    while (head != tail) {
+        LogRecHdr h;
+        ring_read(r, head, &h, sizeof(h));
+        ring_read(r, head + sizeof(h), msg, h.len);
+        out_line(o, h.ts_ms, msg, h.len);
+        head += (sizeof(h) + h.len + 7) & ~(size_t)7;
+        count++;
+    }
+    atomic_store_explicit(&r->head, head, memory_order_release);
+
+    unsigned long dropped = atomic_exchange_explicit(&r->dropped, 0, memory_order_relaxed);
+    if (dropped > 0) {
+        int n = snprintf(msg, sizeof(msg), "[log] ring full, %lu messages dropped", dropped);
+        out_line(o, now_ms(), msg, (size_t)n);
+    }
+    return count;
+}
+
+static size_t drain_all(LogOut *o) {
+    size_t count = 0;
+    pthread_mutex_lock(&g_rings_lock);
+    for (LogRing **pp = &g_rings; *pp;) {
+        LogRing *r = *pp;
+        // 先看 orphan：置位后不会再有新消息，这一轮取完即可释放
+        int orphan = atomic_load_explicit(&r->orphan, memory_order_acquire);
+        count += drain_ring(r, o);
+        if (orphan) {
+            *pp = r->next;
+            free(r);
+        } else {
+            pp = &r->next;
+        }
+    }
+    pthread_mutex_unlock(&g_rings_lock);
+
+    if (o->len > 0) {
+        write_all(o->buf, o->len);
+        o->len = 0;
     }
+    return count;
+}
+
+static void *log_drain_main(void *arg) {
+    (void)arg;
+    static LogOut out;
+
+    for (;;) {
+        size_t n = drain_all(&out);
+        if (atomic_load(&g_log_stop)) {
+            if (n == 0) break;
+            continue;
+        }
+        if (n > 0) continue;
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += LOG_DRAIN_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&g_drain_lock);
+        if (!atomic_load(&g_log_stop))
+            pthread_cond_timedwait(&g_drain_cv, &g_drain_lock, &ts);
+        pthread_mutex_unlock(&g_drain_lock);
+    }
+    return NULL;
+}
 
-    if (format == NULL) return;
+static void log_start(void) {
+    if (pthread_key_create(&g_ring_key, ring_orphan) != 0) return;
+    if (pthread_create(&g_drain_thread, NULL, log_drain_main, NULL) != 0) return;
+    atomic_store(&g_log_running, 1);
+    atexit(log_stop);
+}
+
+/* ---------- 生产者 ---------- */
+
+static LogRing *thread_ring(void) {
+    if (t_ring) return t_ring;
 
-    char buffer[LOG_BUFFER_SIZE];
-    va_list args;
-    va_start(args, format);
+    LogRing *r = calloc(1, sizeof(LogRing));
+    if (!r) return NULL;
+    pthread_setspecific(g_ring_key, r);
 
-    int ret = vsnprintf(buffer, LOG_BUFFER_SIZE, format, args);
-    va_end(args);
+    pthread_mutex_lock(&g_rings_lock);
+    r->next = g_rings;
+    g_rings = r;
+    pthread_mutex_unlock(&g_rings_lock);
+
+    t_ring = r;
+    return r;
+}
 
-    if (ret < 0 || ret >= LOG_BUFFER_SIZE) {
+static void ring_write(LogRing *r, size_t pos, const void *src, size_t n) {
+    size_t off = pos & (LOG_RING_SIZE - 1);
+    size_t first = n < LOG_RING_SIZE - off ? n : LOG_RING_SIZE - off;
+    memcpy(r->data + off, src, first);
+    memcpy(r->data, (const char *)src + first, n - first);
+}
+
+static void log_emit(int level, uint64_t ts, const char *msg, size_t len) {
+    LogRing *r = atomic_load_explicit(&g_log_running, memory_order_acquire) ? thread_ring() : NULL;
+    if (!r) {
+        write_sync(ts, msg);
+        return;
+    }
 
-        fprintf(stderr, "iloge error: failed to format iloge message or message too long.\n");
+    size_t need = (sizeof(LogRecHdr) + len + 7) & ~(size_t)7;
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t used = tail - head;
+    if (need > LOG_RING_SIZE - used) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
         return;
     }
-    fprintf(stderr, "<%s> %s\n", timestr(), buffer);
-}
\ No newline at end of file
+
+    LogRecHdr h = { (uint32_t)len, (uint32_t)level, ts };
+    ring_write(r, tail, &h, sizeof(h));
+    ring_write(r, tail + sizeof(h), msg, len);
+    atomic_store_explicit(&r->tail, tail + need, memory_order_release);
+
+    // 平时由后台线程定时来取，快满时提前叫醒
+    if (used + need > LOG_RING_SIZE / 2)
+        pthread_cond_signal(&g_drain_cv);
+}
+
+// 返回 0 表示这条被限流
+static int log_rate_check(const char *format, uint64_t ts) {
+    LogRate *rt = &t_rate[((uintptr_t)format >> 3) % LOG_RATE_SLOTS];
+    char note[128];
+
+    if (rt->fmt != format || ts - rt->window_ms >= LOG_RATE_WINDOW_MS) {
+        if (rt->suppressed > 0) {
+            int n = snprintf(note, sizeof(note), "[log] %u similar messages suppressed: %.80s",
+                             rt->suppressed, rt->fmt);
+            log_emit(BT_LOG_ERROR, ts, note, (size_t)n < sizeof(note) ? (size_t)n : sizeof(note) - 1);
+        }
+        rt->fmt = format;
+        rt->window_ms = ts;
+        rt->count = 0;
+        rt->suppressed = 0;
+    }
+    if (++rt->count > LOG_RATE_BURST) {
+        rt->suppressed++;
+        return 0;
+    }
+    return 1;
+}
+
+static void vlog(int level, const char *format, va_list args) {
+    if (format == NULL || !log_enabled(level)) return;
+
+    pthread_once(&g_log_once, log_start);
+
+    uint64_t ts = now_ms();
+    if (!log_rate_check(format, ts)) return;
+
+    static thread_local char buffer[LOG_MSG_MAX];
+    int ret = vsnprintf(buffer, sizeof(buffer), format, args);
+    if (ret < 0) return;
+
+    size_t len = (size_t)ret;
+    if (len >= sizeof(buffer)) {
+        len = sizeof(buffer) - 1;
+        memcpy(buffer + len - 3, "...", 3);
+    }
+    log_emit(level, ts, buffer, len);
+}
+
+#define DEFINE_LOG_FN(name, level)              \
+    void name(const char *format, ...) {        \
+        va_list args;                           \
+        va_start(args, format);                 \
+        vlog(level, format, args);              \
+        va_end(args);                           \
+    }
+
+DEFINE_LOG_FN(ilogs,   BT_LOG_ERROR)
+DEFINE_LOG_FN(iloge,   BT_LOG_ERROR)
+DEFINE_LOG_FN(ilogi,   BT_LOG_INFO)
+DEFINE_LOG_FN(ilogii,  BT_LOG_DEBUG)
+DEFINE_LOG_FN(ilogiii, BT_LOG_TRACE)
@@ -9,7 +9,19 @@ extern "C" {
 #endif
 const char *rsx_version();
 const char *build_version();
+
+// 日志级别：set_debug 设置阈值，0 关闭，数字越大越详细，运行中可随时修改
+#define BT_LOG_ERROR 1      // ilogs / iloge
+#define BT_LOG_INFO  2      // ilogi
+#define BT_LOG_DEBUG 3      // ilogii
+#define BT_LOG_TRACE 4      // ilogiii
+
 void set_debug(int dbg);
+int  get_debug(void);
+// 参数本身构造代价大时（比如 alert->message()）先判断再打
+int  log_enabled(int level);
+
+// 异步写 stderr，不阻塞调用线程；同一调用点每秒超过 20 条的部分会被合并计数
 void ilogs(const char *format, ...);
 void ilogi(const char *format, ...);
 void ilogii(const char *format, ...);